@@ -0,0 +1,119 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_ACCEPT_THREAD_H
+#define COMP8005_ASSN2_ACCEPT_THREAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "client.h"
+
+#define ACCEPT_QUEUE_SIZE 4096 // Clients waiting for one event loop; must be a power of two
+#define ACCEPT_CACHE_LINE 64
+
+/**
+ * How the accept thread picks the event loop for each new client.
+ */
+typedef enum
+{
+    ACCEPT_POLICY_NONE = 0,    // No accept thread; each event loop accepts for itself
+    ACCEPT_POLICY_ROUND_ROBIN,
+    ACCEPT_POLICY_LEAST_CONN,  // Fewest clients handed over and not yet closed
+    ACCEPT_POLICY_LEAST_BYTES, // Fewest bytes buffered or waiting to be echoed, then fewest clients
+} accept_policy_t;
+
+/**
+ * A single-producer, single-consumer queue of accepted clients for one event loop. The accept thread is the only
+ * writer of tail and the event loop the only writer of head, so neither side takes a lock; the loop learns that there
+ * are clients waiting through event_fd, which it watches along with its clients' sockets.
+ */
+typedef struct
+{
+    client_t slots[ACCEPT_QUEUE_SIZE];
+
+    atomic_size_t head; // Next slot for the event loop to take
+    char head_pad[ACCEPT_CACHE_LINE - sizeof(atomic_size_t)];
+    atomic_size_t tail; // Next slot for the accept thread to fill
+    char tail_pad[ACCEPT_CACHE_LINE - sizeof(atomic_size_t)];
+
+    int event_fd;  // Readable while clients are waiting
+    int signalled; // Set by the accept thread when it has queued clients since last writing event_fd
+
+    // Load the event loop reports back for the policies
+    atomic_size_t connections;     // Clients handed to this loop and not yet closed
+    atomic_size_t bytes_in_flight; // Input buffered and echoes queued across the loop's clients
+} accept_queue_t;
+
+/**
+ * A thread that does nothing but accept clients, in batches, and hand them to event loops through their queues.
+ */
+typedef struct
+{
+    pthread_t thread;
+    int listen_sock;
+    int stop_fd; // Written to wake the thread when the server is shutting down
+    accept_queue_t* queues;
+    size_t num_queues;
+    accept_policy_t policy;
+    size_t next; // Round-robin position
+    int running;
+} accept_thread_t;
+
+/**
+ * Parses a policy name: "rr", "least-conn" or "least-bytes".
+ *
+ * @return The policy, or ACCEPT_POLICY_NONE if the name isn't one of them.
+ */
+accept_policy_t accept_policy_parse(char const* name);
+
+/**
+ * Sets up an empty queue and its eventfd.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+int accept_queue_init(accept_queue_t* queue);
+
+/**
+ * Clears event_fd and takes up to max waiting clients off the queue. Called by the queue's event loop when event_fd is
+ * readable; the sockets are already non-blocking.
+ *
+ * @return The number of clients taken. If this is max, more may still be waiting, so the loop should call again.
+ */
+size_t accept_queue_take(accept_queue_t* queue, client_t* out, size_t max);
+
+/**
+ * Closes any clients still waiting in the queue and its eventfd. The accept thread must have stopped.
+ */
+void accept_queue_release(accept_queue_t* queue);
+
+/**
+ * Makes the listening socket non-blocking and starts a thread that accepts on it and spreads the clients over the
+ * given queues. SIGINT and SIGQUIT are blocked in the thread so that they still interrupt the event loops.
+ *
+ * @param thread      The accept thread to start.
+ * @param listen_sock The listening socket.
+ * @param queues      One queue per event loop; these have to outlive the thread.
+ * @param num_queues  The number of queues.
+ * @param policy      How to choose the queue for each client.
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+int accept_thread_start(accept_thread_t* thread, int listen_sock, accept_queue_t* queues, size_t num_queues,
+                        accept_policy_t policy);
+
+/**
+ * Wakes the accept thread and waits for it to exit. Does nothing if it was never started.
+ */
+void accept_thread_stop(accept_thread_t* thread);
+
+/**
+ * Writes the number of clients accepted, the batches they were accepted in and the event loop wakeups it took to hand
+ * them over. Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int accept_thread_report(char* buf, size_t len);
+
+#endif //COMP8005_ASSN2_ACCEPT_THREAD_H
@@ -5,17 +5,39 @@
 #ifndef COMP8005_ASSN2_ACCEPTOR_H
 #define COMP8005_ASSN2_ACCEPTOR_H
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "client.h"
 
+#define ACCEPT_EXHAUSTED     (-2) // accept_clients ran out of fds; the waiting clients were shed to say so
+#define ACCEPT_LOW_WATER_PCT 90   // A paused listener is watched again once its clients drop to this % of the count...
+#define ACCEPT_RETRY_MS      100  // ...or after this long, in case fds were freed somewhere else in the process
+#define ACCEPT_SHED_MAX      256  // Most clients shed at once
+
 typedef struct
 {
     struct addrinfo* info;
     unsigned short port;
     int sock;
+    int reuseport; // Set when the server opens a listener per event loop, so that they join one SO_REUSEPORT group
 } acceptor_t;
 
 /**
- * Attempts to accept a client using the given acceptor.
+ * Tracks a listener that an event loop has stopped watching because the process ran out of fds.
+ */
+typedef struct
+{
+    atomic_int paused;
+    size_t resume_below; // Watch the listener again once the loop has fewer clients than this
+    uint64_t since_ms;   // When it was paused, for the retry interval
+} accept_pause_t;
+
+/**
+ * Attempts to accept a client using the given acceptor. When the process runs out of fds, the waiting clients are
+ * accepted and shed (see accept_shed) and the call waits ACCEPT_RETRY_MS before trying again, rather than failing and
+ * taking the server down with it.
  *
  * @param acceptor The acceptor containing a socket on which to accept a client.
  * @param out      A client structure that will hold the new client's information on success.
@@ -23,6 +45,71 @@ typedef struct
  */
 int accept_client(acceptor_t* acceptor, client_t* out);
 
+/**
+ * Accepts as many clients as are waiting, up to max, with sockets that are already non-blocking and close-on-exec.
+ *
+ * @param listen_sock The listening socket, which must be non-blocking.
+ * @param out         An array of at least max clients that will hold the new clients.
+ * @param max         The most clients to accept.
+ * @return The number of clients accepted (0 if none were waiting); ACCEPT_EXHAUSTED if the process is out of fds and
+ *         none were accepted, in which case the waiting clients were shed and the caller should stop watching the
+ *         listener for a while (see accept_pause_start); or -1 on failure (an error message will have been
+ *         printed already, unless the server is shutting down).
+ */
+int accept_clients(int listen_sock, client_t* out, size_t max);
+
+/**
+ * Accepts the clients waiting in the backlog (up to ACCEPT_SHED_MAX) and closes each straight away with a reset, using
+ * an fd kept in reserve for the purpose, so that clients that can't be served are told so instead of waiting. Doesn't
+ * block if none are waiting.
+ *
+ * @param listen_sock The listening socket.
+ * @return The number of clients shed; 0 if none were waiting or the reserve fd couldn't be had.
+ */
+int accept_shed(int listen_sock);
+
+/**
+ * Records that a loop has stopped watching its listener for want of fds. It should watch it again once
+ * accept_pause_over says so.
+ *
+ * @param pause       The loop's pause state.
+ * @param connections The clients the loop has now.
+ * @return 1 if this call paused the listener, 0 if it already was.
+ */
+int accept_pause_start(accept_pause_t* pause, size_t connections);
+
+/**
+ * Ends a pause once the loop's clients have dropped below the low-water mark or ACCEPT_RETRY_MS has passed.
+ *
+ * @param pause       The loop's pause state.
+ * @param connections The clients the loop has now.
+ * @return 1 if this call ended the pause and the listener should be watched again, 0 otherwise.
+ */
+int accept_pause_over(accept_pause_t* pause, size_t connections);
+
+/**
+ * Returns the longest a paused loop should wait for events before calling accept_pause_over, or -1 if it isn't paused.
+ */
+int accept_pause_wait_ms(accept_pause_t* pause);
+
+/**
+ * Writes the number of clients shed and listener pauses, or nothing if there were none. Safe to call from a signal
+ * handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int accept_overload_report(char* buf, size_t len);
+
+/**
+ * Creates a socket bound to the acceptor's address and calls listen() on it. SO_REUSEADDR and SO_REUSEPORT are set
+ * on the socket, so several listening sockets can be opened for one acceptor and the kernel will spread incoming
+ * connections between them.
+ *
+ * @param acceptor The acceptor, whose info must already have been filled in by getaddrinfo.
+ * @return The listening socket, or -1 on failure (an error message will have been printed already).
+ */
+int open_listen_socket(acceptor_t const* acceptor);
+
 /**
  * Cleans up the acceptor's addrinfo and socket.
  *
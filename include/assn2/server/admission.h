@@ -0,0 +1,47 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_ADMISSION_H
+#define COMP8005_ASSN2_ADMISSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_ADMISSION_TARGET_US 1000 // Latency below which nothing is taken as queueing
+
+/**
+ * Returns whether admission control is on (server_config.admission_limit was set).
+ */
+int admission_enabled(void);
+
+/**
+ * Decides whether a new client can be served, given the clients already in flight. A client past the limit is closed
+ * straight away with a reset, so it learns at once instead of adding to everyone's latency.
+ *
+ * @param sock      The new client's socket.
+ * @param in_flight The clients being served, not counting this one.
+ * @return 1 if the client was admitted, or 0 if it was rejected (and its socket closed).
+ */
+int admission_admit(int sock, size_t in_flight);
+
+/**
+ * Feeds a measured echo latency into the limit. Every few samples the limit is moved towards the concurrency at which
+ * latency stays near its baseline. Thread-safe; does nothing if admission control is off.
+ *
+ * @param latency_ns The time between a client's message arriving and its echo going out, for a server that times each
+ *                   echo. The event loops pass the length of a pass over their ready clients instead, which is how long
+ *                   the last client served in it waited.
+ * @param in_flight  The clients being served when it was measured.
+ */
+void admission_sample(uint64_t latency_ns, size_t in_flight);
+
+/**
+ * Writes the current limit, the range it moved over, the latencies it was worked out from, and the clients admitted
+ * and rejected, or nothing if admission control is off. Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int admission_report(char* buf, size_t len);
+
+#endif //COMP8005_ASSN2_ADMISSION_H
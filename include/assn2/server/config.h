@@ -0,0 +1,52 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_CONFIG_H
+#define COMP8005_ASSN2_CONFIG_H
+
+#include <stddef.h>
+
+#define DEFAULT_READ_BUDGET    (64 * 1024) // Bytes read from one client per event loop turn
+#define DEFAULT_MESSAGE_BUDGET 64          // Messages handled for one client per event loop turn
+
+/**
+ * Tunables set from the command line before serve() is called. Zero means "use the server's default" unless noted.
+ */
+typedef struct
+{
+    unsigned int reactors; // Number of event loop threads for servers that run several; 0 for one per online CPU
+
+    // thread server pool sizing
+    unsigned int pool_min;
+    unsigned int pool_max;
+    unsigned long idle_timeout_ms; // How long a worker above pool_min waits for a client before exiting
+    size_t worker_stack_size;      // Stack size for thread server workers and coroutines; 0 for the default
+    size_t worker_guard_size;      // Guard region below each worker's or coroutine's stack; 0 for the default
+
+    // epoll-pool handler pool
+    unsigned int handler_threads;  // 0 for one per online CPU
+    unsigned int handler_cost;     // Checksum passes over each message to simulate handler CPU work; 0 for none
+
+    size_t splice_threshold;       // epoll/select splice message bodies at least this big instead of copying; 0 for never
+    size_t zerocopy_threshold;     // epoll sends echoes at least this big with MSG_ZEROCOPY; 0 for never
+    size_t out_high_water;         // epoll/select stop reading a connection with this many echo bytes queued
+    size_t read_budget;            // epoll/select bytes read from one client before moving on to the others
+    unsigned int message_budget;   // epoll/select messages handled for one client before moving on to the others
+    unsigned int accept_policy;    // epoll/select accept_policy_t for a dedicated accept thread; 0 to accept in the event loops
+    char const* socket_profile;    // socket_profile_find name for listening and accepted sockets; NULL for "default"
+    int release_idle;              // epoll/select give a connection's buffers back whenever it has nothing buffered or queued
+
+    // epoll connection deadlines in milliseconds; 0 for none
+    unsigned long client_idle_ms;     // Nothing buffered or queued and nothing received
+    unsigned long header_timeout_ms;  // Partway through a frame and nothing more received
+    unsigned long send_timeout_ms;    // Echoes queued and nothing more sent
+
+    // Adaptive admission control
+    unsigned int admission_limit;      // Starting limit on clients in flight; 0 for no admission control
+    unsigned long admission_target_us; // Echo latency below which the limit never comes down; 0 for the default
+} server_config_t;
+
+extern server_config_t server_config;
+
+#endif //COMP8005_ASSN2_CONFIG_H
@@ -0,0 +1,83 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_ECHO_H
+#define COMP8005_ASSN2_ECHO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "frame.h"
+#include "output_queue.h"
+#include "zero_copy.h"
+
+#define ECHO_OPEN     0 // echo_conn_serve's result for a client that's still connected
+#define ECHO_FINISHED 1 // ...and for one that sent a size of 0 or closed its side
+
+/**
+ * A connection served by one of the readiness-based loops (select and poll): its input and output buffers, the splice
+ * in progress, and its transfer stats.
+ */
+typedef struct
+{
+    frame_decoder_t input;
+    output_queue_t output;
+    size_t splice_left; // Body bytes of the current message still to be spliced
+    splice_pipe_t splice;
+    ssize_t transferred;
+    time_t transfer_time;
+} echo_conn_t;
+
+/**
+ * Sets up a connection's state for a new client. Nothing is allocated until the first read.
+ */
+void echo_conn_init(echo_conn_t* conn);
+
+/**
+ * Reads and echoes whatever the client has sent, until the socket would block or the client has used up its read
+ * budget for this pass (server_config.read_budget bytes or server_config.message_budget messages); what's left on the
+ * socket keeps it ready for the next one, after the other clients. Echoes that the socket won't take stay queued.
+ *
+ * @param sock The client's (non-blocking) socket.
+ * @param conn The client's connection state.
+ * @return ECHO_OPEN if the client is still connected, ECHO_FINISHED if it's done, or -1 on failure (with errno set).
+ *         The socket is left open either way; see echo_conn_close.
+ */
+int echo_conn_serve(int sock, echo_conn_t* conn);
+
+/**
+ * Returns whether the loop should watch the client for input: not while it's throttled for not keeping up with its
+ * echoes, nor while its splice pipe holds data the socket wouldn't take, since nothing more is read until that's sent.
+ */
+int echo_conn_wants_read(echo_conn_t const* conn);
+
+/**
+ * Returns whether the loop should watch the client for output: only while it has echoes waiting, in its output queue
+ * or its splice pipe.
+ */
+int echo_conn_wants_write(echo_conn_t const* conn);
+
+/**
+ * Returns the bytes buffered for the client, input and output, for the accept thread's load balancing.
+ */
+size_t echo_conn_in_flight(echo_conn_t const* conn);
+
+/**
+ * Closes a client that echo_conn_serve has finished with, logging its transfer stats if it finished cleanly or the
+ * error if it failed, and releases its buffers.
+ *
+ * @param sock   The client's socket.
+ * @param conn   The client's connection state, which is ready for echo_conn_init afterwards.
+ * @param result What echo_conn_serve returned: ECHO_FINISHED or -1.
+ * @param peer   The client's address, for the log.
+ */
+void echo_conn_close(int sock, echo_conn_t* conn, int result, struct sockaddr_in const* peer);
+
+/**
+ * Releases a connection's buffers without logging anything, e.g. when the server shuts down.
+ */
+void echo_conn_release(echo_conn_t* conn);
+
+#endif //COMP8005_ASSN2_ECHO_H
@@ -0,0 +1,104 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_FRAME_H
+#define COMP8005_ASSN2_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FRAME_HEADER_SIZE sizeof(uint32_t)
+
+/**
+ * A connection's input buffer. Each recv reads as much as will fit, and the frames (4-byte size header, then body) are
+ * parsed out of it in place, so a client that pipelines its messages needs far fewer than one recv per message.
+ */
+typedef struct
+{
+    char* buf;    // From the buffer pool; NULL until the first read
+    size_t start; // First byte not yet consumed
+    size_t end;   // One past the last byte received
+    int eof;      // Set once the peer has closed its side
+    int drained;  // Set when the last recv came up short, so the socket has nothing more to read for now
+} frame_decoder_t;
+
+/**
+ * Sets up an empty decoder. Nothing is allocated until the first read.
+ */
+void frame_decoder_init(frame_decoder_t* dec);
+
+/**
+ * Reads from the socket with a single recv, into whatever space is free after the buffered bytes. If a frame header has
+ * been buffered, the buffer is first compacted or grown so that the whole frame will fit.
+ *
+ * @param sock The client's (non-blocking) socket.
+ * @param dec  The connection's decoder.
+ * @return The number of bytes read, 0 if the socket would block or the peer has closed (dec->eof is set), or -1 on
+ *         failure.
+ */
+ssize_t frame_fill(int sock, frame_decoder_t* dec);
+
+/**
+ * Gets the body size from the header of the next frame.
+ *
+ * @return 1 if the whole header has been buffered, or 0 if not.
+ */
+int frame_header(frame_decoder_t const* dec, uint32_t* size);
+
+/**
+ * Returns the number of bytes of the next frame's body that have been buffered, which may be more than the body size
+ * if further frames follow it. Only valid once frame_header has succeeded.
+ */
+size_t frame_body_buffered(frame_decoder_t const* dec);
+
+/**
+ * Returns the next frame's body if all of it has been buffered, or NULL if not. The body stays valid until the frame
+ * is consumed or the decoder is filled again.
+ */
+char* frame_body(frame_decoder_t const* dec, uint32_t size);
+
+/**
+ * Discards a handled frame (or the start of one) from the front of the buffer. Each call counts as one frame decoded.
+ */
+void frame_consume(frame_decoder_t* dec, size_t len);
+
+/**
+ * Consumes len bytes and hands the buffer itself over to the caller (to be freed with buffer_free), so that data in
+ * it can outlive the frame. Any bytes after the consumed ones are copied into a new buffer.
+ *
+ * @return The old buffer, or NULL if a new buffer couldn't be allocated (in which case nothing is consumed).
+ */
+char* frame_detach(frame_decoder_t* dec, size_t len);
+
+/**
+ * Consumes the header of a frame whose body is to be spliced, along with whatever part of the body is already
+ * buffered; the rest of the body is left on the socket for splice_echo.
+ *
+ * @param dec  The connection's decoder, holding at least the frame's header.
+ * @param size The frame's body size.
+ * @param body Set to the part of the body that was buffered, which stays valid until the decoder is filled again.
+ * @return The number of body bytes consumed.
+ */
+size_t frame_consume_partial(frame_decoder_t* dec, uint32_t size, char const** body);
+
+/**
+ * Gives the decoder's buffer back to the pool if nothing is left in it. The next frame_fill takes another one only if
+ * it receives something.
+ */
+void frame_decoder_trim(frame_decoder_t* dec);
+
+/**
+ * Frees the decoder's buffer.
+ */
+void frame_decoder_release(frame_decoder_t* dec);
+
+/**
+ * Writes the number of frames parsed and of recv calls made by every decoder. Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int frame_stats_report(char* buf, size_t len);
+
+#endif //COMP8005_ASSN2_FRAME_H
@@ -0,0 +1,76 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_OUTPUT_QUEUE_H
+#define COMP8005_ASSN2_OUTPUT_QUEUE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "vector.h"
+
+#define DEFAULT_OUT_HIGH_WATER (256 * 1024)
+
+/**
+ * Echo data waiting to be sent on a connection. Echoes are copied into pooled chunks, small ones packed together, and
+ * whole runs of chunks go out with one sendmsg, so a socket that can't keep up is left to the event loop instead of
+ * being retried on the spot.
+ */
+typedef struct
+{
+    vector_t chunks; // output_chunk_t, oldest first; not allocated until the first append
+    size_t head;     // Index of the oldest chunk not yet sent
+    size_t pending;  // Bytes queued and not yet sent
+    int throttled;   // Set from reaching the high-water mark until draining to half of it
+} output_queue_t;
+
+/**
+ * Sets up an empty queue. Nothing is allocated until the first append.
+ */
+void output_queue_init(output_queue_t* queue);
+
+/**
+ * Copies data onto the end of the queue, filling the last chunk before starting another.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+int output_queue_append(output_queue_t* queue, void const* data, size_t len);
+
+/**
+ * Sends as much of the queue as the socket will take, with one sendmsg per run of chunks.
+ *
+ * @param sock  The client's (non-blocking) socket.
+ * @param queue The connection's queue.
+ * @return The number of bytes sent, or -1 on failure.
+ */
+ssize_t output_queue_flush(int sock, output_queue_t* queue);
+
+/**
+ * Returns whether the connection should stop reading: from when its unsent output reaches server_config.out_high_water
+ * (or DEFAULT_OUT_HIGH_WATER) until it drains to half of that.
+ *
+ * @param queue The connection's output queue.
+ * @param held  Bytes of the connection's output held outside the queue (e.g. in its splice pipe), which count too.
+ */
+int output_queue_throttled(output_queue_t* queue, size_t held);
+
+/**
+ * Frees the queue's chunk list if everything in it has been sent, leaving the queue as if newly initialised.
+ */
+void output_queue_trim(output_queue_t* queue);
+
+/**
+ * Frees everything in the queue, sent or not.
+ */
+void output_queue_release(output_queue_t* queue);
+
+/**
+ * Writes the number of sendmsg calls, bytes sent, peak queue size and number of times reading was throttled, across
+ * every queue. Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int output_queue_report(char* buf, size_t len);
+
+#endif //COMP8005_ASSN2_OUTPUT_QUEUE_H
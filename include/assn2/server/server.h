@@ -13,8 +13,16 @@
 typedef struct server_t server_t;
 
 extern server_t* thread_server;
+extern server_t* thread_lf_server;
 extern server_t* select_server;
+extern server_t* select_mt_server;
+extern server_t* poll_server;
 extern server_t* epoll_server;
+extern server_t* uring_server;
+extern server_t* epoll_reuseport_server;
+extern server_t* epoll_mt_server;
+extern server_t* epoll_pool_server;
+extern server_t* coro_server;
 
 struct server_t
 {
@@ -50,14 +58,43 @@ struct server_t
      */
     void (*cleanup)(server_t* server);
 
-    // Summary stats
-    size_t max_concurrent;
-    size_t total_served;
+    // Summary stats; atomic so that servers running several event loops can share them
+    atomic_size_t max_concurrent;
+    atomic_size_t total_served;
 
     // Data private to the server implementation (reference to thread pool, queue for receiving new clients, etc.)
     void* private;
+
+    /**
+     * Writes any implementation-specific stats for the final summary (one "name: value" pair per line) into buf.
+     * Optional; may be NULL. This can be called from a signal handler, so it shouldn't allocate or take locks.
+     *
+     * @param server The server whose stats will be written.
+     * @param buf    The buffer into which to write the stats.
+     * @param len    The size of buf.
+     *
+     * @return The number of characters written (or that would have been written, like snprintf).
+     */
+    int (*report)(server_t* server, char* buf, size_t len);
 };
 
+/**
+ * Records a newly added client in the server's summary stats. Safe to call from several threads at once.
+ *
+ * @param server    The server to which the client was added.
+ * @param connected The number of clients connected to the server, including the new one.
+ */
+void server_client_added(server_t* server, size_t connected);
+
+/**
+ * Formats the final summary ("Total served: ...") for the server, including its implementation-specific stats.
+ *
+ * @param server The server to summarise.
+ * @param buf    The buffer into which to write the summary.
+ * @param len    The size of buf.
+ */
+void server_summary(server_t* server, char* buf, size_t len);
+
 /**
  * Starts accepting connections and relaying them to the provided server.
  *
@@ -0,0 +1,51 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_SOCKET_PROFILE_H
+#define COMP8005_ASSN2_SOCKET_PROFILE_H
+
+/**
+ * A named set of socket options for the listening and accepted sockets. Zero leaves an option at the kernel's default.
+ */
+typedef struct
+{
+    char const* name;
+    int backlog;       // listen() backlog (the kernel caps it at net.core.somaxconn)
+    int nodelay;       // TCP_NODELAY
+    int rcvbuf;        // SO_RCVBUF bytes; setting it turns off the kernel's receive buffer autotuning
+    int sndbuf;        // SO_SNDBUF bytes; likewise for send buffers
+    int defer_accept;  // TCP_DEFER_ACCEPT seconds: connections aren't accepted until they have data (or time out)
+    int fastopen;      // TCP_FASTOPEN queue length
+    int notsent_lowat; // TCP_NOTSENT_LOWAT bytes: the socket only polls writable with less than this unsent
+    int busy_poll;     // SO_BUSY_POLL microseconds to spin on the device queue before sleeping in a read
+} socket_profile_t;
+
+/**
+ * Looks up a profile by name: "default" (a backlog of 256 and nothing else), "latency", "throughput" or "c10m".
+ *
+ * @return The profile, or NULL if there isn't one with that name.
+ */
+socket_profile_t const* socket_profile_find(char const* name);
+
+/**
+ * Applies server_config.socket_profile's options to a new listening socket. Called between socket() and bind(), so
+ * that the buffer sizes are in place before the window scale is negotiated for any connection.
+ *
+ * @return The backlog to pass to listen().
+ */
+int socket_profile_listener(int sock);
+
+/**
+ * Applies the profile's per-connection options to an accepted socket. Linux copies them from the listener, which this
+ * checks on the first accepted socket; only if they didn't carry over are they set on each socket.
+ */
+void socket_profile_accepted(int sock);
+
+/**
+ * Prints the profile's name and the settings the listening socket actually ended up with, as read back from the
+ * kernel, so that benchmark runs can be reproduced.
+ */
+void socket_profile_log(int listen_sock);
+
+#endif //COMP8005_ASSN2_SOCKET_PROFILE_H
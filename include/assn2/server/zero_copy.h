@@ -0,0 +1,189 @@
+//
+// Created by shane on 10/17/26.
+//
+
+#ifndef COMP8005_ASSN2_ZERO_COPY_H
+#define COMP8005_ASSN2_ZERO_COPY_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "output_queue.h"
+#include "vector.h"
+
+/**
+ * A pipe used to splice a message body from a client's socket back out to the same socket.
+ */
+typedef struct
+{
+    int fds[2];    // Read and write ends, or -1 if no pipe is held
+    size_t queued; // Bytes spliced into the pipe that haven't been spliced back out yet
+} splice_pipe_t;
+
+/**
+ * Sets up a connection's pipe slot without taking a pipe from the pool yet.
+ */
+void splice_pipe_init(splice_pipe_t* pipe);
+
+/**
+ * Returns whether a message body of the given size should be spliced instead of copied, according to
+ * server_config.splice_threshold.
+ */
+int splice_wanted(size_t msg_size);
+
+/**
+ * Moves up to bytes_to_echo bytes of a message body from the socket into the pipe and straight back out to the
+ * socket, so that the body never enters user space. A pipe is taken from the pool the first time one is needed.
+ * Anything left in the pipe from an earlier call is sent first, and nothing more is read until the pipe is empty; what
+ * the socket won't take stays in the pipe (see pipe->queued), so the caller should wait until the socket is writable
+ * before calling this or splice_drain again.
+ *
+ * @param sock          The client's (non-blocking) socket.
+ * @param pipe          The connection's pipe.
+ * @param bytes_to_echo The number of body bytes still to come.
+ * @param eof           Set to 1 if the peer closed its side before the rest of the body arrived, or 0 otherwise.
+ * @return The number of body bytes read from the socket (fewer than bytes_to_echo if the socket would block, the pipe
+ *         couldn't be emptied or the peer closed), or -1 on failure.
+ */
+ssize_t splice_echo(int sock, splice_pipe_t* pipe, size_t bytes_to_echo, int* eof);
+
+/**
+ * Sends whatever is left in the pipe back out to the socket, until the pipe is empty or the socket would block.
+ *
+ * @param sock The client's (non-blocking) socket.
+ * @param pipe The connection's pipe.
+ * @return The number of bytes sent, or -1 on failure.
+ */
+ssize_t splice_drain(int sock, splice_pipe_t* pipe);
+
+/**
+ * Returns the connection's pipe to the pool (or closes it if it might still hold data).
+ */
+void splice_pipe_release(splice_pipe_t* pipe);
+
+/**
+ * A buffer handed to the kernel by a MSG_ZEROCOPY send, which can't be freed or reused until the kernel reports that
+ * it's done with it.
+ */
+typedef struct
+{
+    char* buf;
+    uint32_t last_seq; // Sequence number of the last zero-copy send that used the buffer
+} zerocopy_buf_t;
+
+/**
+ * Per-connection MSG_ZEROCOPY state.
+ */
+typedef struct
+{
+    int enabled;       // 1 once SO_ZEROCOPY is set, -1 if the socket doesn't support it
+    uint32_t next_seq; // The kernel numbers each zero-copy send call on a socket from 0
+    vector_t pending;  // zerocopy_buf_t, oldest first
+} zerocopy_state_t;
+
+/**
+ * Sets up a connection's zero-copy state. Nothing is allocated until the first zero-copy send.
+ */
+void zerocopy_init(zerocopy_state_t* state);
+
+/**
+ * Returns whether a message of the given size should be sent with MSG_ZEROCOPY, according to
+ * server_config.zerocopy_threshold.
+ */
+int zerocopy_wanted(size_t msg_size);
+
+/**
+ * Sends len bytes from data with MSG_ZEROCOPY, as far as the socket will take them without blocking; the rest is copied
+ * onto the connection's output queue, to go out with its other echoes once the socket is writable. Only call this while
+ * nothing else is waiting to be sent, so that the echo stays in order. The connection always takes ownership of buf,
+ * which holds the data: it is freed by zerocopy_reap once the kernel has finished with it, or straight away if it was
+ * never sent zero-copy. Sockets that don't support zero-copy, and sends that run out of option memory, fall back to
+ * ordinary copying sends.
+ *
+ * @param sock   The socket on which to send.
+ * @param state  The connection's zero-copy state.
+ * @param output The connection's output queue, which gets whatever the socket won't take yet.
+ * @param buf    A buffer from buffer_alloc that holds the data to send.
+ * @param data   The data to send, somewhere in buf.
+ * @param len    The number of bytes to send.
+ * @return 0 on success, or -1 on failure.
+ */
+int zerocopy_send(int sock, zerocopy_state_t* state, output_queue_t* output, char* buf, char const* data, size_t len);
+
+/**
+ * Reads zero-copy completions from the socket's error queue and frees every buffer the kernel is done with. TCP
+ * completes sends in order, so each notification releases every buffer up to the end of its range.
+ *
+ * @param sock  The socket whose error queue will be read.
+ * @param state The connection's zero-copy state.
+ * @return 0 on success, or -1 on failure.
+ */
+int zerocopy_reap(int sock, zerocopy_state_t* state);
+
+/**
+ * Frees every buffer still held for the connection. Only call this once the kernel can't read from them any more: after
+ * their completions have all been reaped, or after the socket has been reset with SO_LINGER 0, which drops its send
+ * and retransmit queues. Closing the socket normally isn't enough, since the kernel keeps sending what was queued.
+ */
+void zerocopy_release(zerocopy_state_t* state);
+
+/**
+ * Closed connections whose zero-copy buffers the kernel may still be sending from, each kept with its socket so that
+ * the completions can still be read from its error queue. Thread-safe.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    vector_t parked; // zerocopy_parked_t
+} zerocopy_parking_t;
+
+/**
+ * Sets up an empty parking list.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+int zerocopy_parking_init(zerocopy_parking_t* parking);
+
+/**
+ * Closes a finished connection's socket, or if it still has zero-copy buffers held, shuts it down both ways and parks
+ * it with them instead, so that they aren't reused while the kernel can still send (or resend) from them. The parking
+ * list takes over the socket and the state either way, and the state is left ready for zerocopy_init.
+ *
+ * @param parking The list to park the connection on.
+ * @param sock    The connection's socket, which must already be out of any epoll set.
+ * @param state   The connection's zero-copy state.
+ */
+void zerocopy_park(zerocopy_parking_t* parking, int sock, zerocopy_state_t* state);
+
+/**
+ * Reaps the completions of every parked connection, closing each one whose buffers have all been released. One that has
+ * waited for longer than a minute (or any, if force is set) is reset instead, and its buffers are released once that
+ * has dropped its send queue.
+ */
+void zerocopy_parking_reap(zerocopy_parking_t* parking, int force);
+
+/**
+ * Resets and closes every connection still parked, releases their buffers, and frees the list.
+ */
+void zerocopy_parking_release(zerocopy_parking_t* parking);
+
+/**
+ * Adds to the totals of echoed bytes by path. Safe to call from several threads at once.
+ *
+ * @param copied  Bytes echoed through a user-space buffer.
+ * @param spliced Bytes echoed with splice.
+ */
+void echo_stats_add(size_t copied, size_t spliced);
+
+/**
+ * Writes the echo throughput (bytes/sec since the first call to echo_stats_add) and process CPU time per GB echoed,
+ * plus the zero-copy completion counts if any zero-copy sends were made.
+ * Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int echo_stats_report(char* buf, size_t len);
+
+#endif //COMP8005_ASSN2_ZERO_COPY_H
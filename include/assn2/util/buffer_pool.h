@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+
+typedef struct
+{
+    size_t allocs;        // Buffers handed out
+    size_t frees;         // Buffers given back
+    size_t depot_hits;    // Allocations that had to refill a thread's magazines from the depot
+    size_t misses;        // Allocations that had to go to malloc
+    size_t oversize;      // Allocations too big for any size class, which always go to malloc
+    size_t cached_bytes;  // Bytes held in the depot
+} buffer_pool_stats_t;
+
+/**
+ * Allocates a buffer of at least size bytes. Sizes up to the largest size class are rounded up to a power of two and
+ * come from the calling thread's magazines, which are refilled from a global depot; only a miss in both calls malloc.
+ *
+ * @param size The number of bytes needed.
+ * @return The buffer, or NULL if out of memory.
+ */
+void* buffer_alloc(size_t size);
+
+/**
+ * Returns a buffer from buffer_alloc to the pool. Does nothing if buf is NULL.
+ *
+ * @param buf The buffer to free.
+ */
+void buffer_free(void* buf);
+
+/**
+ * Returns the number of bytes that a buffer from buffer_alloc can hold, which may be more than was asked for.
+ */
+size_t buffer_capacity(void const* buf);
+
+/**
+ * Copies the pool's counters.
+ */
+void buffer_pool_stats(buffer_pool_stats_t* out);
+
+/**
+ * Writes the pool's counters and hit rate as a line of text. Safe to call from a signal handler.
+ *
+ * @return The number of characters written, as for snprintf.
+ */
+int buffer_pool_report(char* buf, size_t len);
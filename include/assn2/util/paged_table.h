@@ -0,0 +1,56 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define PAGED_TABLE_PAGE_SHIFT 10 // 1024 entries per page
+#define PAGED_TABLE_PAGE_SIZE  ((size_t)1 << PAGED_TABLE_PAGE_SHIFT)
+
+/**
+ * A table of fixed-size entries indexed by a small integer (such as an fd), allocated a page at a time as the indices
+ * are first used. The page directory is sized once for the largest index, so pages never move: a pointer to an entry
+ * stays valid until the table is freed, which is what lets it be handed to the kernel as epoll data. Lookups don't
+ * lock; only allocating a page does.
+ */
+typedef struct
+{
+    _Atomic(char*)* pages; // One per PAGED_TABLE_PAGE_SIZE indices; NULL until an index in it is used
+    size_t num_pages;
+    size_t item_size;
+    atomic_size_t pages_allocated;
+    pthread_mutex_t lock;  // Held only while allocating a page
+} paged_table_t;
+
+/**
+ * Initialises an empty table that can hold indices up to capacity - 1. Only the page directory is allocated.
+ *
+ * @param table     The table to initialise.
+ * @param item_size The size of each entry, as from sizeof.
+ * @param capacity  One more than the largest index that will be stored.
+ * @return 0 on success, -1 on out of memory.
+ */
+int paged_table_init(paged_table_t* table, size_t item_size, size_t capacity);
+
+/**
+ * Returns the entry at index, allocating (and zeroing) its page if this is the first index in it to be used.
+ *
+ * @return The entry, or NULL if index is beyond the table's capacity or its page couldn't be allocated.
+ */
+void* paged_table_slot(paged_table_t* table, size_t index);
+
+/**
+ * Returns the entry at index without allocating anything.
+ *
+ * @return The entry, or NULL if its page has never been used.
+ */
+void* paged_table_find(paged_table_t* table, size_t index);
+
+/**
+ * Returns the number of bytes allocated for pages so far (not counting the directory).
+ */
+size_t paged_table_bytes(paged_table_t* table);
+
+/**
+ * Frees every page and the directory. Pointers to entries are invalid afterwards.
+ */
+void paged_table_free(paged_table_t* table);
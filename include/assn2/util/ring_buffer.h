@@ -1,12 +1,16 @@
 #pragma once
-#include <stdatomic.h>
+#include <pthread.h>
 #include <stddef.h>
 
 typedef struct
 {
-    atomic_size_t head;
-    atomic_size_t tail;
-    atomic_int reader_guard; // Makes sure that the reader doesn't read partially-written data if it catches up to writers
+    size_t head;
+    size_t tail;
+    int closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty; // Readers park here while the buffer is empty
+    pthread_cond_t not_full;  // Writers park here while the buffer is full
 
     void* mem; // Should probably be a static fixed-size buffer since it will never be freed
     size_t size;
@@ -14,27 +18,56 @@ typedef struct
 } ring_buffer_t;
 
 /**
- * Tries to add an element to the buffer. This will block if the buffer is full.
+ * Initialises a bounded buffer that any number of threads can add to and take from.
  *
  * @param buf       The buffer to initialise.
  * @param mem       The memory to use as a ciruclar buffer.
  * @param size      The number of elem_size elements that the buffer can hold.
  * @param elem_size The size of each element in the buffer.
+ * @return 0 on success, -1 on failure.
  */
-void ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size);
+int ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size);
 
 /**
  * Tries to add an element to the buffer. This will block if the buffer is full.
  *
  * @param buf  The buffer to which to add the item.
  * @param item A pointer to the item (which will be copied by value) to add to the buffer.
+ * @return 0 on success, -1 if the buffer has been closed.
  */
-void ring_buffer_put(ring_buffer_t* buf, void* item);
+int ring_buffer_put(ring_buffer_t* buf, void* item);
 
 /**
- * Retrieves the next item from the ring buffer. Blocks if there are no items available.
+ * Retrieves the next item from the ring buffer. Blocks without spinning if there are no items available.
  *
  * @param buf The buffer from which to retrieve the item.
  * @param out Pointer to a variable that will hold the result. Must be >= buf->elem_size.
+ * @return 0 on success, -1 if the buffer has been closed and is empty.
+ */
+int ring_buffer_get(ring_buffer_t* buf, void* out);
+
+/**
+ * Retrieves the next item from the ring buffer, waiting at most timeout_ms milliseconds for one to arrive.
+ *
+ * @param buf        The buffer from which to retrieve the item.
+ * @param out        Pointer to a variable that will hold the result. Must be >= buf->elem_size.
+ * @param timeout_ms The longest time to wait for an item.
+ * @return 0 on success, or -1 with errno set to ETIMEDOUT if no item arrived in time or EPIPE if the buffer has been
+ *         closed and is empty.
+ */
+int ring_buffer_timed_get(ring_buffer_t* buf, void* out, unsigned long timeout_ms);
+
+/**
+ * Closes the buffer, waking every blocked thread. Items already in the buffer can still be retrieved, but nothing
+ * more can be added.
+ *
+ * @param buf The buffer to close.
+ */
+void ring_buffer_close(ring_buffer_t* buf);
+
+/**
+ * Frees the buffer's lock and condition variables (but not its memory). No thread may be using the buffer.
+ *
+ * @param buf The buffer to destroy.
  */
-void ring_buffer_get(ring_buffer_t* buf, void* out);
\ No newline at end of file
+void ring_buffer_destroy(ring_buffer_t* buf);
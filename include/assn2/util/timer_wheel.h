@@ -0,0 +1,75 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_MAX    ((1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1) // Longest delay, in ticks
+
+/**
+ * A timer, embedded in whatever it times. Nodes are linked into the wheel's slots, so scheduling and cancelling never
+ * allocate.
+ */
+typedef struct timer_node
+{
+    struct timer_node* next;
+    struct timer_node** pprev; // The pointer that points at this node, or NULL while it isn't scheduled
+    uint32_t expires;          // Tick at which it fires
+    uint32_t tag;              // Free for the owner, e.g. to say what the timer was for
+} timer_node_t;
+
+/**
+ * Called for each timer that expires, after it has been taken off the wheel.
+ */
+typedef void (*timer_fn)(timer_node_t* node, void* arg);
+
+/**
+ * A hierarchical timing wheel. Level 0 has a slot for each of the next 64 ticks and each level above covers 64 times
+ * the span of the one below; a timer goes into the lowest level that reaches its expiry and moves down a level each
+ * time the level below comes round to its slot. Scheduling and cancelling are O(1), and advancing costs O(1) per tick
+ * plus O(1) per timer per level it moves down. Ticks are unsigned and wrap, so only differences between them matter.
+ */
+typedef struct
+{
+    timer_node_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint32_t now;   // The last tick advanced to
+    size_t count;   // Timers scheduled
+} timer_wheel_t;
+
+/**
+ * Initialises an empty wheel whose current tick is now.
+ */
+void timer_wheel_init(timer_wheel_t* wheel, uint32_t now);
+
+/**
+ * Schedules a timer to fire delay ticks after the wheel's current tick, moving it if it was already scheduled. Delays
+ * of 0 are rounded up to 1 and delays over TIMER_WHEEL_MAX down to it.
+ */
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_node_t* node, uint32_t delay);
+
+/**
+ * Takes a timer off the wheel. Does nothing if it isn't scheduled.
+ */
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_node_t* node);
+
+/**
+ * Returns whether a timer is scheduled. A zeroed node isn't.
+ */
+int timer_node_pending(timer_node_t const* node);
+
+/**
+ * Advances the wheel to now, calling fn for every timer that expires on the way. fn may schedule or cancel timers,
+ * including the one that fired.
+ *
+ * @return The number of timers that fired.
+ */
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint32_t now, timer_fn fn, void* arg);
+
+/**
+ * Returns how many ticks the wheel can go without being advanced and not fire a timer late: the ticks until the next
+ * timer in level 0 or until the next time a higher level moves its timers down, whichever is sooner.
+ *
+ * @return The number of ticks, or UINT32_MAX if no timers are scheduled.
+ */
+uint32_t timer_wheel_next(timer_wheel_t const* wheel);
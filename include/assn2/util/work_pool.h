@@ -0,0 +1,67 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+typedef void (*work_fn)(void* arg);
+
+typedef struct
+{
+    work_fn fn;
+    void* arg;
+} work_item_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    work_item_t* items; // Circular; the owner takes from the back, thieves from the front
+    size_t head;
+    size_t count;
+    size_t cap;
+} work_deque_t;
+
+typedef struct
+{
+    work_deque_t* deques; // One per worker
+    pthread_t* threads;
+    size_t num_workers;
+    size_t num_started;
+
+    atomic_size_t pending;     // Items submitted but not yet taken
+    atomic_size_t sleepers;    // Workers parked (or about to park) on idle
+    atomic_size_t next_deque;  // Round-robin position for submissions
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle;
+    int closed;
+
+    atomic_size_t executed;
+    atomic_size_t stolen;
+} work_pool_t;
+
+/**
+ * Starts a pool of worker threads, each with its own deque of work. Submitted items are spread over the deques, and a
+ * worker whose own deque is empty steals from the others before going to sleep.
+ *
+ * @param pool        The pool to initialise.
+ * @param num_workers The number of worker threads to start.
+ * @param deque_cap   The initial capacity of each worker's deque. The deques grow as needed.
+ * @return 0 on success, -1 on failure.
+ */
+int work_pool_init(work_pool_t* pool, size_t num_workers, size_t deque_cap);
+
+/**
+ * Queues fn(arg) to be run on one of the pool's workers.
+ *
+ * @param pool The pool that will run the item.
+ * @param fn   The function to run.
+ * @param arg  The argument with which fn will be called.
+ * @return 0 on success, -1 if out of memory or the pool has been shut down.
+ */
+int work_pool_submit(work_pool_t* pool, work_fn fn, void* arg);
+
+/**
+ * Stops the pool and waits for its workers to exit. Items already submitted are still run first.
+ *
+ * @param pool The pool to destroy.
+ */
+void work_pool_destroy(work_pool_t* pool);
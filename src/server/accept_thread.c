@@ -0,0 +1,404 @@
+/*********************************************************************************************
+Name:			accept_thread.c
+
+    Required:	accept_thread.h
+                acceptor.h
+                done.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    A dedicated accept thread for the event loop servers. It accepts clients in batches with
+    accept4 and hands each one to an event loop through that loop's lock-free queue, writing
+    each loop's eventfd once per batch instead of once per client. The loop for each client
+    is picked round-robin, by fewest connections, or by fewest bytes in flight, using the
+    load that the loops report back through their queues. Accepting this way means that a
+    burst of connects never holds up echoes and heavy echo traffic never holds up accepts.
+
+    Revisions:
+    2026-10-17 - Shane Spoor - Stop polling the listener while the process is out of fds.
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "accept_thread.h"
+#include "acceptor.h"
+#include "done.h"
+
+#define ACCEPT_BATCH         64 // Most clients accepted before handing them over
+#define ACCEPT_FULL_WAIT_MS  1  // How long to wait for an event loop to make room when every queue is full
+#define ACCEPT_PAUSE_POLL_MS 10 // How often to check the loops' clients while out of fds
+
+// Kept for the whole process so that they can be reported after the servers have cleaned up
+static struct
+{
+    atomic_size_t accepted;
+    atomic_size_t batches;
+    atomic_size_t wakeups; // eventfd writes
+    atomic_size_t full;    // Clients that found their chosen queue full
+    accept_policy_t policy;
+} accept_stats;
+
+accept_policy_t accept_policy_parse(char const* name)
+{
+    if (strcmp(name, "rr") == 0)
+    {
+        return ACCEPT_POLICY_ROUND_ROBIN;
+    }
+    if (strcmp(name, "least-conn") == 0)
+    {
+        return ACCEPT_POLICY_LEAST_CONN;
+    }
+    if (strcmp(name, "least-bytes") == 0)
+    {
+        return ACCEPT_POLICY_LEAST_BYTES;
+    }
+    return ACCEPT_POLICY_NONE;
+}
+
+/**
+ * Returns the name that accept_policy_parse takes for the policy.
+ */
+static char const* accept_policy_name(accept_policy_t policy)
+{
+    switch (policy)
+    {
+        case ACCEPT_POLICY_ROUND_ROBIN:
+            return "rr";
+        case ACCEPT_POLICY_LEAST_CONN:
+            return "least-conn";
+        case ACCEPT_POLICY_LEAST_BYTES:
+            return "least-bytes";
+        default:
+            return "none";
+    }
+}
+
+int accept_queue_init(accept_queue_t* queue)
+{
+    atomic_store(&queue->head, 0);
+    atomic_store(&queue->tail, 0);
+    atomic_store(&queue->connections, 0);
+    atomic_store(&queue->bytes_in_flight, 0);
+    queue->signalled = 0;
+
+    if ((queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        perror("eventfd");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Adds a client to the back of the queue. Only the accept thread calls this.
+ *
+ * @return 0 on success, or -1 if the queue is full.
+ */
+static int accept_queue_put(accept_queue_t* queue, client_t const* client)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == ACCEPT_QUEUE_SIZE)
+    {
+        return -1;
+    }
+
+    queue->slots[tail & (ACCEPT_QUEUE_SIZE - 1)] = *client;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    atomic_fetch_add(&queue->connections, 1);
+    queue->signalled = 1;
+    return 0;
+}
+
+size_t accept_queue_take(accept_queue_t* queue, client_t* out, size_t max)
+{
+    // Cleared before looking at the queue, so a client queued after this look writes the eventfd again
+    uint64_t count;
+    if (read(queue->event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    {
+        perror("read eventfd");
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    size_t taken = 0;
+    while (head != tail && taken < max)
+    {
+        out[taken++] = queue->slots[head & (ACCEPT_QUEUE_SIZE - 1)];
+        ++head;
+    }
+    atomic_store_explicit(&queue->head, head, memory_order_release);
+    return taken;
+}
+
+void accept_queue_release(accept_queue_t* queue)
+{
+    size_t head = atomic_load(&queue->head);
+    size_t tail = atomic_load(&queue->tail);
+    for (; head != tail; ++head)
+    {
+        close(queue->slots[head & (ACCEPT_QUEUE_SIZE - 1)].sock);
+    }
+    atomic_store(&queue->head, head);
+
+    if (queue->event_fd != -1)
+    {
+        close(queue->event_fd);
+        queue->event_fd = -1;
+    }
+}
+
+/**
+ * Picks the queue that the policy says should get the next client.
+ */
+static size_t accept_thread_choose(accept_thread_t* thread)
+{
+    if (thread->policy == ACCEPT_POLICY_ROUND_ROBIN)
+    {
+        return thread->next++ % thread->num_queues;
+    }
+
+    size_t best = 0;
+    size_t best_conns = SIZE_MAX;
+    size_t best_bytes = SIZE_MAX;
+    for (size_t i = 0; i < thread->num_queues; ++i)
+    {
+        size_t conns = atomic_load_explicit(&thread->queues[i].connections, memory_order_relaxed);
+        size_t bytes = thread->policy == ACCEPT_POLICY_LEAST_BYTES ?
+                       atomic_load_explicit(&thread->queues[i].bytes_in_flight, memory_order_relaxed) : 0;
+        if (bytes < best_bytes || (bytes == best_bytes && conns < best_conns))
+        {
+            best = i;
+            best_conns = conns;
+            best_bytes = bytes;
+        }
+    }
+    return best;
+}
+
+/**
+ * Wakes every event loop that has had clients queued since it was last woken.
+ */
+static void accept_thread_signal(accept_thread_t* thread)
+{
+    uint64_t one = 1;
+    for (size_t i = 0; i < thread->num_queues; ++i)
+    {
+        accept_queue_t* queue = &thread->queues[i];
+        if (queue->signalled)
+        {
+            queue->signalled = 0;
+            if (write(queue->event_fd, &one, sizeof(one)) == -1)
+            {
+                perror("write eventfd");
+            }
+            atomic_fetch_add_explicit(&accept_stats.wakeups, 1, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Hands a client to the queue the policy picks, or to the next one with room if that one is full. If every queue is
+ * full, the loops are woken and given a moment to catch up, and the client is closed if the server stops meanwhile.
+ */
+static void accept_thread_dispatch(accept_thread_t* thread, client_t const* client)
+{
+    size_t chosen = accept_thread_choose(thread);
+    while (!atomic_load(&done))
+    {
+        for (size_t i = 0; i < thread->num_queues; ++i)
+        {
+            if (accept_queue_put(&thread->queues[(chosen + i) % thread->num_queues], client) == 0)
+            {
+                return;
+            }
+            if (i == 0)
+            {
+                atomic_fetch_add_explicit(&accept_stats.full, 1, memory_order_relaxed);
+            }
+        }
+
+        accept_thread_signal(thread);
+        struct pollfd stop = {thread->stop_fd, POLLIN, 0};
+        poll(&stop, 1, ACCEPT_FULL_WAIT_MS);
+    }
+    close(client->sock);
+}
+
+/**
+ * Returns the clients handed to the event loops and not yet closed.
+ */
+static size_t accept_thread_connections(accept_thread_t const* thread)
+{
+    size_t connections = 0;
+    for (size_t i = 0; i < thread->num_queues; ++i)
+    {
+        connections += atomic_load_explicit(&thread->queues[i].connections, memory_order_relaxed);
+    }
+    return connections;
+}
+
+/**
+ * Waits without polling the listener until the loops have closed enough clients to make room, or the retry interval
+ * is up, after accept_clients has run out of fds.
+ *
+ * @return 0 to go back to accepting, or -1 if the server is stopping.
+ */
+static int accept_thread_pause(accept_thread_t* thread)
+{
+    accept_pause_t pause = {0};
+    accept_pause_start(&pause, accept_thread_connections(thread));
+    struct pollfd stop = {thread->stop_fd, POLLIN, 0};
+    while (!accept_pause_over(&pause, accept_thread_connections(thread)))
+    {
+        // The loops don't tell us when they close clients, so look again every so often
+        if (atomic_load(&done) || poll(&stop, 1, ACCEPT_PAUSE_POLL_MS) > 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void* accept_thread_run(void* void_thread)
+{
+    accept_thread_t* thread = (accept_thread_t*)void_thread;
+    struct pollfd fds[2] = {{thread->listen_sock, POLLIN, 0}, {thread->stop_fd, POLLIN, 0}};
+    client_t batch[ACCEPT_BATCH];
+    int backlog_empty = 1;
+
+    while (!atomic_load(&done))
+    {
+        // A full batch means that more are probably waiting, so only wait for the listener once it's been emptied
+        if (backlog_empty)
+        {
+            if (poll(fds, 2, -1) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                perror("poll");
+                atomic_store(&done, 1);
+                break;
+            }
+            if (fds[1].revents)
+            {
+                break;
+            }
+        }
+
+        int accepted = accept_clients(thread->listen_sock, batch, ACCEPT_BATCH);
+        if (accepted == ACCEPT_EXHAUSTED)
+        {
+            if (accept_thread_pause(thread) == -1)
+            {
+                break;
+            }
+            backlog_empty = 0; // Clients have probably queued up while we weren't looking
+            continue;
+        }
+        if (accepted == -1)
+        {
+            break;
+        }
+        backlog_empty = accepted < ACCEPT_BATCH;
+        if (accepted == 0)
+        {
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&accept_stats.accepted, (size_t)accepted, memory_order_relaxed);
+        atomic_fetch_add_explicit(&accept_stats.batches, 1, memory_order_relaxed);
+        for (int i = 0; i < accepted; ++i)
+        {
+            accept_thread_dispatch(thread, &batch[i]);
+        }
+        accept_thread_signal(thread);
+    }
+    return NULL;
+}
+
+int accept_thread_start(accept_thread_t* thread, int listen_sock, accept_queue_t* queues, size_t num_queues,
+                        accept_policy_t policy)
+{
+    thread->listen_sock = listen_sock;
+    thread->queues = queues;
+    thread->num_queues = num_queues;
+    thread->policy = policy;
+    thread->next = 0;
+    thread->running = 0;
+    accept_stats.policy = policy;
+
+    int flags = fcntl(listen_sock, F_GETFL, 0);
+    if (flags == -1 || fcntl(listen_sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        perror("fcntl");
+        return -1;
+    }
+
+    if ((thread->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    // The event loops are the ones that have to be interrupted by these, so the accept thread never takes them
+    sigset_t blocked, old_mask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old_mask);
+    int result = pthread_create(&thread->thread, NULL, accept_thread_run, thread);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    if (result != 0)
+    {
+        errno = result;
+        perror("pthread_create");
+        close(thread->stop_fd);
+        return -1;
+    }
+
+    thread->running = 1;
+    return 0;
+}
+
+void accept_thread_stop(accept_thread_t* thread)
+{
+    if (!thread->running)
+    {
+        return;
+    }
+
+    uint64_t one = 1;
+    if (write(thread->stop_fd, &one, sizeof(one)) == -1)
+    {
+        perror("write eventfd");
+    }
+    pthread_join(thread->thread, NULL);
+    close(thread->stop_fd);
+    thread->running = 0;
+}
+
+int accept_thread_report(char* buf, size_t len)
+{
+    size_t accepted = atomic_load(&accept_stats.accepted);
+    size_t batches = atomic_load(&accept_stats.batches);
+    return snprintf(buf, len, "Accept thread (%s): %zu accepted in %zu batches (%.2f per batch); %zu wakeups; "
+                              "%zu found their queue full\n",
+                    accept_policy_name(accept_stats.policy), accepted, batches,
+                    batches ? (double)accepted / (double)batches : 0.0, atomic_load(&accept_stats.wakeups),
+                    atomic_load(&accept_stats.full));
+}
@@ -2,7 +2,8 @@
 Name:			acceptor.c
 
     Required:	server.h
-                done.h	
+                done.h
+                socket_profile.h
 
     Developer:  Shane Spoor
 
@@ -12,19 +13,66 @@ Name:			acceptor.c
     The purpose of this file is to encapsulate the listening socket.
 
     Revisions:
-    (none)
+    2026-10-17 - Shane Spoor - Shed clients and pause listeners instead of exiting when the
+                               process runs out of fds.
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE
 #include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/socket.h>
 #include <netdb.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
 
 #include "done.h"
 #include "server.h"
+#include "socket_profile.h"
+
+// An fd held open for nothing but shedding clients, so that there's always one to accept them with
+static pthread_mutex_t reserve_lock = PTHREAD_MUTEX_INITIALIZER;
+static int reserve_fd = -1;
+
+// Kept for the whole process so that they can be reported after the servers have cleaned up
+static struct
+{
+    atomic_size_t shed;
+    atomic_size_t pauses;
+} overload_stats;
+
+/**
+ * Opens the reserve fd if it isn't open. reserve_lock must be held.
+ */
+static void accept_reserve_open(void)
+{
+    if (reserve_fd == -1)
+    {
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+}
+
+/**
+ * Returns whether an accept error means the process (or the system) has no fds left for the client.
+ */
+static int accept_out_of_fds(int err)
+{
+    return err == EMFILE || err == ENFILE;
+}
+
+/**
+ * Returns the time in milliseconds on a clock that only goes forward.
+ */
+static uint64_t accept_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
 
 
 /*********************************************************************************************
@@ -48,21 +96,33 @@ FUNCTION
     This accepts the client socket info.
 
     Revisions:
-	(none)
+	2026-10-17 - Shane Spoor - Don't report errors caused by shutting the socket down on exit.
+	2026-10-17 - Shane Spoor - Apply the socket profile to the accepted socket.
+	2026-10-17 - Shane Spoor - Shed a client and wait instead of failing when out of fds.
 
 *********************************************************************************************/
 int accept_client(acceptor_t* acceptor, client_t* out)
 {
     struct sockaddr_in peer;
     socklen_t accepted_len = sizeof(peer);
-    int peer_sock = accept(acceptor->sock, (struct sockaddr*)&peer, &accepted_len);
+    int peer_sock;
+    while ((peer_sock = accept(acceptor->sock, (struct sockaddr*)&peer, &accepted_len)) < 0 &&
+           accept_out_of_fds(errno) && !atomic_load(&done))
+    {
+        // Nothing polls a blocking listener, so pausing it just means not calling accept for a while
+        accept_shed(acceptor->sock);
+        atomic_fetch_add_explicit(&overload_stats.pauses, 1, memory_order_relaxed);
+        poll(NULL, 0, ACCEPT_RETRY_MS);
+        accepted_len = sizeof(peer);
+    }
     if (peer_sock < 0)
     {
         if (errno != EWOULDBLOCK && errno != EAGAIN)
         {
-            atomic_store(&done, 1);
+            // Failing because the server is already shutting down (e.g. the socket was shut down) isn't an error
+            int already_done = atomic_exchange(&done, 1);
 
-            if (errno != EINTR)
+            if (errno != EINTR && !already_done)
             {
                 perror("accept");
             }
@@ -70,11 +130,366 @@ int accept_client(acceptor_t* acceptor, client_t* out)
         return -1;
     }
 
+    socket_profile_accepted(peer_sock);
     out->peer = peer;
     out->sock = peer_sock;
     return 0;
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_clients
+
+    Prototype:	int accept_clients(int listen_sock, client_t* out, size_t max)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    listen_sock - The non-blocking listening socket.
+    out - Array that receives the accepted clients.
+    max - The size of out.
+
+    Return Values:
+    The number of clients accepted, which is less than max only if the backlog was emptied (or
+    a signal interrupted the call, or the process ran out of fds); ACCEPT_EXHAUSTED if out of
+    fds before accepting any; or -1 on failure.
+
+    Description:
+    Accepts a batch of clients with accept4, which makes each socket non-blocking and
+    close-on-exec as part of the same call instead of needing fcntl calls afterwards.
+    Connections that were reset before they could be accepted are skipped.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Shed a client and return ACCEPT_EXHAUSTED when out of fds.
+
+*********************************************************************************************/
+int accept_clients(int listen_sock, client_t* out, size_t max)
+{
+    size_t count = 0;
+    while (count < max)
+    {
+        struct sockaddr_in peer;
+        socklen_t accepted_len = sizeof(peer);
+        int peer_sock = accept4(listen_sock, (struct sockaddr*)&peer, &accepted_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (peer_sock < 0)
+        {
+            if (errno == ECONNABORTED || errno == EPROTO)
+            {
+                continue;
+            }
+            if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR)
+            {
+                break;
+            }
+            if (accept_out_of_fds(errno))
+            {
+                // Hand over what we have first; the next call will come back here if there's still no room
+                if (count > 0)
+                {
+                    break;
+                }
+                accept_shed(listen_sock);
+                return ACCEPT_EXHAUSTED;
+            }
+
+            // As for accept_client, failing because the server is shutting down isn't an error
+            if (!atomic_exchange(&done, 1))
+            {
+                perror("accept4");
+            }
+            return count > 0 ? (int)count : -1;
+        }
+
+        socket_profile_accepted(peer_sock);
+        out[count].peer = peer;
+        out[count].sock = peer_sock;
+        ++count;
+    }
+    return (int)count;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_shed
+
+    Prototype:	int accept_shed(int listen_sock)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    listen_sock - The listening socket.
+
+    Return Values:
+    The number of clients shed: 0 if none were waiting or there was no fd to accept them with.
+
+    Description:
+    Frees the reserve fd, accepts the waiting clients into it one at a time (up to
+    ACCEPT_SHED_MAX), closing each with a reset (SO_LINGER of 0), and opens the reserve again.
+    Without this a client that arrives while the process is out of fds sits in the backlog,
+    and the listener stays readable, until something else closes; this way it's told
+    straight away, and clients that arrive during the pause that follows are the ones that
+    wait for the room. Only one thread sheds at a time so that the freed fd isn't taken
+    by another shed; anything else opening an fd in between just means nothing is shed.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_shed(int listen_sock)
+{
+    int shed = 0;
+    pthread_mutex_lock(&reserve_lock);
+    accept_reserve_open();
+    if (reserve_fd != -1)
+    {
+        close(reserve_fd);
+        reserve_fd = -1;
+
+        // Blocking listeners are shed from too, so make sure there's something to accept first
+        struct pollfd listener = {listen_sock, POLLIN, 0};
+        while (shed < ACCEPT_SHED_MAX && poll(&listener, 1, 0) == 1)
+        {
+            int sock = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+            if (sock == -1)
+            {
+                break;
+            }
+            struct linger linger = {1, 0};
+            setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, (socklen_t)sizeof(linger));
+            close(sock);
+            ++shed;
+        }
+        accept_reserve_open();
+    }
+    pthread_mutex_unlock(&reserve_lock);
+
+    atomic_fetch_add_explicit(&overload_stats.shed, (size_t)shed, memory_order_relaxed);
+    return shed;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_pause_start
+
+    Prototype:	int accept_pause_start(accept_pause_t* pause, size_t connections)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    pause - The event loop's pause state.
+    connections - The clients the loop has now.
+
+    Return Values:
+    1 if the listener was paused by this call, or 0 if it already was.
+
+    Description:
+    Pauses a listener until the loop's clients drop to ACCEPT_LOW_WATER_PCT of what they are
+    now, or for ACCEPT_RETRY_MS if the loop has too few clients for that to mean anything
+    (the fds may be held by another loop, in which case it's the retry that resumes it).
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_pause_start(accept_pause_t* pause, size_t connections)
+{
+    if (atomic_exchange(&pause->paused, 1))
+    {
+        return 0;
+    }
+    pause->resume_below = connections * ACCEPT_LOW_WATER_PCT / 100;
+    pause->since_ms = accept_now_ms();
+    atomic_fetch_add_explicit(&overload_stats.pauses, 1, memory_order_relaxed);
+    return 1;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_pause_over
+
+    Prototype:	int accept_pause_over(accept_pause_t* pause, size_t connections)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    pause - The event loop's pause state.
+    connections - The clients the loop has now.
+
+    Return Values:
+    1 if the pause is over and the caller should watch the listener again, 0 otherwise.
+
+    Description:
+    Ends the pause once the loop is below its low-water mark or the retry interval is up.
+    Only one caller sees the end of any one pause, so only one puts the listener back.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_pause_over(accept_pause_t* pause, size_t connections)
+{
+    if (!atomic_load(&pause->paused) ||
+        (connections >= pause->resume_below && accept_now_ms() - pause->since_ms < ACCEPT_RETRY_MS))
+    {
+        return 0;
+    }
+    return atomic_exchange(&pause->paused, 0);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_pause_wait_ms
+
+    Prototype:	int accept_pause_wait_ms(accept_pause_t* pause)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    pause - The event loop's pause state.
+
+    Return Values:
+    The milliseconds until the retry interval is up (at least 1), or -1 if not paused.
+
+    Description:
+    Lets a paused loop bound its wait for events so it gets back to the listener in time even
+    if none of its clients do anything.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_pause_wait_ms(accept_pause_t* pause)
+{
+    if (!atomic_load(&pause->paused))
+    {
+        return -1;
+    }
+    uint64_t elapsed = accept_now_ms() - pause->since_ms;
+    return elapsed >= ACCEPT_RETRY_MS ? 1 : (int)(ACCEPT_RETRY_MS - elapsed);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		accept_overload_report
+
+    Prototype:	int accept_overload_report(char* buf, size_t len)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    buf - Buffer that receives the report.
+    len - The size of buf.
+
+    Return Values:
+    The number of characters written, as for snprintf.
+
+    Description:
+    Reports the clients shed and the listener pauses, if there were any.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+int accept_overload_report(char* buf, size_t len)
+{
+    size_t shed = atomic_load(&overload_stats.shed);
+    size_t pauses = atomic_load(&overload_stats.pauses);
+    if (shed == 0 && pauses == 0)
+    {
+        return 0;
+    }
+    return snprintf(buf, len, "Out of fds: %zu clients shed; listener paused %zu times\n", shed, pauses);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		open_listen_socket
+
+    Prototype:	int open_listen_socket(acceptor_t const* acceptor)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    acceptor - Struct with the address to listen on.
+
+    Return Values:
+    The listening socket, or -1 on failure.
+
+    Description:
+    Creates a listening socket for the acceptor's address. If the acceptor's reuseport flag is
+    set, every socket created this way joins the same SO_REUSEPORT group, so servers can open
+    one per event loop; otherwise a second server on the same port fails to bind. The first one
+    also opens the fd kept in reserve for shedding clients.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Take the backlog and socket options from the socket profile.
+	2026-10-17 - Shane Spoor - Open the reserve fd for accept_shed.
+	2026-10-17 - Shane Spoor - Only join a SO_REUSEPORT group when the acceptor asks for one.
+
+*********************************************************************************************/
+int open_listen_socket(acceptor_t const* acceptor)
+{
+    int sock = socket(acceptor->info->ai_family, acceptor->info->ai_socktype, acceptor->info->ai_protocol);
+    if (sock < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, (socklen_t)sizeof(reuse)) < 0)
+    {
+        // This isn't a fatal error, so just print the error message and carry on
+        perror("setsockopt");
+    }
+    if (acceptor->reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, (socklen_t)sizeof(reuse)) < 0)
+    {
+        perror("setsockopt SO_REUSEPORT");
+    }
+
+    int backlog = socket_profile_listener(sock);
+
+    if (bind(sock, acceptor->info->ai_addr, acceptor->info->ai_addrlen) < 0)
+    {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+
+    if (listen(sock, backlog) == -1)
+    {
+        perror("listen");
+        close(sock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&reserve_lock);
+    accept_reserve_open();
+    pthread_mutex_unlock(&reserve_lock);
+    return sock;
+}
+
 /*********************************************************************************************
 FUNCTION
 
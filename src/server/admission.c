@@ -0,0 +1,192 @@
+/*********************************************************************************************
+Name:			admission.c
+
+    Required:	admission.h
+                config.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    Adaptive admission control. The servers report latencies as they measure them: the
+    thread servers time each echo, and the event loops time each pass (or turn, or batch)
+    over their ready clients, since the last client served in a pass waited for all of it.
+    Every ADMISSION_WINDOW samples the limit on clients in flight is moved the way a gradient
+    concurrency limiter moves it: the window's average latency is compared with a slowly
+    moving baseline, and while it stays within ADMISSION_TOLERANCE of the baseline (or under
+    the latency target) the limit grows by about its square root, which leaves room for a
+    little queueing. Once latency climbs past that the limit is pulled down in proportion,
+    but with each change smoothed by ADMISSION_SMOOTHING it loses at most about a tenth per
+    window (it keeps 0.9 of itself plus a fifth of its square root), so one slow window
+    doesn't throw much of it away. New clients past the limit are reset as soon as they're
+    accepted, so those admitted keep close to unloaded latency instead of every client
+    slowing down.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "config.h"
+
+#define ADMISSION_WINDOW      32    // Samples averaged into each change of the limit
+#define ADMISSION_LONG_WINDOW 64    // Windows the baseline latency is averaged over
+#define ADMISSION_TOLERANCE   2.0   // How far over the baseline the average can go before the limit comes down
+#define ADMISSION_SMOOTHING   0.2   // How much of each new limit is taken at once
+#define ADMISSION_MIN_LIMIT   8
+#define ADMISSION_MAX_LIMIT   (1u << 20)
+
+// Kept for the whole process so that they can be reported after the servers have cleaned up
+static struct
+{
+    pthread_mutex_t lock;    // Held while a sample is added and the limit moved
+    atomic_size_t limit;     // Clients admitted at once; read without the lock
+    double estimate;         // The limit before rounding
+    double baseline_ns;      // Long-term average latency; 0 until the first window
+    double average_ns;       // The last window's average latency
+    uint64_t window_ns;      // Sum of the current window's samples
+    size_t window_samples;
+    size_t window_in_flight; // Most clients in flight during the current window
+
+    size_t limit_min;
+    size_t limit_max;
+    atomic_size_t admitted;
+    atomic_size_t rejected;
+} admission = {PTHREAD_MUTEX_INITIALIZER};
+
+int admission_enabled(void)
+{
+    return server_config.admission_limit != 0;
+}
+
+/**
+ * Returns the limit, setting it up from the configured starting point the first time.
+ */
+static size_t admission_limit(void)
+{
+    size_t limit = atomic_load_explicit(&admission.limit, memory_order_relaxed);
+    if (limit == 0)
+    {
+        pthread_mutex_lock(&admission.lock);
+        if (admission.estimate == 0)
+        {
+            admission.estimate = server_config.admission_limit;
+            admission.limit_min = server_config.admission_limit;
+            admission.limit_max = server_config.admission_limit;
+            atomic_store(&admission.limit, (size_t)server_config.admission_limit);
+        }
+        limit = atomic_load(&admission.limit);
+        pthread_mutex_unlock(&admission.lock);
+    }
+    return limit;
+}
+
+int admission_admit(int sock, size_t in_flight)
+{
+    if (!admission_enabled())
+    {
+        return 1;
+    }
+
+    if (in_flight < admission_limit())
+    {
+        atomic_fetch_add_explicit(&admission.admitted, 1, memory_order_relaxed);
+        return 1;
+    }
+
+    // A reset rather than a FIN, so that it's obvious to the client and nothing is left in TIME_WAIT here
+    struct linger linger = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, (socklen_t)sizeof(linger));
+    close(sock);
+    atomic_fetch_add_explicit(&admission.rejected, 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Moves the limit once a window of samples is in. admission.lock must be held.
+ */
+static void admission_update(void)
+{
+    double average = (double)admission.window_ns / (double)admission.window_samples;
+    admission.average_ns = average;
+
+    // The baseline follows slowly, and comes down quickly when latency drops below it so it doesn't stay inflated
+    if (admission.baseline_ns == 0 || average < admission.baseline_ns)
+    {
+        admission.baseline_ns = admission.baseline_ns == 0 ? average : (admission.baseline_ns + average) / 2;
+    }
+    else
+    {
+        admission.baseline_ns += (average - admission.baseline_ns) / ADMISSION_LONG_WINDOW;
+    }
+
+    double target = admission.baseline_ns * ADMISSION_TOLERANCE;
+    double floor = (server_config.admission_target_us ? server_config.admission_target_us :
+                    DEFAULT_ADMISSION_TARGET_US) * 1000.0;
+    target = target < floor ? floor : target;
+    double gradient = average <= 0 ? 1.0 : target / average;
+    gradient = gradient > 1.0 ? 1.0 : gradient < 0.5 ? 0.5 : gradient;
+
+    double limit = admission.estimate;
+    double next = limit * gradient + sqrt(limit);
+
+    // Only grow if the clients came close to the limit; an idle server says nothing about how many it could take
+    if (next > limit && admission.window_in_flight < limit / 2)
+    {
+        next = limit;
+    }
+
+    limit = limit * (1 - ADMISSION_SMOOTHING) + next * ADMISSION_SMOOTHING;
+    limit = limit < ADMISSION_MIN_LIMIT ? ADMISSION_MIN_LIMIT : limit > ADMISSION_MAX_LIMIT ? ADMISSION_MAX_LIMIT : limit;
+    admission.estimate = limit;
+
+    size_t rounded = (size_t)limit;
+    atomic_store(&admission.limit, rounded);
+    admission.limit_min = rounded < admission.limit_min ? rounded : admission.limit_min;
+    admission.limit_max = rounded > admission.limit_max ? rounded : admission.limit_max;
+
+    admission.window_ns = 0;
+    admission.window_samples = 0;
+    admission.window_in_flight = 0;
+}
+
+void admission_sample(uint64_t latency_ns, size_t in_flight)
+{
+    if (!admission_enabled())
+    {
+        return;
+    }
+
+    admission_limit();
+    pthread_mutex_lock(&admission.lock);
+    admission.window_ns += latency_ns;
+    admission.window_in_flight = in_flight > admission.window_in_flight ? in_flight : admission.window_in_flight;
+    if (++admission.window_samples >= ADMISSION_WINDOW)
+    {
+        admission_update();
+    }
+    pthread_mutex_unlock(&admission.lock);
+}
+
+int admission_report(char* buf, size_t len)
+{
+    if (!admission_enabled())
+    {
+        return 0;
+    }
+
+    return snprintf(buf, len, "Admission: limit %zu (ranged %zu-%zu); latency %.0f us average, %.0f us baseline; "
+                              "%zu clients admitted, %zu rejected\n",
+                    atomic_load(&admission.limit), admission.limit_min, admission.limit_max,
+                    admission.average_ns / 1000, admission.baseline_ns / 1000,
+                    atomic_load(&admission.admitted), atomic_load(&admission.rejected));
+}
@@ -0,0 +1,678 @@
+/*********************************************************************************************
+Name:			coro_server.c
+
+    Required:	acceptor.h
+                config.h
+                done.h
+                server.h
+                vector.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    This is the coroutine server. Every connection runs as a coroutine with the same
+    straight-line read/echo/read loop as the thread server's workers, but on a small stack
+    taken from a pool instead of its own OS thread. Whenever a read or send would block, the
+    coroutine yields back to a single epoll scheduler, which resumes it once its socket is
+    ready again. This gives epoll-level concurrency without turning the handler into a state
+    machine.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "timing.h"
+#include "config.h"
+#include "done.h"
+#include "acceptor.h"
+#include "admission.h"
+#include "server.h"
+#include "vector.h"
+
+#define CORO_MAX_EVENTS      1024
+#define CORO_STACK_SIZE      (32 * 1024) // Default usable stack per coroutine
+#define CORO_MIN_STACK_SIZE  (16 * 1024) // Signal handlers can run on a coroutine's stack, so don't go below this
+#define CORO_STACKS_PER_SLAB 64
+#define CORO_ACCEPT_BATCH    64
+
+static int coro_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int coro_server_add_client(server_t* server, client_t client);
+static void coro_server_cleanup(server_t* server);
+static int coro_server_report(server_t* server, char* buf, size_t len);
+
+static server_t coro_server_impl =
+{
+    coro_server_start,
+    coro_server_add_client,
+    coro_server_cleanup,
+    0,
+    0,
+    NULL,
+    coro_server_report
+};
+
+server_t* coro_server = &coro_server_impl;
+
+typedef struct coro_t
+{
+    ucontext_t context;
+    void* stack;
+    client_t client;
+    uint32_t waiting; // Events the coroutine is blocked on, or 0 while it's running
+    int finished;
+
+    // Every live coroutine, so that they can be torn down on exit
+    struct coro_t* prev;
+    struct coro_t* next;
+} coro_t;
+
+typedef struct
+{
+    int epfd;
+    int listen_sock;
+    ucontext_t scheduler;
+    coro_t* current;
+    coro_t* live;
+
+    size_t stack_size; // Usable stack per coroutine
+    size_t guard_size; // Inaccessible pages below each stack
+    vector_t free_stacks;
+    vector_t slabs;
+
+    accept_pause_t pause; // Set while the listener is out of the epoll set for want of fds
+} coro_server_private;
+
+// Kept outside the private data so that they can still be reported after cleanup
+static struct
+{
+    size_t live;
+    size_t peak;
+    size_t stacks;
+    size_t switches;
+    size_t stack_size;
+    size_t guard_size;
+} coro_stats;
+
+/**
+ * Takes a stack from the pool, carving up a new slab if the pool is empty.
+ *
+ * @param private The scheduler's private data.
+ * @return The lowest usable address of the stack, or NULL if out of memory.
+ */
+static void* coro_stack_get(coro_server_private* private)
+{
+    if (private->free_stacks.size == 0)
+    {
+        // Stacks are mapped in slabs so that 100k connections don't need 100k mappings (and run into
+        // vm.max_map_count). Pages only become resident once a coroutine touches them.
+        size_t slot_size = private->stack_size + private->guard_size;
+        unsigned char* slab = mmap(NULL, slot_size * CORO_STACKS_PER_SLAB, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (slab == MAP_FAILED)
+        {
+            perror("mmap");
+            return NULL;
+        }
+        if (vector_push_back(&private->slabs, &slab) == -1)
+        {
+            munmap(slab, slot_size * CORO_STACKS_PER_SLAB);
+            return NULL;
+        }
+
+        for (size_t i = 0; i < CORO_STACKS_PER_SLAB; ++i)
+        {
+            unsigned char* slot = slab + i * slot_size;
+            if (private->guard_size && mprotect(slot, private->guard_size, PROT_NONE) == -1)
+            {
+                perror("mprotect");
+            }
+
+            void* stack = slot + private->guard_size;
+            if (vector_push_back(&private->free_stacks, &stack) == -1)
+            {
+                break; // The rest of the slab just goes unused
+            }
+        }
+        coro_stats.stacks += CORO_STACKS_PER_SLAB;
+    }
+
+    if (private->free_stacks.size == 0)
+    {
+        return NULL;
+    }
+    void** stacks = (void**)private->free_stacks.items;
+    return stacks[--private->free_stacks.size];
+}
+
+/**
+ * Returns a stack to the pool.
+ */
+static void coro_stack_put(coro_server_private* private, void* stack)
+{
+    // If this fails, the stack is just leaked until cleanup unmaps its slab
+    vector_push_back(&private->free_stacks, &stack);
+}
+
+/**
+ * Parks the running coroutine until its socket reports one of the given events.
+ *
+ * @param private The scheduler's private data.
+ * @param events  The epoll events for which the coroutine is waiting.
+ */
+static void coro_wait(coro_server_private* private, uint32_t events)
+{
+    coro_t* coro = private->current;
+    coro->waiting = events;
+    swapcontext(&coro->context, &private->scheduler);
+    coro->waiting = 0;
+}
+
+/**
+ * Reads exactly bytes_to_read bytes, yielding to the scheduler whenever the socket runs dry.
+ *
+ * @param private       The scheduler's private data.
+ * @param sock          The socket from which to read.
+ * @param buffer        The buffer into which the data will be read.
+ * @param bytes_to_read The number of bytes to read.
+ * @return The number of bytes read (less than bytes_to_read only if the peer closed the connection), or -1 on error.
+ */
+static ssize_t coro_read_data(coro_server_private* private, int sock, void* buffer, size_t bytes_to_read)
+{
+    unsigned char* raw = (unsigned char*)buffer;
+    size_t read_total = 0;
+    while (read_total < bytes_to_read)
+    {
+        ssize_t bytes_read = recv(sock, raw + read_total, bytes_to_read - read_total, 0);
+        if (bytes_read == -1)
+        {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+            {
+                coro_wait(private, EPOLLIN);
+            }
+            else if (errno != EINTR)
+            {
+                return -1;
+            }
+            continue;
+        }
+        else if (bytes_read == 0)
+        {
+            break;
+        }
+        read_total += (size_t)bytes_read;
+    }
+    return (ssize_t)read_total;
+}
+
+/**
+ * Sends all bytes_to_send bytes, yielding to the scheduler whenever the socket's send buffer is full.
+ *
+ * @param private       The scheduler's private data.
+ * @param sock          The socket on which to send the data.
+ * @param buffer        The data to send.
+ * @param bytes_to_send The number of bytes to send.
+ * @return bytes_to_send, or -1 on error.
+ */
+static ssize_t coro_send_data(coro_server_private* private, int sock, void const* buffer, size_t bytes_to_send)
+{
+    unsigned char const* raw = (unsigned char const*)buffer;
+    size_t sent_total = 0;
+    while (sent_total < bytes_to_send)
+    {
+        ssize_t bytes_sent = send(sock, raw + sent_total, bytes_to_send - sent_total, MSG_NOSIGNAL);
+        if (bytes_sent == -1)
+        {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+            {
+                coro_wait(private, EPOLLOUT);
+            }
+            else if (errno != EINTR)
+            {
+                return -1;
+            }
+            continue;
+        }
+        sent_total += (size_t)bytes_sent;
+    }
+    return (ssize_t)sent_total;
+}
+
+/**
+ * Echoes messages back to the client until it sends a message size of 0, then logs its stats. This is the
+ * thread server's loop with the blocking calls swapped for ones that yield.
+ *
+ * @param private The scheduler's private data.
+ * @param client  The client to serve.
+ * @return 0 on success, or -1 if the connection failed.
+ */
+static int coro_serve_client(coro_server_private* private, client_t* client)
+{
+    int sock = client->sock;
+    size_t transferred = 0;
+    uint32_t msg_size = 0;
+    char* msg = NULL;
+    size_t msg_alloc = 0;
+    int result = 0;
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    while (1)
+    {
+        ssize_t bytes_read = coro_read_data(private, sock, &msg_size, sizeof(msg_size));
+        if (bytes_read == -1)
+        {
+            result = -1;
+            break;
+        }
+        transferred += (size_t)bytes_read;
+        if (bytes_read < (ssize_t)sizeof(msg_size) || msg_size == 0)
+        {
+            break;
+        }
+
+        if (msg_size > msg_alloc)
+        {
+            char* new_msg = realloc(msg, msg_size);
+            if (!new_msg)
+            {
+                perror("realloc");
+                result = -1;
+                break;
+            }
+            msg = new_msg;
+            msg_alloc = msg_size;
+        }
+
+        bytes_read = coro_read_data(private, sock, msg, msg_size);
+        if (bytes_read == -1 || coro_send_data(private, sock, msg, (size_t)bytes_read) == -1)
+        {
+            result = -1;
+            break;
+        }
+        transferred += (size_t)bytes_read;
+        if (bytes_read < (ssize_t)msg_size)
+        {
+            break;
+        }
+    }
+
+    free(msg);
+    if (result == -1)
+    {
+        perror("coro client");
+        return -1;
+    }
+
+    gettimeofday(&end, NULL);
+    long transfer_time = TIME_DIFF(start, end);
+
+    unsigned short src_port = ntohs(client->peer.sin_port);
+    char addr_buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client->peer.sin_addr, addr_buf, INET_ADDRSTRLEN);
+
+    char csv[256];
+    snprintf(csv, 256, "%ld,%zu,%s:%hu\n", transfer_time, transferred, addr_buf, src_port);
+    log_msg(csv);
+
+    printf("Transfer time; %ldus; total bytes transferred: %zu; peer: %s:%hu\n",
+           transfer_time, transferred, addr_buf, src_port);
+    return 0;
+}
+
+/**
+ * Coroutine entry point; makecontext can only pass ints, so the coroutine is picked up from the scheduler.
+ */
+static void coro_entry(void)
+{
+    coro_server_private* private = (coro_server_private*)coro_server->private;
+    coro_t* coro = private->current;
+
+    coro_serve_client(private, &coro->client);
+    coro->finished = 1;
+    // Returning resumes the scheduler through uc_link
+}
+
+/**
+ * Closes a coroutine's connection and returns its stack to the pool.
+ */
+static void coro_destroy(coro_server_private* private, coro_t* coro)
+{
+    close(coro->client.sock); // Also removes it from the epoll set
+
+    if (coro->prev)
+    {
+        coro->prev->next = coro->next;
+    }
+    else
+    {
+        private->live = coro->next;
+    }
+    if (coro->next)
+    {
+        coro->next->prev = coro->prev;
+    }
+
+    coro_stack_put(private, coro->stack);
+    free(coro);
+    --coro_stats.live;
+}
+
+/**
+ * Switches to the given coroutine and runs it until it next blocks or finishes.
+ */
+static void coro_resume(coro_server_private* private, coro_t* coro)
+{
+    private->current = coro;
+    ++coro_stats.switches;
+    swapcontext(&private->scheduler, &coro->context);
+    private->current = NULL;
+
+    if (coro->finished)
+    {
+        coro_destroy(private, coro);
+    }
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		coro_server_start
+
+    Prototype:	static int coro_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since the scheduler accepts clients itself.
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Runs the scheduler: waits on the epoll set, accepts new clients into fresh coroutines,
+    and resumes each coroutine whose socket has become ready, until the done flag is set.
+    When the process runs out of fds the listener stops being watched until enough
+    coroutines have finished.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Accept in batches and pause the listener when out of fds.
+	2026-10-17 - Shane Spoor - Feed each batch's latency to admission control.
+
+*********************************************************************************************/
+static int coro_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    coro_server_private* private = calloc(1, sizeof(coro_server_private));
+    if (!private)
+    {
+        perror("malloc");
+        return -1;
+    }
+    private->epfd = -1;
+    private->listen_sock = acceptor->sock;
+    server->private = private;
+
+    // Guard pages split the slab mappings, so unlike pthread stacks they're off unless asked for
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t stack_size = server_config.worker_stack_size ? server_config.worker_stack_size : CORO_STACK_SIZE;
+    stack_size = stack_size < CORO_MIN_STACK_SIZE ? CORO_MIN_STACK_SIZE : stack_size;
+    private->stack_size = (stack_size + page_size - 1) & ~(page_size - 1);
+    private->guard_size = (server_config.worker_guard_size + page_size - 1) & ~(page_size - 1);
+    coro_stats.stack_size = private->stack_size;
+    coro_stats.guard_size = private->guard_size;
+
+    if (vector_init(&private->free_stacks, sizeof(void*), CORO_STACKS_PER_SLAB) == -1 ||
+        vector_init(&private->slabs, sizeof(void*), 0) == -1)
+    {
+        perror("malloc");
+        return -1;
+    }
+
+    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    {
+        perror("fcntl");
+        return -1;
+    }
+
+    if ((private->epfd = epoll_create1(0)) == -1)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL; // The listening socket is the only entry without a coroutine
+    if (epoll_ctl(private->epfd, EPOLL_CTL_ADD, acceptor->sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    struct epoll_event events[CORO_MAX_EVENTS];
+    while (!atomic_load(&done))
+    {
+        int num_ready = epoll_wait(private->epfd, events, CORO_MAX_EVENTS, accept_pause_wait_ms(&private->pause));
+        if (num_ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            return -1;
+        }
+
+        struct timespec batch_start;
+        clock_gettime(CLOCK_MONOTONIC, &batch_start);
+        for (int i = 0; i < num_ready && !atomic_load(&done); ++i)
+        {
+            coro_t* coro = (coro_t*)events[i].data.ptr;
+            if (coro == NULL)
+            {
+                client_t clients[CORO_ACCEPT_BATCH];
+                int accepted;
+                do
+                {
+                    accepted = accept_clients(acceptor->sock, clients, CORO_ACCEPT_BATCH);
+                    for (int j = 0; j < accepted; ++j)
+                    {
+                        if (server->add_client(server, clients[j]) == -1)
+                        {
+                            atomic_store(&done, 1);
+                            return -1;
+                        }
+                    }
+                } while (accepted == CORO_ACCEPT_BATCH);
+
+                // Watching no events keeps the listener registered but stops it waking us until there's room
+                if (accepted == ACCEPT_EXHAUSTED && accept_pause_start(&private->pause, coro_stats.live))
+                {
+                    event.events = 0;
+                    epoll_ctl(private->epfd, EPOLL_CTL_MOD, acceptor->sock, &event);
+                }
+            }
+            else if (coro->waiting)
+            {
+                // Edge-triggered, so the coroutine retries its call and parks again if this wasn't its event
+                coro_resume(private, coro);
+            }
+        }
+
+        // The last coroutine resumed waited for every one before it, so that's the latency queueing adds
+        struct timespec batch_end;
+        clock_gettime(CLOCK_MONOTONIC, &batch_end);
+        admission_sample((uint64_t)((batch_end.tv_sec - batch_start.tv_sec) * 1000000000L +
+                                    (batch_end.tv_nsec - batch_start.tv_nsec)), coro_stats.live);
+
+        // Edge-triggered, so watching it again reports any clients that queued up meanwhile
+        if (accept_pause_over(&private->pause, coro_stats.live))
+        {
+            event.events = EPOLLIN | EPOLLET;
+            event.data.ptr = NULL;
+            if (epoll_ctl(private->epfd, EPOLL_CTL_MOD, acceptor->sock, &event) == -1)
+            {
+                perror("epoll_ctl");
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		coro_server_add_client
+
+    Prototype:	static int coro_server_add_client(server_t* server, client_t client)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    client - the newly accepted client
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Creates a coroutine for the client, registers its socket with the scheduler, and runs it
+    until it first blocks.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Reset clients past the admission limit.
+
+*********************************************************************************************/
+static int coro_server_add_client(server_t* server, client_t client)
+{
+    coro_server_private* private = (coro_server_private*)server->private;
+
+    if (!admission_admit(client.sock, coro_stats.live))
+    {
+        return 0;
+    }
+
+    if (fcntl(client.sock, F_SETFL, O_NONBLOCK | fcntl(client.sock, F_GETFL, 0)) == -1)
+    {
+        perror("fcntl");
+        close(client.sock);
+        return -1;
+    }
+
+    coro_t* coro = calloc(1, sizeof(coro_t));
+    if (!coro || !(coro->stack = coro_stack_get(private)))
+    {
+        perror("coroutine");
+        free(coro);
+        close(client.sock);
+        return -1;
+    }
+    coro->client = client;
+
+    getcontext(&coro->context);
+    coro->context.uc_stack.ss_sp = coro->stack;
+    coro->context.uc_stack.ss_size = private->stack_size;
+    coro->context.uc_link = &private->scheduler;
+    makecontext(&coro->context, coro_entry, 0);
+
+    // Registered for both directions once, edge-triggered, so it never needs to be modified
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    event.data.ptr = coro;
+    if (epoll_ctl(private->epfd, EPOLL_CTL_ADD, client.sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        coro_stack_put(private, coro->stack);
+        free(coro);
+        close(client.sock);
+        return -1;
+    }
+
+    coro->next = private->live;
+    if (private->live)
+    {
+        private->live->prev = coro;
+    }
+    private->live = coro;
+
+    if (++coro_stats.live > coro_stats.peak)
+    {
+        coro_stats.peak = coro_stats.live;
+    }
+    server_client_added(server, coro_stats.live);
+
+    coro_resume(private, coro);
+    return 0;
+}
+
+static void coro_server_cleanup(server_t* server)
+{
+    coro_server_private* private = (coro_server_private*)server->private;
+    if (private == NULL)
+    {
+        return;
+    }
+
+    // Coroutines still blocked are simply abandoned along with their stacks
+    while (private->live)
+    {
+        coro_t* coro = private->live;
+        private->live = coro->next;
+        close(coro->client.sock);
+        free(coro);
+    }
+
+    size_t slot_size = private->stack_size + private->guard_size;
+    void** slabs = (void**)private->slabs.items;
+    for (size_t i = 0; i < private->slabs.size; ++i)
+    {
+        munmap(slabs[i], slot_size * CORO_STACKS_PER_SLAB);
+    }
+    vector_free(&private->slabs);
+    vector_free(&private->free_stacks);
+
+    if (private->epfd != -1)
+    {
+        close(private->epfd);
+    }
+    free(private);
+    server->private = NULL;
+}
+
+static int coro_server_report(server_t* server, char* buf, size_t len)
+{
+    return snprintf(buf, len, "Coroutines: %zu live, %zu peak; %zu context switches\n"
+                              "Coroutine stacks: %zu allocated, %zu KiB each + %zu KiB guard\n",
+                    coro_stats.live, coro_stats.peak, coro_stats.switches,
+                    coro_stats.stacks, coro_stats.stack_size / 1024, coro_stats.guard_size / 1024);
+}
@@ -0,0 +1,273 @@
+/*********************************************************************************************
+Name:			echo.c
+
+    Required:	echo.h
+                config.h
+                done.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    The per-connection echo routine shared by the select and poll servers. Both only differ
+    in how they learn that a client is ready, so everything from reading frames to queueing,
+    splicing and throttling echoes to logging the transfer once the client is done lives
+    here.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "done.h"
+#include "echo.h"
+#include "log.h"
+#include "timing.h"
+
+void echo_conn_init(echo_conn_t* conn)
+{
+    frame_decoder_init(&conn->input);
+    output_queue_init(&conn->output);
+    splice_pipe_init(&conn->splice);
+    conn->splice_left = 0;
+    conn->transferred = 0;
+    conn->transfer_time = 0;
+}
+
+/**
+ * Sends as much of the connection's output as the socket will take: whatever is still in the splice pipe first, since
+ * everything in the output queue was echoed after it, and then the queue. The throttle is updated to match what's
+ * left, so that the loop's watch never waits on a stale one.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int echo_conn_flush(int sock, echo_conn_t* conn)
+{
+    if (conn->splice.queued > 0 && splice_drain(sock, &conn->splice) == -1)
+    {
+        return -1;
+    }
+    if (conn->splice.queued == 0 && output_queue_flush(sock, &conn->output) == -1)
+    {
+        return -1;
+    }
+    output_queue_throttled(&conn->output, conn->splice.queued);
+    return 0;
+}
+
+int echo_conn_serve(int sock, echo_conn_t* conn)
+{
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    // Anything could have arrived since the last call
+    conn->input.drained = 0;
+
+    size_t read_budget = server_config.read_budget ? server_config.read_budget : DEFAULT_READ_BUDGET;
+    unsigned int message_budget = server_config.message_budget ? server_config.message_budget : DEFAULT_MESSAGE_BUDGET;
+    size_t bytes_read_total = 0;
+    unsigned int messages = 0;
+    int result = ECHO_OPEN;
+
+    if (echo_conn_flush(sock, conn) == -1)
+    {
+        return -1;
+    }
+
+    while (!atomic_load(&done))
+    {
+        if (output_queue_throttled(&conn->output, conn->splice.queued))
+        {
+            // The client isn't reading its echoes fast enough; it isn't watched for input until they drain
+            break;
+        }
+
+        if (conn->splice_left > 0)
+        {
+            if (bytes_read_total >= read_budget)
+            {
+                break;
+            }
+
+            // Spliced data goes straight to the socket, so anything queued ahead of it has to be sent first
+            if (conn->output.pending > 0)
+            {
+                if (echo_conn_flush(sock, conn) == -1)
+                {
+                    return -1;
+                }
+                if (conn->output.pending > 0)
+                {
+                    break;
+                }
+            }
+
+            // The rest of a large body goes socket->pipe->socket as it arrives, so it never reaches the input buffer
+            int eof;
+            ssize_t bytes_spliced = splice_echo(sock, &conn->splice, conn->splice_left, &eof);
+            if (bytes_spliced == -1)
+            {
+                return -1;
+            }
+
+            conn->transferred += bytes_spliced;
+            bytes_read_total += (size_t)bytes_spliced;
+            conn->splice_left -= (size_t)bytes_spliced;
+            if (eof)
+            {
+                // Closed partway through the body
+                result = ECHO_FINISHED;
+                break;
+            }
+            if (conn->splice_left > 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Echo every complete message already buffered before reading again
+        uint32_t msg_size;
+        if (frame_header(&conn->input, &msg_size))
+        {
+            if (msg_size == 0)
+            {
+                // Client is finished sending data
+                result = ECHO_FINISHED;
+                break;
+            }
+
+            if (splice_wanted(msg_size))
+            {
+                // Whatever part of the body has already been read is echoed from the buffer
+                char const* buffered;
+                size_t buffered_len = frame_consume_partial(&conn->input, msg_size, &buffered);
+                if (buffered_len > 0 && output_queue_append(&conn->output, buffered, buffered_len) == -1)
+                {
+                    perror("output_queue_append");
+                    return -1;
+                }
+                echo_stats_add(buffered_len, 0);
+                conn->splice_left = msg_size - buffered_len;
+                ++messages;
+                continue;
+            }
+
+            char* msg = frame_body(&conn->input, msg_size);
+            if (msg)
+            {
+                // We've received a full message; queue its echo for the client
+                if (output_queue_append(&conn->output, msg, msg_size) == -1)
+                {
+                    perror("output_queue_append");
+                    return -1;
+                }
+                echo_stats_add(msg_size, 0);
+                frame_consume(&conn->input, FRAME_HEADER_SIZE + msg_size);
+                ++messages;
+                continue;
+            }
+        }
+
+        // Everything echoed from the buffer so far goes out together before reading more
+        if (echo_conn_flush(sock, conn) == -1)
+        {
+            return -1;
+        }
+
+        // Whatever's buffered is always finished off, since readiness only says what's still on the socket
+        if (conn->input.drained || bytes_read_total >= read_budget || messages >= message_budget)
+        {
+            break;
+        }
+        ssize_t bytes_read = frame_fill(sock, &conn->input);
+        if (bytes_read == -1)
+        {
+            return -1;
+        }
+        if (bytes_read == 0)
+        {
+            if (conn->input.eof)
+            {
+                // Closed without sending a size of 0
+                result = ECHO_FINISHED;
+            }
+            break;
+        }
+        conn->transferred += bytes_read;
+        bytes_read_total += (size_t)bytes_read;
+    }
+
+    if (result == ECHO_OPEN && echo_conn_flush(sock, conn) == -1)
+    {
+        return -1;
+    }
+
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    conn->transfer_time += TIME_DIFF(start, end);
+
+    if (result == ECHO_OPEN && server_config.release_idle)
+    {
+        // Only gives back what's empty, so a connection partway through a frame or an echo keeps its buffers
+        frame_decoder_trim(&conn->input);
+        output_queue_trim(&conn->output);
+    }
+    return result;
+}
+
+int echo_conn_wants_read(echo_conn_t const* conn)
+{
+    return !conn->output.throttled && conn->splice.queued == 0;
+}
+
+int echo_conn_wants_write(echo_conn_t const* conn)
+{
+    return conn->output.pending > 0 || conn->splice.queued > 0;
+}
+
+size_t echo_conn_in_flight(echo_conn_t const* conn)
+{
+    return conn->output.pending + (conn->input.end - conn->input.start);
+}
+
+void echo_conn_close(int sock, echo_conn_t* conn, int result, struct sockaddr_in const* peer)
+{
+    if (result == ECHO_FINISHED)
+    {
+        // Success, so write results to file
+        unsigned short src_port = ntohs(peer->sin_port);
+        char *addr = inet_ntoa(peer->sin_addr);
+        char csv[256];
+        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", conn->transfer_time, conn->transferred, addr, src_port);
+        log_msg(csv);
+
+        char pretty[256];
+        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                 conn->transfer_time, conn->transferred, addr, src_port);
+        printf("%s", pretty);
+    }
+    else
+    {
+        perror("echo");
+    }
+
+    close(sock);
+    echo_conn_release(conn);
+}
+
+void echo_conn_release(echo_conn_t* conn)
+{
+    frame_decoder_release(&conn->input);
+    output_queue_release(&conn->output);
+    splice_pipe_release(&conn->splice);
+    echo_conn_init(conn);
+}
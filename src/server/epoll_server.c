@@ -3,6 +3,7 @@ Name:			epoll_server.c
 
     Required:	epoll_server.h	
                 acceptor.h
+                accept_thread.h
                 done.h
                 server.h
                 protocol.h
@@ -13,39 +14,87 @@ Name:			epoll_server.c
 
     Description:
     This is the epoll server. This file will deal with handling the epoll server connections
-    coming from the client.
+    coming from the client. Each epoll set and its connection table make up a reactor; the
+    plain epoll server runs a single reactor on the accepting thread, the reuseport server
+    runs one reactor per core, each with its own SO_REUSEPORT listening socket, and the
+    multi-threaded server has several worker threads sharing one reactor, with client sockets
+    armed with EPOLLONESHOT so that only one worker handles a connection at a time. In the
+    pooled server the reactors only do I/O and framing: each complete message goes to a
+    work-stealing handler pool, and the handlers post the connection back to its reactor's
+    completion queue (waking it through an eventfd) so that the reactor sends the echo. With
+    an accept policy set, reactors don't accept at all: a dedicated accept thread hands them
+    their clients through per-reactor queues, also signalled with an eventfd. Each reactor
+    also keeps a timing wheel holding one deadline per connection (idle, mid-frame or
+    waiting to send), which it advances between epoll_waits.
 
     Revisions:
-    (none)
+    2026-10-17 - Shane Spoor - Take the listener out of the epoll set while out of fds.
+    2026-10-17 - Shane Spoor - Admit clients under the adaptive limit, fed with turn latencies.
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 
+#include "buffer_pool.h"
 #include "log.h"
 #include "timing.h"
+#include "config.h"
 #include "done.h"
 #include "acceptor.h"
+#include "accept_thread.h"
+#include "admission.h"
+#include "frame.h"
+#include "output_queue.h"
+#include "paged_table.h"
 #include "protocol.h"
 #include "server.h"
+#include "timer_wheel.h"
 #include "vector.h"
+#include "work_pool.h"
+#include "zero_copy.h"
 
 
 #define ACCEPT_PER_ITER 100
-#define NUM_EPOLL_EVENTS 98304
+#define NUM_EPOLL_EVENTS 4096  // Most events taken per epoll_wait; unrelated to how many clients a reactor can hold
+#define EPOLL_MAX_CONNS (1 << 20) // Connection table capacity if there's no open file limit to size it from
+#define NUM_MT_EPOLL_EVENTS 64 // Kept small so that one worker can't grab every ready connection
+#define HANDLE_DEFERRED 2      // handle_request's result for a client that used up its read budget
+#define EPOLL_WAIT_MS 3000     // Longest epoll_wait, after which the reactor says it timed out
+#define EPOLL_TICK_MS 10       // Resolution of the connection deadlines
+
+/**
+ * The deadline a connection's timer is running for, which depends on what it's waiting for.
+ */
+typedef enum
+{
+    EPOLL_TIMEOUT_IDLE = 0, // Between messages, for the client to send another (server_config.client_idle_ms)
+    EPOLL_TIMEOUT_HEADER,   // Partway through a frame, for the client to send more of it (server_config.header_timeout_ms)
+    EPOLL_TIMEOUT_SEND,     // With echoes queued, for the client to take some (server_config.send_timeout_ms)
+    EPOLL_TIMEOUT_KINDS
+} epoll_timeout_kind;
 
 static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
 static int epoll_server_add_client(server_t* server, client_t client);
 static void epoll_server_cleanup(server_t* epoll_server);
+static int epoll_reuseport_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int epoll_pool_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int epoll_server_report(server_t* server, char* buf, size_t len);
 
 static server_t epoll_server_impl =
 {
@@ -54,360 +103,1782 @@ static server_t epoll_server_impl =
     epoll_server_cleanup,
     0,
     0,
-    NULL
+    NULL,
+    epoll_server_report
 };
 
 server_t* epoll_server = &epoll_server_impl;
 
+static server_t epoll_reuseport_server_impl =
+{
+    epoll_reuseport_server_start,
+    epoll_server_add_client,
+    epoll_server_cleanup,
+    0,
+    0,
+    NULL,
+    epoll_server_report
+};
+
+server_t* epoll_reuseport_server = &epoll_reuseport_server_impl;
+
+static server_t epoll_mt_server_impl =
+{
+    epoll_mt_server_start,
+    epoll_server_add_client,
+    epoll_server_cleanup,
+    0,
+    0,
+    NULL,
+    epoll_server_report
+};
+
+server_t* epoll_mt_server = &epoll_mt_server_impl;
+
+static server_t epoll_pool_server_impl =
+{
+    epoll_pool_server_start,
+    epoll_server_add_client,
+    epoll_server_cleanup,
+    0,
+    0,
+    NULL,
+    epoll_server_report
+};
+
+server_t* epoll_pool_server = &epoll_pool_server_impl;
+
+struct epoll_reactor;
+
+/**
+ * The hot half of a connection: everything the reactor touches to handle an event. Entries live in the reactor's
+ * paged connection table at the socket's index, and the socket is registered with a pointer to its entry as the epoll
+ * data, so an event leads straight to its connection.
+ */
 typedef struct
 {
-    ssize_t transferred;
-    time_t transfer_time;
-    uint32_t partial_msg_size; // :(
+    int sock;
+    uint32_t events;     // Events registered for the socket; EPOLLOUT only while output is waiting
+    atomic_int deferred; // Set while the connection is on its reactor's ready list
+    int in_flight; // Set while the handler pool has msg; the reactor leaves the connection alone until it comes back
+    struct epoll_reactor* reactor;
+    frame_decoder_t input;
+    output_queue_t output;
+    char* msg;   // Body of the message being handled, in the input buffer
     uint32_t msg_size;
-    char* msg;
+    atomic_int timed_out; // Set (to its epoll_timeout_kind + 1) when the timer has shut the socket down
+    size_t splice_left; // Body bytes of the current message still to be spliced
+    splice_pipe_t splice;
+    zerocopy_state_t zerocopy; // Echo buffers the kernel is still sending from
+    size_t reported_bytes;     // Input and output bytes last counted in the reactor's accept queue load
+    timer_node_t timer;        // The connection's one deadline, tagged with its epoll_timeout_kind
 } epoll_server_request;
 
+// The cold half (peer address and transfer stats, only written when a turn ends) is a client_stats_t in a second table
+// at the same index. Together they're all that an idle connection costs in user space, apart from whatever buffers it
+// still holds, and with pages allocated on demand the tables only grow with the highest fd in use.
+#define EPOLL_CONN_BUDGET 256 // Bytes of connection table per connection
+_Static_assert(sizeof(epoll_server_request) + sizeof(client_stats_t) <= EPOLL_CONN_BUDGET,
+               "an epoll connection's table entries have outgrown EPOLL_CONN_BUDGET");
+
+typedef struct epoll_reactor
+{
+    int epfd;
+    int listen_sock;        // -1 when clients come from the accept thread instead
+    uint32_t listen_events; // Events the listener is registered for while it isn't paused
+    accept_queue_t* accepts; // The accept thread's queue for this reactor, or NULL if it accepts for itself
+    uint32_t client_events; // Events registered for each client; EPOLLONESHOT when workers share the reactor
+    int max_events;         // Most events taken per epoll_wait
+    paged_table_t conns;    // epoll_server_request, indexed by socket
+    paged_table_t stats;    // client_stats_t, indexed by socket
+    atomic_size_t connected_count;
+
+    // Pooled server only: messages go to the pool, and handled connections come back through the completion queue
+    work_pool_t* pool;
+    int completion_fd;
+    pthread_mutex_t completion_lock;
+    vector_t completions; // Connections whose messages are ready to echo
+    vector_t completions_spare;
+
+    // Connections that used up their read budget, resumed after the next epoll_wait; locked since epoll-mt workers share it
+    pthread_mutex_t ready_lock;
+    vector_t ready;
+
+    // Connection deadlines, in EPOLL_TICK_MS ticks; locked since epoll-mt workers share them
+    pthread_mutex_t timer_lock;
+    timer_wheel_t timers;
+
+    // Set while the listener is out of the epoll set for want of fds; locked so epoll-mt workers can't both move it
+    pthread_mutex_t pause_lock;
+    accept_pause_t pause;
+
+    // Closed connections whose zero-copy buffers the kernel may still be sending from
+    zerocopy_parking_t parking;
+} epoll_reactor;
+
 typedef struct
 {
-    fd_set set;
-    int max_fd;
-    client_t client;
-    epoll_server_request request;
-} epoll_server_client;
+    pthread_t thread;
+    unsigned int cpu;
+    server_t* server;
+    epoll_reactor* reactor;
+} epoll_worker;
 
 typedef struct
 {
-    int epfd;
-    vector_t epoll_clients;
-    size_t connected_count;
+    epoll_reactor* reactors;
+    size_t num_reactors;
+    epoll_worker* workers;
+    size_t num_workers;
+    atomic_size_t connected_count; // Summed over every reactor
+    work_pool_t pool;
+    int has_pool;
+    accept_thread_t acceptor;
+    accept_queue_t* accept_queues; // One per reactor while the accept thread is in use
 } epoll_server_private;
 
+// Kept outside the private data so that they can still be reported after cleanup
+static struct
+{
+    atomic_size_t turns;        // epoll_wait batches handled
+    atomic_size_t turn_ns;      // Total time spent handling them
+    atomic_size_t turn_ns_max;
+    atomic_size_t offloaded;    // Messages handed to the pool
+    atomic_size_t wakeups;      // Completion eventfd wakeups
+    atomic_size_t deferred;     // Times a client used up its read budget and went on the ready list
+    atomic_size_t expired[EPOLL_TIMEOUT_KINDS]; // Connections closed by each deadline
+    size_t handlers;
+    size_t executed;
+    size_t stolen;
+    size_t table_bytes; // Connection table pages, copied out when the tables are freed
+} epoll_stats;
+
+static atomic_ulong handler_sink; // Keeps the simulated handler work from being optimised away
+
+static int epoll_reactor_add_client(server_t* server, epoll_reactor* reactor, client_t client);
+
+/**
+ * Stands in for real per-message processing by running server_config.handler_cost checksum passes over the message.
+ */
+static void epoll_handler_work(char const* msg, size_t len)
+{
+    unsigned long sum = 0;
+    for (unsigned int pass = 0; pass < server_config.handler_cost; ++pass)
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            sum = sum * 31 + (unsigned char)msg[i];
+        }
+    }
+    atomic_store_explicit(&handler_sink, sum, memory_order_relaxed);
+}
+
+/**
+ * Queues the echo of the request's current message and consumes its frame from the input buffer. The echo goes out
+ * with the rest of the connection's output the next time it's flushed, except for zero-copy sends, which are made
+ * straight away if nothing is waiting ahead of them; whatever of those the socket won't take is queued like any other
+ * echo.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int epoll_send_message(int sock, epoll_server_request* request)
+{
+    size_t frame_len = FRAME_HEADER_SIZE + request->msg_size;
+    char* msg = request->msg;
+    request->msg = NULL;
+
+    if (zerocopy_wanted(request->msg_size) && request->output.pending == 0 && request->splice.queued == 0)
+    {
+        // The input buffer now belongs to the kernel until its completion arrives, so the decoder moves to a new one
+        char* buf = frame_detach(&request->input, frame_len);
+        if (buf)
+        {
+            return zerocopy_send(sock, &request->zerocopy, &request->output, buf, msg, request->msg_size);
+        }
+    }
+
+    if (output_queue_append(&request->output, msg, request->msg_size) == -1)
+    {
+        perror("output_queue_append");
+        return -1;
+    }
+    echo_stats_add(request->msg_size, 0);
+    frame_consume(&request->input, frame_len);
+    return 0;
+}
+
+/**
+ * Sends as much of the client's output as the socket will take: whatever is still in the splice pipe first, since
+ * everything in the output queue was echoed after it, and then the queue. The throttle is updated to match what's
+ * left, so that the registered events never wait on a stale one.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int epoll_flush(int sock, epoll_server_request* request)
+{
+    if (request->splice.queued > 0 && splice_drain(sock, &request->splice) == -1)
+    {
+        return -1;
+    }
+    if (request->splice.queued == 0 && output_queue_flush(sock, &request->output) == -1)
+    {
+        return -1;
+    }
+    output_queue_throttled(&request->output, request->splice.queued);
+    return 0;
+}
+
+/**
+ * Returns the events to register for a client: the reactor's usual ones, plus EPOLLOUT while it has output waiting
+ * (queued or left in its splice pipe), and without EPOLLIN while it's throttled (so that every new segment from a client
+ * that won't be read yet doesn't wake the reactor for nothing).
+ */
+static uint32_t epoll_client_events(epoll_reactor const* reactor, epoll_server_request const* request)
+{
+    int waiting = request->output.pending > 0 || request->splice.queued > 0;
+    uint32_t events = reactor->client_events | (waiting ? EPOLLOUT : 0);
+    return request->output.throttled ? events & ~EPOLLIN : events;
+}
+
 /**
- * Handles a client request on the given socket.
+ * Updates the client's registered events to match its output queue. One-shot reactors set the events when they re-arm
+ * the socket instead.
  *
- * @param set  The client set for this server, which contains the list of clients and requests.
- * @param sock The socket for the given client.
  * @return 0 on success, or -1 on failure.
  */
-static int handle_request(server_t* server, int sock)
+static int epoll_update_events(epoll_reactor* reactor, epoll_server_request* request)
+{
+    uint32_t events = epoll_client_events(reactor, request);
+    if (events == request->events || (reactor->client_events & EPOLLONESHOT))
+    {
+        return 0;
+    }
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = request;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, request->sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    request->events = events;
+    return 0;
+}
+
+/**
+ * Runs the handler for a complete message on a pool thread and posts the connection back to its reactor.
+ */
+static void epoll_pool_handle(void* void_request)
+{
+    epoll_server_request* request = (epoll_server_request*)void_request;
+    epoll_reactor* reactor = request->reactor;
+
+    epoll_handler_work(request->msg, request->msg_size);
+
+    pthread_mutex_lock(&reactor->completion_lock);
+    int was_empty = reactor->completions.size == 0;
+    int pushed = vector_push_back(&reactor->completions, &request);
+    pthread_mutex_unlock(&reactor->completion_lock);
+
+    if (pushed == -1)
+    {
+        perror("completion queue");
+        atomic_store(&done, 1);
+    }
+
+    // The reactor swaps the whole queue out after reading the eventfd, so only the first completion needs to wake it
+    uint64_t one = 1;
+    if (was_empty && write(reactor->completion_fd, &one, sizeof(one)) == -1)
+    {
+        perror("write eventfd");
+    }
+}
+
+/**
+ * Returns the deadline in milliseconds for a kind of timeout, or 0 if it's off.
+ */
+static unsigned long epoll_timeout_ms(epoll_timeout_kind kind)
+{
+    switch (kind)
+    {
+        case EPOLL_TIMEOUT_IDLE:
+            return server_config.client_idle_ms;
+        case EPOLL_TIMEOUT_HEADER:
+            return server_config.header_timeout_ms;
+        case EPOLL_TIMEOUT_SEND:
+            return server_config.send_timeout_ms;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns whether any connection deadline is set, since without one the reactors skip the timing wheel altogether.
+ */
+static int epoll_timeouts_enabled(void)
+{
+    return server_config.client_idle_ms || server_config.header_timeout_ms || server_config.send_timeout_ms;
+}
+
+/**
+ * Returns the current time in timing wheel ticks. The coarse clock is read without a system call and is well within
+ * a tick.
+ */
+static uint32_t epoll_timer_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * (1000 / EPOLL_TICK_MS) + (uint64_t)now.tv_nsec / (EPOLL_TICK_MS * 1000000));
+}
+
+/**
+ * Restarts a connection's timer for whatever it's now waiting on, or stops it if that has no deadline or the handler
+ * pool has the connection. Called at the end of every turn, so any progress pushes the deadline back.
+ */
+static void epoll_timer_arm(epoll_reactor* reactor, epoll_server_request* request)
+{
+    epoll_timeout_kind kind = EPOLL_TIMEOUT_IDLE;
+    if (request->output.pending > 0 || request->splice.queued > 0)
+    {
+        kind = EPOLL_TIMEOUT_SEND;
+    }
+    else if (request->input.end > request->input.start || request->splice_left > 0)
+    {
+        kind = EPOLL_TIMEOUT_HEADER;
+    }
+    unsigned long ms = request->in_flight ? 0 : epoll_timeout_ms(kind);
+
+    pthread_mutex_lock(&reactor->timer_lock);
+    if (ms == 0)
+    {
+        timer_wheel_cancel(&reactor->timers, &request->timer);
+    }
+    else
+    {
+        request->timer.tag = (uint32_t)kind;
+        unsigned long ticks = (ms + EPOLL_TICK_MS - 1) / EPOLL_TICK_MS;
+        timer_wheel_schedule(&reactor->timers, &request->timer, ticks > TIMER_WHEEL_MAX ? TIMER_WHEEL_MAX : (uint32_t)ticks);
+    }
+    pthread_mutex_unlock(&reactor->timer_lock);
+}
+
+/**
+ * Shuts down the socket of a connection whose deadline has passed. The connection isn't closed here, since (in
+ * epoll-mt) another worker may be handling it; instead the shutdown wakes it with EPOLLHUP, and whichever worker gets
+ * that event finds the socket closed and cleans up as usual.
+ */
+static void epoll_timer_fire(timer_node_t* node, void* arg)
+{
+    (void)arg;
+    epoll_server_request* request = (epoll_server_request*)((char*)node - offsetof(epoll_server_request, timer));
+    atomic_store(&request->timed_out, (int)node->tag + 1);
+    atomic_fetch_add(&epoll_stats.expired[node->tag], 1);
+    shutdown(request->sock, SHUT_RDWR);
+}
+
+/**
+ * Fires every connection deadline that has passed, and finishes closing the parked connections whose zero-copy
+ * completions have come in.
+ */
+static void epoll_reactor_expire(epoll_reactor* reactor)
+{
+    zerocopy_parking_reap(&reactor->parking, 0);
+
+    if (epoll_timeouts_enabled())
+    {
+        pthread_mutex_lock(&reactor->timer_lock);
+        timer_wheel_advance(&reactor->timers, epoll_timer_now(), epoll_timer_fire, NULL);
+        pthread_mutex_unlock(&reactor->timer_lock);
+    }
+}
+
+/**
+ * Returns how long the reactor can wait for events before it has to fire a deadline, capped at EPOLL_WAIT_MS.
+ */
+static int epoll_reactor_wait_ms(epoll_reactor* reactor)
+{
+    if (!epoll_timeouts_enabled())
+    {
+        return EPOLL_WAIT_MS;
+    }
+
+    pthread_mutex_lock(&reactor->timer_lock);
+    uint32_t ticks = timer_wheel_next(&reactor->timers);
+    pthread_mutex_unlock(&reactor->timer_lock);
+    return ticks >= EPOLL_WAIT_MS / EPOLL_TICK_MS ? EPOLL_WAIT_MS : (int)ticks * EPOLL_TICK_MS;
+}
+
+/**
+ * Takes the listener out of the epoll set after accept_clients ran out of fds, so that a backlog the reactor can't
+ * accept from doesn't keep waking it. It's removed rather than modified since an EPOLLEXCLUSIVE registration can't be.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int epoll_reactor_pause(epoll_reactor* reactor)
+{
+    int result = 0;
+    pthread_mutex_lock(&reactor->pause_lock);
+    if (accept_pause_start(&reactor->pause, atomic_load(&reactor->connected_count)) &&
+        (result = epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, reactor->listen_sock, NULL)) == -1)
+    {
+        perror("epoll_ctl");
+    }
+    pthread_mutex_unlock(&reactor->pause_lock);
+    return result;
+}
+
+/**
+ * Puts a paused listener back in the epoll set once enough clients have closed, or the retry interval is up. Being
+ * edge-triggered, adding it reports any clients that queued up meanwhile.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int epoll_reactor_resume(epoll_reactor* reactor)
+{
+    if (!atomic_load(&reactor->pause.paused))
+    {
+        return 0;
+    }
+
+    int result = 0;
+    pthread_mutex_lock(&reactor->pause_lock);
+    if (accept_pause_over(&reactor->pause, atomic_load(&reactor->connected_count)))
+    {
+        struct epoll_event event;
+        event.events = reactor->listen_events;
+        event.data.ptr = &reactor->listen_sock;
+        if ((result = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->listen_sock, &event)) == -1)
+        {
+            perror("epoll_ctl");
+        }
+    }
+    pthread_mutex_unlock(&reactor->pause_lock);
+    return result;
+}
+
+/**
+ * Closes a client that has finished or failed: logs its transfer if it finished (or the error if it failed), takes it
+ * out of the reactor and its counts, and releases its buffers, leaving its table entry ready for the next client.
+ *
+ * @param server  The server, which holds the connection count shared by every reactor.
+ * @param reactor The reactor that owns the connection.
+ * @param request The connection's entry in the reactor's connection table.
+ * @param result  0 if the client finished, or -1 if it failed (with errno set).
+ * @param elapsed Microseconds of the current turn to add to its transfer time if it finished.
+ */
+static void epoll_close_client(server_t* server, epoll_reactor* reactor, epoll_server_request* request, int result,
+                               time_t elapsed)
 {
     epoll_server_private* private = (epoll_server_private*)server->private;
-    epoll_server_client* client_list = (epoll_server_client*)private->epoll_clients.items;
-    int index = sock; // To make things a bit less confusing
-    epoll_server_client* epoll_client = client_list + index;
-    epoll_server_request* request = &epoll_client->request;
+    int sock = request->sock;
+    client_stats_t* stats = paged_table_find(&reactor->stats, (size_t)sock);
+
+    atomic_fetch_sub(&reactor->connected_count, 1);
+    atomic_fetch_sub(&private->connected_count, 1);
+    if (reactor->accepts)
+    {
+        atomic_fetch_sub(&reactor->accepts->connections, 1);
+        atomic_fetch_sub(&reactor->accepts->bytes_in_flight, request->reported_bytes);
+        request->reported_bytes = 0;
+    }
+
+    if (epoll_timeouts_enabled())
+    {
+        pthread_mutex_lock(&reactor->timer_lock);
+        timer_wheel_cancel(&reactor->timers, &request->timer);
+        pthread_mutex_unlock(&reactor->timer_lock);
+    }
+
+    // Failing to read from or write to a socket the timer shut down isn't an error, and it was counted when it fired
+    int timed_out = atomic_exchange(&request->timed_out, 0);
+    if (timed_out)
+    {
+        result = 0;
+    }
+    else if (result == 0)
+    {
+        // Success, so write results to file
+        stats->transfer_time += elapsed;
+
+        unsigned short src_port = ntohs(stats->peer.sin_port);
+        char *addr = inet_ntoa(stats->peer.sin_addr);
+        char csv[256];
+        snprintf(csv, 256, "%ld,%zu,%s:%hu\n", stats->transfer_time, stats->transferred, addr, src_port);
+        log_msg(csv);
+
+        char pretty[256];
+        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %zu; peer: %s:%hu\n",
+              stats->transfer_time, stats->transferred, addr, src_port);
+        printf("%s", pretty);
+    }
+    else
+    {
+        perror("oops!");
+    }
+
+    struct epoll_event ev;
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, sock, &ev);
+
+    frame_decoder_release(&request->input);
+    output_queue_release(&request->output);
+    splice_pipe_release(&request->splice);
+
+    // Reset everything for the next client before the fd can be reused
+    //FD_CLR(sock, &set->set);
+    request->msg = NULL;
+    request->msg_size = 0;
+    request->splice_left = 0;
+    atomic_store(&request->deferred, 0);
+    request->sock = -1;
+
+    // The kernel may still be sending (or resending) from zero-copy buffers, so those wait with the socket until it's done
+    zerocopy_park(&reactor->parking, sock, &request->zerocopy);
+}
+
+/**
+ * Handles a client request on the given socket, reading until the socket would block or the client has used up its
+ * read budget (server_config.read_budget bytes or server_config.message_budget messages) for this turn.
+ *
+ * @param server  The server, which holds the connection count shared by every reactor.
+ * @param reactor The reactor that owns the connection.
+ * @param request The connection's entry in the reactor's connection table.
+ * @return 0 if the client is still connected, 1 if it has finished or failed and its socket has been closed,
+ *         HANDLE_DEFERRED if it used up its budget and should be resumed later, or -1 if the reactor failed (e.g. to
+ *         update the client's events).
+ */
+static int handle_request(server_t* server, epoll_reactor* reactor, epoll_server_request* request)
+{
+    int sock = request->sock;
+    client_stats_t* stats = paged_table_find(&reactor->stats, (size_t)sock);
+
+    if (request->zerocopy.pending.size > 0 && zerocopy_reap(sock, &request->zerocopy) == -1)
+    {
+        perror("zerocopy_reap");
+    }
+
+    if (request->in_flight)
+    {
+        // Reading resumes once the pool's echo has been queued; until then only earlier echoes can go out
+        if (epoll_flush(sock, request) == -1)
+        {
+            perror("sendmsg");
+        }
+        return epoll_update_events(reactor, request);
+    }
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    // Anything could have arrived since the last call
+    request->input.drained = 0;
+
+    size_t read_budget = server_config.read_budget ? server_config.read_budget : DEFAULT_READ_BUDGET;
+    unsigned int message_budget = server_config.message_budget ? server_config.message_budget : DEFAULT_MESSAGE_BUDGET;
+    size_t bytes_read_total = 0;
+    unsigned int messages = 0;
+    int deferred = 0;
+    int throttled = 0;
+
+    int result = 0;
+    if (epoll_flush(sock, request) == -1)
+    {
+        result = -1;
+        goto cleanup;
+    }
+
+    while (!atomic_load(&done))
+    {
+        if (output_queue_throttled(&request->output, request->splice.queued))
+        {
+            // The client isn't reading its echoes fast enough; stop reading from it until EPOLLOUT drains them
+            throttled = 1;
+            break;
+        }
+
+        if (bytes_read_total >= read_budget || messages >= message_budget)
+        {
+            // Edge-triggered, so nothing will wake us for the rest; the reactor picks it up again after its other clients
+            deferred = 1;
+            break;
+        }
+
+        if (request->splice_left > 0)
+        {
+            // Spliced data goes straight to the socket, so anything queued ahead of it has to be sent first
+            if (request->output.pending > 0)
+            {
+                if (epoll_flush(sock, request) == -1)
+                {
+                    result = -1;
+                    goto cleanup;
+                }
+                if (request->output.pending > 0)
+                {
+                    break;
+                }
+            }
+
+            // The rest of a large body goes socket->pipe->socket as it arrives, so it never reaches the input buffer
+            int eof;
+            ssize_t bytes_spliced = splice_echo(sock, &request->splice, request->splice_left, &eof);
+            if (bytes_spliced == -1)
+            {
+                result = -1;
+                goto cleanup;
+            }
+
+            stats->transferred += (size_t)bytes_spliced;
+            bytes_read_total += (size_t)bytes_spliced;
+            request->splice_left -= (size_t)bytes_spliced;
+            if (eof)
+            {
+                // Closed partway through the body
+                goto cleanup;
+            }
+            if (request->splice_left > 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Handle every complete message already buffered before reading again
+        uint32_t msg_size;
+        if (frame_header(&request->input, &msg_size))
+        {
+            if (msg_size == 0)
+            {
+                // Client is finished sending data
+                goto cleanup;
+            }
+
+            if (splice_wanted(msg_size))
+            {
+                // Whatever part of the body has already been read is echoed from the buffer
+                char const* buffered;
+                size_t buffered_len = frame_consume_partial(&request->input, msg_size, &buffered);
+                if (buffered_len > 0 && output_queue_append(&request->output, buffered, buffered_len) == -1)
+                {
+                    perror("output_queue_append");
+                    result = -1;
+                    goto cleanup;
+                }
+                echo_stats_add(buffered_len, 0);
+                request->splice_left = msg_size - buffered_len;
+                ++messages;
+                continue;
+            }
+
+            char* body = frame_body(&request->input, msg_size);
+            if (body && reactor->pool)
+            {
+                // We've received a full message; the pool handles it while this connection stops reading
+                request->msg = body;
+                request->msg_size = msg_size;
+                request->in_flight = 1;
+                atomic_fetch_add(&epoll_stats.offloaded, 1);
+                if (work_pool_submit(reactor->pool, epoll_pool_handle, request) == -1)
+                {
+                    perror("work_pool_submit");
+                    request->in_flight = 0;
+                    result = -1;
+                    goto cleanup;
+                }
+                break;
+            }
+            else if (body)
+            {
+                // We've received a full message; echo back to the client
+                request->msg = body;
+                request->msg_size = msg_size;
+                epoll_handler_work(request->msg, request->msg_size);
+                if (epoll_send_message(sock, request) == -1)
+                {
+                    result = -1;
+                    goto cleanup;
+                }
+                ++messages;
+                continue;
+            }
+        }
+
+        // Everything echoed from the buffer so far goes out together before reading more
+        if (epoll_flush(sock, request) == -1)
+        {
+            result = -1;
+            goto cleanup;
+        }
+
+        if (request->input.drained)
+        {
+            break;
+        }
+        ssize_t bytes_read = frame_fill(sock, &request->input);
+        if (bytes_read == -1)
+        {
+            result = -1;
+            goto cleanup;
+        }
+        if (bytes_read == 0)
+        {
+            if (request->input.eof)
+            {
+                // Closed without sending a size of 0
+                goto cleanup;
+            }
+            break;
+        }
+        stats->transferred += (size_t)bytes_read;
+    }
+
+    if (epoll_flush(sock, request) == -1)
+    {
+        result = -1;
+        goto cleanup;
+    }
+    if (throttled && !request->output.throttled)
+    {
+        // The echoes drained on the way out, and edge-triggered input won't fire again for what's already waiting
+        deferred = 1;
+    }
+
+    {
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        stats->transfer_time += TIME_DIFF(start, end);
+    }
+
+    if (server_config.release_idle && !request->in_flight)
+    {
+        // Only gives back what's empty, so a connection partway through a frame or an echo keeps its buffers
+        frame_decoder_trim(&request->input);
+        output_queue_trim(&request->output);
+    }
+
+    if (epoll_timeouts_enabled())
+    {
+        epoll_timer_arm(reactor, request);
+    }
+
+    if (epoll_update_events(reactor, request) == -1)
+    {
+        return -1;
+    }
+    return deferred ? HANDLE_DEFERRED : 0;
+
+cleanup:
+    {
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        time_t elapsed = TIME_DIFF(start, end);
+        epoll_close_client(server, reactor, request, result, elapsed);
+    }
+
+    // A client that failed has been closed like one that finished; only a failure of the reactor's own stops it
+    return 1;
+}
+
+/**
+ * Handles a client's events, then either puts it on the ready list if it used up its read budget or, for a one-shot
+ * reactor, re-arms it so that whichever worker is free can take its next event.
+ *
+ * @return 0 on success (including the client having finished), or -1 on failure.
+ */
+static int epoll_client_service(server_t* server, epoll_reactor* reactor, epoll_server_request* request)
+{
+    int sock = request->sock;
+    int request_result = handle_request(server, reactor, request);
+    if ((request_result == 0 || request_result == HANDLE_DEFERRED) && reactor->accepts)
+    {
+        // Only the change is published, so a connection in lockstep with its client costs nothing here
+        size_t in_flight = request->output.pending + (request->input.end - request->input.start);
+        if (in_flight != request->reported_bytes)
+        {
+            atomic_fetch_add_explicit(&reactor->accepts->bytes_in_flight, in_flight - request->reported_bytes,
+                                      memory_order_relaxed);
+            request->reported_bytes = in_flight;
+        }
+    }
+
+    if (request_result == HANDLE_DEFERRED)
+    {
+        atomic_store(&request->deferred, 1);
+
+        pthread_mutex_lock(&reactor->ready_lock);
+        int pushed = vector_push_back(&reactor->ready, &request);
+        pthread_mutex_unlock(&reactor->ready_lock);
+        if (pushed == -1)
+        {
+            perror("vector_push_back");
+            return -1;
+        }
+        atomic_fetch_add(&epoll_stats.deferred, 1);
+    }
+    else if (request_result == 0 && (reactor->client_events & EPOLLONESHOT))
+    {
+        struct epoll_event event;
+        event.events = epoll_client_events(reactor, request);
+        event.data.ptr = request;
+        if (epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, sock, &event) == -1)
+        {
+            perror("epoll_ctl");
+            return -1;
+        }
+    }
+    return request_result == -1 ? -1 : 0;
+}
+
+/**
+ * Sends the echoes for every connection the pool has finished with, then resumes reading from each of them. A client
+ * whose echo can't be sent is closed, and the rest are carried on with.
+ *
+ * @param server  The server that owns the reactor.
+ * @param reactor The reactor whose completion queue will be drained.
+ * @return 0 on success, or -1 if the reactor itself failed.
+ */
+static int epoll_reactor_complete(server_t* server, epoll_reactor* reactor)
+{
+    uint64_t count;
+    if (read(reactor->completion_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    {
+        perror("read eventfd");
+        return -1;
+    }
+    atomic_fetch_add(&epoll_stats.wakeups, 1);
+
+    pthread_mutex_lock(&reactor->completion_lock);
+    vector_t ready = reactor->completions;
+    reactor->completions = reactor->completions_spare;
+    pthread_mutex_unlock(&reactor->completion_lock);
+
+    epoll_server_request** requests = (epoll_server_request**)ready.items;
+    int result = 0;
+    for (size_t i = 0; i < ready.size && result == 0; ++i)
+    {
+        epoll_server_request* request = requests[i];
+        request->in_flight = 0;
+
+        if (epoll_send_message(request->sock, request) == -1)
+        {
+            // Only costs this client; the rest of the completions still go out
+            epoll_close_client(server, reactor, request, -1, 0);
+        }
+        else if (epoll_client_service(server, reactor, request) == -1)
+        {
+            // Edge-triggered, so anything that arrived while the message was away has to be read now
+            result = -1;
+        }
+    }
+
+    ready.size = 0;
+    reactor->completions_spare = ready;
+    return result;
+}
+
+/**
+ * Creates the reactor's epoll set and connection tables and registers its listening socket. The tables can hold any fd
+ * below the open file limit, but only get pages as fds in them are used.
+ *
+ * @param reactor     The reactor to initialise.
+ * @param listen_sock The listening socket from which this reactor accepts clients, or -1 if it will get them from the
+ *                    accept thread.
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int epoll_reactor_init(epoll_reactor* reactor, int listen_sock)
+{
+    struct epoll_event event;
+
+    reactor->listen_sock = listen_sock;
+    reactor->listen_events = EPOLLIN | EPOLLET | EPOLLHUP | EPOLLERR;
+    atomic_store(&reactor->pause.paused, 0);
+    reactor->client_events = EPOLLIN | EPOLLET;
+    reactor->max_events = NUM_EPOLL_EVENTS;
+    atomic_store(&reactor->connected_count, 0);
+    reactor->epfd = -1;
+    reactor->pool = NULL;
+    reactor->completion_fd = -1;
+    reactor->accepts = NULL;
+
+    struct rlimit open_file_limit;
+    if (getrlimit(RLIMIT_NOFILE, &open_file_limit) == -1)
+    {
+        perror("getrlimit");
+        return -1;
+    }
+    size_t capacity = open_file_limit.rlim_cur == RLIM_INFINITY ? EPOLL_MAX_CONNS : (size_t)open_file_limit.rlim_cur;
+    if (paged_table_init(&reactor->conns, sizeof(epoll_server_request), capacity) == -1 ||
+        paged_table_init(&reactor->stats, sizeof(client_stats_t), capacity) == -1)
+    {
+        perror("malloc clients");
+        return -1;
+    }
+
+    if (vector_init(&reactor->ready, sizeof(epoll_server_request*), 0) == -1 ||
+        zerocopy_parking_init(&reactor->parking) == -1)
+    {
+        perror("malloc ready list");
+        return -1;
+    }
+    pthread_mutex_init(&reactor->ready_lock, NULL);
+    pthread_mutex_init(&reactor->timer_lock, NULL);
+    pthread_mutex_init(&reactor->pause_lock, NULL);
+    timer_wheel_init(&reactor->timers, epoll_timer_now());
+
+    if ((reactor->epfd = epoll_create(NUM_EPOLL_EVENTS)) == -1)
+    {
+        perror("epoll_create");
+        return -1;
+    }
+    if (listen_sock == -1)
+    {
+        return 0;
+    }
+
+    // Set accept socket to non-blocking mode
+    if (fcntl(listen_sock, F_SETFL, O_NONBLOCK | fcntl(listen_sock, F_GETFL, 0)) == -1)
+    {
+        perror("fnctl");
+        return -1;
+    }
+
+    event.events = reactor->listen_events;
+    event.data.ptr = &reactor->listen_sock;
+
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, listen_sock, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the reactor's event loop until the done flag is set or an error occurs. Clients that used up their read budget
+ * in one turn are resumed after the next epoll_wait, which doesn't block while any are waiting, so that every other
+ * ready client gets its turn first.
+ *
+ * @param server  The server that owns the reactor.
+ * @param reactor The reactor to run.
+ * @return 0 on success, or -1 on failure.
+ */
+static int epoll_reactor_run(server_t* server, epoll_reactor* reactor)
+{
+    epoll_server_private* priv = (epoll_server_private*)server->private;
+    int epoll_ready = 0;
+    int err = 0;
+    struct epoll_event events[NUM_EPOLL_EVENTS];
+
+    vector_t resume;
+    if (vector_init(&resume, sizeof(epoll_server_request*), 0) == -1)
+    {
+        perror("malloc ready list");
+        return -1;
+    }
+
+    while (!atomic_load(&done))
+    {
+        // Only the clients deferred before this turn are resumed in it; any deferred again wait for the next one
+        pthread_mutex_lock(&reactor->ready_lock);
+        vector_t swap = reactor->ready;
+        reactor->ready = resume;
+        resume = swap;
+        pthread_mutex_unlock(&reactor->ready_lock);
+
+        int wait_ms = resume.size ? 0 : epoll_reactor_wait_ms(reactor);
+        int pause_ms = accept_pause_wait_ms(&reactor->pause);
+        if (pause_ms != -1 && pause_ms < wait_ms)
+        {
+            wait_ms = pause_ms;
+        }
+        epoll_ready = epoll_wait(reactor->epfd, events, reactor->max_events, wait_ms);
+        if (epoll_ready == -1)
+        {
+            if (errno != EINTR)
+            {
+                perror("epoll_wait");
+                err = 1;
+            }
+            break;
+        }else if (epoll_ready == 0 && resume.size == 0)
+        {
+            // Woken early for a deadline rather than after a whole quiet EPOLL_WAIT_MS
+            if (wait_ms == EPOLL_WAIT_MS)
+            {
+                printf("timed out\n");
+            }
+            epoll_reactor_expire(reactor);
+            if (epoll_reactor_resume(reactor) == -1)
+            {
+                err = 1;
+                break;
+            }
+            continue;
+        }
+        // printf("number of events ready: %d\n", epoll_ready);
+        struct timespec turn_start;
+        clock_gettime(CLOCK_MONOTONIC, &turn_start);
+
+        int index;
+        for (index = 0; index < epoll_ready && !atomic_load(&done); index++)
+        {
+            // Everything but a client is registered with a pointer to its fd's field in the reactor
+            void* data = events[index].data.ptr;
+            if (data == &reactor->completion_fd)
+            {
+                if (epoll_reactor_complete(server, reactor) == -1)
+                {
+                    err = 1;
+                    break;
+                }
+            }
+            else if (data == &reactor->listen_sock || (reactor->accepts && data == &reactor->accepts->event_fd))
+            {
+                // Edge-triggered listener, so keep going until the backlog (or the accept thread's queue) is empty
+                client_t clients[ACCEPT_PER_ITER];
+                int accepted;
+                do
+                {
+                    accepted = reactor->accepts ?
+                               (int)accept_queue_take(reactor->accepts, clients, ACCEPT_PER_ITER) :
+                               accept_clients(reactor->listen_sock, clients, ACCEPT_PER_ITER);
+                    for (int i = 0; i < accepted && !err; ++i)
+                    {
+                        if (epoll_reactor_add_client(server, reactor, clients[i]) == -1)
+                        {
+                            err = 1;
+                        }
+                    }
+                } while (accepted == ACCEPT_PER_ITER && !err);
+
+                if (accepted == -1 || err || (accepted == ACCEPT_EXHAUSTED && epoll_reactor_pause(reactor) == -1))
+                {
+                    err = 1;
+                    break;
+                }
+            }
+            else if (epoll_client_service(server, reactor, (epoll_server_request*)data) == -1)
+            {
+                err = 1;
+                break;
+            }
+        }
+
+        epoll_server_request** requests = (epoll_server_request**)resume.items;
+        for (size_t i = 0; i < resume.size && !err && !atomic_load(&done); ++i)
+        {
+            // Cleared when the client finishes, so a closed (or since reused) fd is skipped
+            if (atomic_exchange(&requests[i]->deferred, 0) &&
+                epoll_client_service(server, reactor, requests[i]) == -1)
+            {
+                err = 1;
+            }
+        }
+        resume.size = 0;
+        if (err)
+        {
+            break;
+        }
+        epoll_reactor_expire(reactor);
+        if (epoll_reactor_resume(reactor) == -1)
+        {
+            err = 1;
+            break;
+        }
+
+        struct timespec turn_end;
+        clock_gettime(CLOCK_MONOTONIC, &turn_end);
+        size_t turn_ns = (size_t)((turn_end.tv_sec - turn_start.tv_sec) * 1000000000L + (turn_end.tv_nsec - turn_start.tv_nsec));
+        atomic_fetch_add(&epoll_stats.turns, 1);
+        atomic_fetch_add(&epoll_stats.turn_ns, turn_ns);
+
+        // Whoever was served last in the turn waited all of it for their echo, so it's the latency that queueing adds
+        admission_sample(turn_ns, atomic_load(&priv->connected_count));
+        size_t turn_max = atomic_load(&epoll_stats.turn_ns_max);
+        while (turn_ns > turn_max && !atomic_compare_exchange_weak(&epoll_stats.turn_ns_max, &turn_max, turn_ns));
+    }
+
+    vector_free(&resume);
+    return err ? -1 : 0;
+}
+
+/**
+ * Returns the bytes of connection table pages allocated across every reactor. Pages are only ever added, so this is
+ * the most the tables have held since the server started.
+ */
+static size_t epoll_table_bytes(epoll_server_private* priv)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < priv->num_reactors; ++i)
+    {
+        bytes += paged_table_bytes(&priv->reactors[i].conns) + paged_table_bytes(&priv->reactors[i].stats);
+    }
+    return bytes;
+}
+
+/**
+ * Allocates the private data for a server with the given number of reactors and worker threads.
+ *
+ * @return The private data, or NULL if out of memory.
+ */
+static epoll_server_private* epoll_server_private_create(size_t num_reactors, size_t num_workers)
+{
+    epoll_server_private* priv = malloc(sizeof(epoll_server_private));
+    if (priv == NULL)
+    {
+        return NULL;
+    }
+
+    priv->reactors = calloc(num_reactors, sizeof(epoll_reactor));
+    priv->workers = calloc(num_workers, sizeof(epoll_worker));
+    if (priv->reactors == NULL || priv->workers == NULL)
+    {
+        free(priv->reactors);
+        free(priv->workers);
+        free(priv);
+        return NULL;
+    }
+    priv->num_reactors = num_reactors;
+    priv->num_workers = num_workers;
+    priv->has_pool = 0;
+    priv->acceptor.running = 0;
+    priv->accept_queues = NULL;
+    atomic_store(&priv->connected_count, 0);
+    for (size_t i = 0; i < num_reactors; ++i)
+    {
+        priv->reactors[i].epfd = -1;
+        priv->reactors[i].listen_sock = -1;
+        priv->reactors[i].completion_fd = -1;
+    }
+
+    return priv;
+}
+
+/**
+ * Starts the accept thread for server_config.accept_policy, giving each reactor a queue to take its clients from in
+ * place of a listening socket.
+ *
+ * @param priv        The server's private data, whose reactors have been initialised without listening sockets.
+ * @param listen_sock The socket on which the accept thread will accept.
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int epoll_start_acceptor(epoll_server_private* priv, int listen_sock)
+{
+    priv->accept_queues = calloc(priv->num_reactors, sizeof(accept_queue_t));
+    if (priv->accept_queues == NULL)
+    {
+        perror("malloc accept queues");
+        return -1;
+    }
+    for (size_t i = 0; i < priv->num_reactors; ++i)
+    {
+        priv->accept_queues[i].event_fd = -1;
+    }
+
+    for (size_t i = 0; i < priv->num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &priv->reactors[i];
+        accept_queue_t* queue = &priv->accept_queues[i];
+        if (accept_queue_init(queue) == -1)
+        {
+            return -1;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &queue->event_fd;
+        if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, queue->event_fd, &event) == -1)
+        {
+            perror("epoll_ctl");
+            return -1;
+        }
+        reactor->accepts = queue;
+    }
+
+    return accept_thread_start(&priv->acceptor, listen_sock, priv->accept_queues, priv->num_reactors,
+                               (accept_policy_t)server_config.accept_policy);
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		epoll_server_start
+
+    Prototype:	static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Mat Siwoski
+
+    Created On: 2017-02-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - The number of handles to accept.
+
+    Return Values:
+	
+    Description:
+    This is the start of the epoll server. This will set up the connections and pass the data to another
+    function to handle the data.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Moved the event loop into epoll_reactor_run.
+	2026-10-17 - Shane Spoor - Accept on a dedicated thread if an accept policy is set.
+
+*********************************************************************************************/
+static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    epoll_server_private* priv = epoll_server_private_create(1, 0);
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return -1;
+    }
+
+    server->private = priv;
+    int accept_thread = server_config.accept_policy != ACCEPT_POLICY_NONE;
+    if (epoll_reactor_init(&priv->reactors[0], accept_thread ? -1 : acceptor->sock) == -1 ||
+        (accept_thread && epoll_start_acceptor(priv, acceptor->sock) == -1))
+    {
+        return -1;
+    }
+
+    return epoll_reactor_run(server, &priv->reactors[0]);
+}
+
+static void* epoll_worker_thread(void* void_worker)
+{
+    epoll_worker* worker = (epoll_worker*)void_worker;
+
+    // Keep each worker on its own core so that the connections it handles stay in that core's cache
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    if (epoll_reactor_run(worker->server, worker->reactor) == -1)
+    {
+        atomic_store(&done, 1);
+        return (void*)-1;
+    }
+    return NULL;
+}
+
+/**
+ * Runs every worker in the server's private data, using the calling thread for the first one, and waits for all of
+ * them to finish.
+ *
+ * @param server The server whose workers will be run.
+ * @return 0 on success, or -1 if any worker failed.
+ */
+static int epoll_run_workers(server_t* server)
+{
+    epoll_server_private* priv = (epoll_server_private*)server->private;
+
+    size_t started;
+    for (started = 1; started < priv->num_workers; ++started)
+    {
+        if (pthread_create(&priv->workers[started].thread, NULL, epoll_worker_thread, &priv->workers[started]) != 0)
+        {
+            perror("pthread_create");
+            atomic_store(&done, 1);
+            break;
+        }
+    }
+
+    int result = 0;
+    if (started == priv->num_workers)
+    {
+        result = epoll_worker_thread(&priv->workers[0]) == NULL ? 0 : -1;
+    }
+
+    // Whatever stopped this worker should stop the rest; the signal interrupts their epoll_wait
+    atomic_store(&done, 1);
+    for (size_t i = 1; i < started; ++i)
+    {
+        pthread_kill(priv->workers[i].thread, SIGINT);
+    }
+    for (size_t i = 1; i < started; ++i)
+    {
+        void* thread_result;
+        pthread_join(priv->workers[i].thread, &thread_result);
+        if (thread_result != NULL)
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Returns the number of event loop threads to start: server_config.reactors, or one per online CPU by default.
+ */
+static size_t epoll_thread_count(void)
+{
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return server_config.reactors ? server_config.reactors : (num_cpus > 0 ? (size_t)num_cpus : 1);
+}
+
+/**
+ * Sets up a worker and picks the core that it will run on.
+ */
+static void epoll_worker_init(epoll_worker* worker, server_t* server, epoll_reactor* reactor, size_t index)
+{
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    worker->server = server;
+    worker->reactor = reactor;
+    worker->cpu = num_cpus > 0 ? (unsigned int)(index % (size_t)num_cpus) : 0;
+}
 
-    struct timeval start;
-    gettimeofday(&start, NULL);
+/*********************************************************************************************
+FUNCTION
 
-    int result = 0;
-    int would_block = 0;
-    do
-    {
-        int which_message = request->transferred / (request->msg_size + sizeof(request->msg_size));
-        size_t offset = request->transferred % (request->msg_size + sizeof(request->msg_size));
+    Name:		epoll_reuseport_server_start
 
-        if (offset < sizeof(request->msg_size))
-        {
-            // We're reading a message size
-            unsigned char* raw = ((unsigned char*)&request->partial_msg_size) + offset;
-            size_t bytes_left = sizeof(request->partial_msg_size) - offset;
-            ssize_t bytes_read = read_data(sock, raw, bytes_left);
-            if (bytes_read == -1)
-            {
-                result = -1;
-                goto cleanup;
-            }
+    Prototype:	static int epoll_reuseport_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
-            {
-                request->msg_size = request->partial_msg_size;
-                if (request->msg_size == 0)
-                {
-                    // Client is finished sending data
-                    goto cleanup;
-                }
-                if (request->msg == NULL)
-                {
-                    request->msg = malloc(request->msg_size);
-                    if (!request->msg)
-                    {
-                        perror("malloc");
-                        result = -1;
-                        goto cleanup;
-                    }
-                }
-            }
-        }
-        else
-        {
-            // We're reading message content
-            offset -= sizeof(request->msg_size);
-            size_t bytes_left = request->msg_size - offset;
-            ssize_t bytes_read = read_data(sock, request->msg, bytes_left);
+    Developer:	Shane Spoor
 
-            if (bytes_read == -1)
-            {
-                result = -1;
-                goto cleanup;
-            }
+    Created On: 2026-10-17
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
-            {
-                // We've received a full message; echo back to the client
-                ssize_t bytes_sent;
-                size_t send_bytes_left = (ssize_t)request->msg_size;
-                do
-                {
-                    bytes_sent = send_data(sock, request->msg + (request->msg_size - send_bytes_left), send_bytes_left);
-                    send_bytes_left -= bytes_sent;
-                } while(bytes_sent != -1 && send_bytes_left > 0);
-                
-                if (bytes_sent == -1)
-                {
-                    result = -1;
-                    goto cleanup;
-                }
-            }
-        }
-    } while(!would_block && !atomic_load(&done));
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since each reactor accepts on its own listening socket.
 
-    {
-        struct timeval end;
-        gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
-    }
+    Return Values:
+    0 on success, -1 on failure.
 
-    return 0;
+    Description:
+    Starts one reactor per core (or server_config.reactors of them). The first reactor uses the
+    acceptor's socket and the others open their own in the same SO_REUSEPORT group, so the
+    kernel spreads new connections over the reactors and they never share any state.
 
-cleanup:
-    --private->connected_count;
+    Revisions:
+	2026-10-17 - Shane Spoor - With an accept policy set, the reactors share the accept thread's
+	                           listening socket instead of opening their own.
+
+*********************************************************************************************/
+static int epoll_reuseport_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
 
-    if (result == 0)
+    int accept_thread = server_config.accept_policy != ACCEPT_POLICY_NONE;
+    size_t num_reactors = epoll_thread_count();
+    epoll_server_private* priv = epoll_server_private_create(num_reactors, num_reactors);
+    if (priv == NULL)
     {
-        // Success, so write results to file
-        struct timeval end;
-        gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        perror("malloc priv");
+        return -1;
+    }
+    server->private = priv;
 
-        unsigned short src_port = ntohs(epoll_client->client.peer.sin_port);
-        char *addr = inet_ntoa(epoll_client->client.peer.sin_addr);
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request->transfer_time, request->transferred, addr, src_port);
-        log_msg(csv);
+    for (size_t i = 0; i < num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &priv->reactors[i];
+        epoll_worker_init(&priv->workers[i], server, reactor, i);
 
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-              request->transfer_time, request->transferred, addr, src_port);
-        printf("%s", pretty);
+        int listen_sock = accept_thread ? -1 : i == 0 ? acceptor->sock : open_listen_socket(acceptor);
+        if ((listen_sock == -1 && !accept_thread) || epoll_reactor_init(reactor, listen_sock) == -1)
+        {
+            priv->num_reactors = i + 1;
+            return -1;
+        }
     }
-    else
+    if (accept_thread && epoll_start_acceptor(priv, acceptor->sock) == -1)
     {
-        perror("oops!");
+        return -1;
     }
+    printf("Started %zu epoll reactors\n", num_reactors);
 
-    struct epoll_event ev;
-    epoll_ctl(private->epfd, EPOLL_CTL_DEL, sock, &ev);
-
-    close(sock);
-    free(request->msg);
-
-    // Reset everything for the next client
-    //FD_CLR(sock, &set->set);
-    request->msg = NULL;
-    request->msg_size = 0;
-    request->partial_msg_size = 0;
-    request->transferred = 0;
-    request->transfer_time = 0;
-    epoll_client->client.sock = -1;
-    return result;
+    return epoll_run_workers(server);
 }
 
 /*********************************************************************************************
 FUNCTION
 
-    Name:		epoll_server_start
+    Name:		epoll_mt_server_start
 
-    Prototype:	static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+    Prototype:	static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
 
-    Developer:	Mat Siwoski
+    Developer:	Shane Spoor
 
-    Created On: 2017-02-17
+    Created On: 2026-10-17
 
     Parameters:
     server - server struct with server data
     acceptor - acceptor struct with acceptor data
-    handles_accept - The number of handles to accept.
+    handles_accept - Set to 1, since the workers accept from the shared epoll set.
 
     Return Values:
-	
+    0 on success, -1 on failure.
+
     Description:
-    This is the start of the epoll server. This will set up the connections and pass the data to another
-    function to handle the data.
+    Starts several worker threads that all wait on one epoll set. Clients are registered with
+    EPOLLONESHOT and re-armed once handle_request is done with them, so a busy connection only
+    ever occupies one worker and every other worker stays free for the rest. The listener is
+    registered with EPOLLEXCLUSIVE; with a single epoll set each readiness change already wakes
+    only one waiter, and the flag keeps that true if the listener is ever added to more sets.
+    The workers always accept for themselves, since they share one reactor (and so would share
+    one accept queue, which only ever has one reader).
 
     Revisions:
 	(none)
 
 *********************************************************************************************/
-static int epoll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+static int epoll_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
 {
     *handles_accept = 1;
 
-    int epoll_ready = 0;
-    struct epoll_event event;
-    struct epoll_event events[NUM_EPOLL_EVENTS];
-    
-    epoll_server_private* priv = malloc(sizeof(epoll_server_private));
+    size_t num_workers = epoll_thread_count();
+    epoll_server_private* priv = epoll_server_private_create(1, num_workers);
     if (priv == NULL)
     {
         perror("malloc priv");
-        return -1;        
+        return -1;
     }
+    server->private = priv;
 
-    priv->connected_count = 0;
-
-    int result = vector_init(&priv->epoll_clients, sizeof(epoll_server_client), NUM_EPOLL_EVENTS);
-    if (result == -1)
+    epoll_reactor* reactor = &priv->reactors[0];
+    if (epoll_reactor_init(reactor, acceptor->sock) == -1)
     {
-        perror("malloc clients");
-        free(priv);
         return -1;
     }
 
-    // Set accept socket to non-blocking mode
-    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    // Swap the listener's registration for an exclusive one
+    struct epoll_event event;
+    reactor->listen_events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+    event.events = reactor->listen_events;
+    event.data.ptr = &reactor->listen_sock;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, acceptor->sock, &event) == -1 ||
+        epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, acceptor->sock, &event) == -1)
     {
-        perror("fnctl");
+        perror("epoll_ctl");
         return -1;
     }
 
-    server->private = priv;
+    reactor->client_events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    reactor->max_events = NUM_MT_EPOLL_EVENTS;
 
-    if ((priv->epfd = epoll_create(NUM_EPOLL_EVENTS)) == -1)
+    for (size_t i = 0; i < num_workers; ++i)
     {
-        perror("epoll_create");
+        epoll_worker_init(&priv->workers[i], server, reactor, i);
+    }
+    printf("Started %zu epoll workers\n", num_workers);
+
+    return epoll_run_workers(server);
+}
+
+/**
+ * Gives a reactor its completion queue and eventfd and points it at the handler pool.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int epoll_reactor_attach_pool(epoll_reactor* reactor, work_pool_t* pool)
+{
+    if (pthread_mutex_init(&reactor->completion_lock, NULL) != 0 ||
+        vector_init(&reactor->completions, sizeof(epoll_server_request*), 0) == -1 ||
+        vector_init(&reactor->completions_spare, sizeof(epoll_server_request*), 0) == -1)
+    {
+        perror("completion queue");
+        return -1;
+    }
+
+    if ((reactor->completion_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        perror("eventfd");
         return -1;
     }
-    event.events = EPOLLIN | EPOLLET | EPOLLHUP | EPOLLERR;
-    event.data.fd = acceptor->sock;
 
-    if (epoll_ctl(priv->epfd, EPOLL_CTL_ADD, acceptor->sock, &event) == -1)
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &reactor->completion_fd;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->completion_fd, &event) == -1)
     {
         perror("epoll_ctl");
         return -1;
     }
 
-    while (1)
+    reactor->pool = pool;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		epoll_pool_server_start
+
+    Prototype:	static int epoll_pool_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since each reactor accepts on its own listening socket.
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Starts server_config.reactors reactors (one by default) laid out like the reuseport
+    server, plus a work-stealing pool of server_config.handler_threads handlers (one per CPU by
+    default). The reactors only read, frame and send; complete messages are handled on the pool
+    so that slow handlers never hold up another connection's I/O.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Accept on a dedicated thread if an accept policy is set.
+
+*********************************************************************************************/
+static int epoll_pool_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_reactors = server_config.reactors ? server_config.reactors : 1;
+    size_t num_handlers = server_config.handler_threads ? server_config.handler_threads : (num_cpus > 0 ? (size_t)num_cpus : 1);
+    int accept_thread = server_config.accept_policy != ACCEPT_POLICY_NONE;
+
+    epoll_server_private* priv = epoll_server_private_create(num_reactors, num_reactors);
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return -1;
+    }
+    server->private = priv;
+
+    // Handlers inherit this mask, which leaves SIGINT to the reactor threads so that it interrupts their epoll_wait
+    sigset_t blocked, old_mask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old_mask);
+    int pool_result = work_pool_init(&priv->pool, num_handlers, NUM_MT_EPOLL_EVENTS);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    if (pool_result == -1)
     {
-        epoll_ready = epoll_wait(priv->epfd, events, NUM_EPOLL_EVENTS, 3000);
-        if (epoll_ready == -1)
-        {
-            perror("epoll_wait");
-            break;
-        }else if (epoll_ready == 0)
-        {
-            printf("timed out\n");
-            continue;
-        }
-        // printf("number of events ready: %d\n", epoll_ready);
-        int index;
-        int err = 0;
-        for (index = 0; index < epoll_ready && !atomic_load(&done); index++)
-        {
-            if (events[index].data.fd == acceptor->sock)
-            {
-                while(1)//for (size_t i = 0; i < ACCEPT_PER_ITER; ++i)
-                {
-                    client_t client;
-                    int accept_result = accept_client(acceptor, &client);
-                    if (accept_result == -1)
-                    {
-                        if (errno != EWOULDBLOCK && errno != EAGAIN)
-                        {
-                            err = 1;
-                        }
-                        break;
-                    }
-                    // if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
-                    // {
-                    //     perror("fnctl");
-                    //     return -1;
-                    // }
-                    if (server->add_client(server, client) == -1)
-                    {
-                        err = 1;
-                        break;
-                    }
-                    else
-                    {
-                        // printf("Added client\n");
-                    }
-                }
-            }
-            else
-            {
-                int request_result = handle_request(server, events[index].data.fd);
-                if (request_result == -1)
-                {
-                    err = 1;
-                    break;
-                }
-            }
-        }
-        if (err)
+        perror("work_pool_init");
+        return -1;
+    }
+    priv->has_pool = 1;
+    epoll_stats.handlers = num_handlers;
+
+    for (size_t i = 0; i < num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &priv->reactors[i];
+        epoll_worker_init(&priv->workers[i], server, reactor, i);
+
+        int listen_sock = accept_thread ? -1 : i == 0 ? acceptor->sock : open_listen_socket(acceptor);
+        if ((listen_sock == -1 && !accept_thread) || epoll_reactor_init(reactor, listen_sock) == -1 ||
+            epoll_reactor_attach_pool(reactor, &priv->pool) == -1)
         {
-            break;
+            priv->num_reactors = i + 1;
+            return -1;
         }
     }
+    if (accept_thread && epoll_start_acceptor(priv, acceptor->sock) == -1)
+    {
+        return -1;
+    }
+    printf("Started %zu epoll reactors with %zu handler threads\n", num_reactors, num_handlers);
 
-    return (errno && errno != EINTR) * -1;
+    return epoll_run_workers(server);
 }
 
-static int epoll_server_add_client(server_t* server, client_t client)
+static int epoll_reactor_add_client(server_t* server, epoll_reactor* reactor, client_t client)
 {
     struct epoll_event event;
     epoll_server_private* priv = (epoll_server_private*)server->private;
 
-    if (fcntl(client.sock, F_SETFL, O_NONBLOCK | fcntl(client.sock, F_GETFL, 0)) == -1)
+    // The table entries have to be filled in before the socket can produce any events
+    epoll_server_request* request = NULL;
+    client_stats_t* stats = NULL;
+    int admitted = admission_admit(client.sock, atomic_load(&priv->connected_count));
+    if (admitted)
     {
-        perror("fnctl");
-        return -1;
+        request = paged_table_slot(&reactor->conns, (size_t)client.sock);
+        stats = paged_table_slot(&reactor->stats, (size_t)client.sock);
+    }
+    if (request == NULL || stats == NULL)
+    {
+        if (admitted)
+        {
+            // Past the fd limit the tables were sized for (or out of memory), so turn this one client away
+            fprintf(stderr, "No connection table entry for socket %d; closing it\n", client.sock);
+            close(client.sock);
+        }
+        if (reactor->accepts)
+        {
+            atomic_fetch_sub(&reactor->accepts->connections, 1);
+        }
+        return 0;
+    }
+
+    memset(request, 0, sizeof(epoll_server_request));
+    request->sock = client.sock;
+    request->reactor = reactor;
+    frame_decoder_init(&request->input);
+    output_queue_init(&request->output);
+    splice_pipe_init(&request->splice);
+    zerocopy_init(&request->zerocopy);
+    request->events = reactor->client_events;
+
+    stats->peer = client.peer;
+    stats->transferred = 0;
+    stats->transfer_time = 0;
+
+    if (epoll_timeouts_enabled())
+    {
+        // A client that connects and never sends anything is idle from the start
+        epoll_timer_arm(reactor, request);
     }
 
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = client.sock;
-    if (epoll_ctl(priv->epfd, EPOLL_CTL_ADD, client.sock, &event) == -1)
+    event.events = reactor->client_events;
+    event.data.ptr = request;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, client.sock, &event) == -1)
     {
         perror("epoll_ctl");
         return -1;
     }
-    ++server->total_served;
-    ++priv->connected_count;
-    if (priv->connected_count > server->max_concurrent)
-    {
-        server->max_concurrent = priv->connected_count;
-    }    
+    atomic_fetch_add(&reactor->connected_count, 1);
+    server_client_added(server, atomic_fetch_add(&priv->connected_count, 1) + 1);
 
-    epoll_server_client* clients = (epoll_server_client*)priv->epoll_clients.items;
-    clients[client.sock].client = client;
     return 0;
 }
 
+static int epoll_server_add_client(server_t* server, client_t client)
+{
+    epoll_server_private* priv = (epoll_server_private*)server->private;
+    return epoll_reactor_add_client(server, &priv->reactors[0], client);
+}
+
 static void epoll_server_cleanup(server_t* epoll_server)
 {
     epoll_server_private* private = (epoll_server_private*)epoll_server->private;
-    vector_free(&private->epoll_clients);
+    if (private == NULL)
+    {
+        return;
+    }
+
+    // The accept thread and handlers hand clients to the reactors, so they have to be gone first
+    accept_thread_stop(&private->acceptor);
+    if (private->has_pool)
+    {
+        work_pool_destroy(&private->pool);
+        epoll_stats.executed = atomic_load(&private->pool.executed);
+        epoll_stats.stolen = atomic_load(&private->pool.stolen);
+    }
+
+    epoll_stats.table_bytes = epoll_table_bytes(private);
+    for (size_t i = 0; i < private->num_reactors; ++i)
+    {
+        epoll_reactor* reactor = &private->reactors[i];
+        if (reactor->completion_fd != -1)
+        {
+            close(reactor->completion_fd);
+            vector_free(&reactor->completions);
+            vector_free(&reactor->completions_spare);
+            pthread_mutex_destroy(&reactor->completion_lock);
+        }
+        paged_table_free(&reactor->conns);
+        paged_table_free(&reactor->stats);
+        zerocopy_parking_release(&reactor->parking);
+        if (reactor->ready.items)
+        {
+            vector_free(&reactor->ready);
+            pthread_mutex_destroy(&reactor->ready_lock);
+            pthread_mutex_destroy(&reactor->timer_lock);
+        }
+        if (reactor->epfd != -1)
+        {
+            close(reactor->epfd);
+        }
+        // Reactor 0 always uses the acceptor's socket, which serve() closes
+        if (i > 0 && reactor->listen_sock != -1)
+        {
+            close(reactor->listen_sock);
+        }
+    }
+    if (private->accept_queues)
+    {
+        for (size_t i = 0; i < private->num_reactors; ++i)
+        {
+            accept_queue_release(&private->accept_queues[i]);
+        }
+        free(private->accept_queues);
+    }
+    free(private->reactors);
+    free(private->workers);
     free(private);
-    close(private->epfd);
-}
\ No newline at end of file
+    epoll_server->private = NULL;
+}
+
+static int epoll_server_report(server_t* server, char* buf, size_t len)
+{
+    epoll_server_private* private = (epoll_server_private*)server->private;
+    size_t turns = atomic_load(&epoll_stats.turns);
+    int written = snprintf(buf, len, "Reactor turns: %zu; mean %zuus, max %zuus\n", turns,
+                           turns ? atomic_load(&epoll_stats.turn_ns) / turns / 1000 : 0,
+                           atomic_load(&epoll_stats.turn_ns_max) / 1000);
+    if (written > 0 && (size_t)written < len)
+    {
+        written += snprintf(buf + written, len - (size_t)written,
+                            "Read budget: %zu KiB / %u messages per turn; %zu deferrals\n",
+                            (server_config.read_budget ? server_config.read_budget : DEFAULT_READ_BUDGET) / 1024,
+                            server_config.message_budget ? server_config.message_budget : DEFAULT_MESSAGE_BUDGET,
+                            atomic_load(&epoll_stats.deferred));
+    }
+    if (epoll_timeouts_enabled() && written > 0 && (size_t)written < len)
+    {
+        written += snprintf(buf + written, len - (size_t)written,
+                            "Timeouts: %zu idle (%lums), %zu mid-frame (%lums), %zu send (%lums)\n",
+                            atomic_load(&epoll_stats.expired[EPOLL_TIMEOUT_IDLE]), server_config.client_idle_ms,
+                            atomic_load(&epoll_stats.expired[EPOLL_TIMEOUT_HEADER]), server_config.header_timeout_ms,
+                            atomic_load(&epoll_stats.expired[EPOLL_TIMEOUT_SEND]), server_config.send_timeout_ms);
+    }
+    if (epoll_stats.handlers && written > 0 && (size_t)written < len)
+    {
+        // The pool's own counters are only copied out once it has stopped
+        size_t executed = private ? atomic_load(&private->pool.executed) : epoll_stats.executed;
+        size_t stolen = private ? atomic_load(&private->pool.stolen) : epoll_stats.stolen;
+        written += snprintf(buf + written, len - (size_t)written,
+                            "Handler pool: %zu threads; %zu offloaded, %zu handled, %zu stolen; %zu completion wakeups\n",
+                            epoll_stats.handlers, atomic_load(&epoll_stats.offloaded), executed, stolen,
+                            atomic_load(&epoll_stats.wakeups));
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        size_t table_bytes = private ? epoll_table_bytes(private) : epoll_stats.table_bytes;
+        written += snprintf(buf + written, len - (size_t)written,
+                            "Connection tables: %zu KiB; %zu + %zu bytes per connection (budget %d)\n",
+                            table_bytes / 1024, sizeof(epoll_server_request), sizeof(client_stats_t),
+                            EPOLL_CONN_BUDGET);
+    }
+    if (server_config.accept_policy != ACCEPT_POLICY_NONE && written > 0 && (size_t)written < len)
+    {
+        written += accept_thread_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += echo_stats_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += frame_stats_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += output_queue_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += buffer_pool_report(buf + written, len - (size_t)written);
+    }
+    return written;
+}
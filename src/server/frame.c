@@ -0,0 +1,286 @@
+/*********************************************************************************************
+Name:			frame.c
+
+    Required:	frame.h
+                buffer_pool.h
+                zero_copy.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    Buffered decoding of the echo protocol's frames (a 4-byte message size followed by the
+    message body). Each connection reads into one input buffer with as large a recv as will
+    fit, and the servers handle every complete frame in it before going back to select or
+    epoll, instead of reading each header and body with separate calls.
+
+    Revisions:
+    2026-10-17 - Shane Spoor - A decoder with no buffer reads to the stack first, and
+                               frame_decoder_trim gives back an empty one, so that idle
+                               connections can go without.
+    2026-10-17 - Shane Spoor - Don't size the buffer for a body that's going to be spliced.
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "buffer_pool.h"
+#include "frame.h"
+#include "zero_copy.h"
+
+#define FRAME_BUFFER_SIZE 16384 // Smallest input buffer; bigger frames get a buffer that fits them whole
+#define FRAME_SCRATCH_SIZE 65536 // Stack space for reads into a decoder with no buffer, so mid-sized frames fit in one
+
+// Kept for the whole process so that they can be reported after the servers have cleaned up
+static struct
+{
+    atomic_size_t recvs;
+    atomic_size_t frames;
+    atomic_size_t trimmed; // Empty buffers given back by frame_decoder_trim
+} frame_stats;
+
+void frame_decoder_init(frame_decoder_t* dec)
+{
+    dec->buf = NULL;
+    dec->start = 0;
+    dec->end = 0;
+    dec->eof = 0;
+    dec->drained = 0;
+}
+
+/**
+ * Makes sure that the buffer has room for needed bytes from dec->start, moving the buffered bytes to the front of the
+ * buffer (or into a bigger one) if not.
+ *
+ * @return 0 on success, or -1 if a bigger buffer couldn't be allocated.
+ */
+static int frame_reserve(frame_decoder_t* dec, size_t needed)
+{
+    size_t buffered = dec->end - dec->start;
+    size_t capacity = dec->buf ? buffer_capacity(dec->buf) : 0;
+    if (dec->start + needed <= capacity)
+    {
+        return 0;
+    }
+
+    if (needed <= capacity)
+    {
+        memmove(dec->buf, dec->buf + dec->start, buffered);
+    }
+    else
+    {
+        char* bigger = buffer_alloc(needed < FRAME_BUFFER_SIZE ? FRAME_BUFFER_SIZE : needed);
+        if (!bigger)
+        {
+            return -1;
+        }
+        if (dec->buf)
+        {
+            memcpy(bigger, dec->buf + dec->start, buffered);
+            buffer_free(dec->buf);
+        }
+        dec->buf = bigger;
+    }
+    dec->start = 0;
+    dec->end = buffered;
+    return 0;
+}
+
+/**
+ * Receives up to space bytes into dst, retrying on EINTR and setting dec->eof and dec->drained as for frame_fill.
+ *
+ * @return The number of bytes received, 0 if there were none (or the peer has closed), or -1 on failure.
+ */
+static ssize_t frame_recv(int sock, frame_decoder_t* dec, char* dst, size_t space)
+{
+    ssize_t bytes_read;
+    do
+    {
+        bytes_read = recv(sock, dst, space, 0);
+    } while (bytes_read == -1 && errno == EINTR);
+    atomic_fetch_add_explicit(&frame_stats.recvs, 1, memory_order_relaxed);
+
+    if (bytes_read == -1)
+    {
+        dec->drained = 1;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (bytes_read == 0)
+    {
+        dec->eof = 1;
+        return 0;
+    }
+
+    // A short read on a stream socket means that it's been emptied, which saves the caller a recv just to get EAGAIN
+    dec->drained = (size_t)bytes_read < space;
+    return bytes_read;
+}
+
+/**
+ * Returns how big a buffer a frame of the given size wants: the whole frame, unless its body will be spliced, in which
+ * case only what arrives with the header is ever buffered.
+ */
+static size_t frame_wanted(uint32_t size)
+{
+    return splice_wanted(size) ? FRAME_BUFFER_SIZE : FRAME_HEADER_SIZE + (size_t)size;
+}
+
+/**
+ * Fills a decoder that has no buffer. The read goes to the stack first, so a buffer is only taken from the pool once
+ * there are bytes to keep, and it can be sized for the whole frame if they include the header.
+ */
+static ssize_t frame_fill_empty(int sock, frame_decoder_t* dec)
+{
+    char scratch[FRAME_SCRATCH_SIZE];
+    ssize_t bytes_read = frame_recv(sock, dec, scratch, sizeof(scratch));
+    if (bytes_read <= 0)
+    {
+        return bytes_read;
+    }
+
+    uint32_t size = 0;
+    if ((size_t)bytes_read >= FRAME_HEADER_SIZE)
+    {
+        memcpy(&size, scratch, FRAME_HEADER_SIZE);
+    }
+    size_t needed = frame_wanted(size);
+    needed = needed < (size_t)bytes_read ? (size_t)bytes_read : needed;
+    if ((dec->buf = buffer_alloc(needed < FRAME_BUFFER_SIZE ? FRAME_BUFFER_SIZE : needed)) == NULL)
+    {
+        perror("buffer_alloc");
+        return -1;
+    }
+
+    memcpy(dec->buf, scratch, (size_t)bytes_read);
+    dec->start = 0;
+    dec->end = (size_t)bytes_read;
+    return bytes_read;
+}
+
+ssize_t frame_fill(int sock, frame_decoder_t* dec)
+{
+    if (dec->buf == NULL)
+    {
+        return frame_fill_empty(sock, dec);
+    }
+    if (dec->start == dec->end)
+    {
+        dec->start = dec->end = 0;
+    }
+
+    // Leave room for the whole of the current frame if its size is known (and it won't be spliced), or at least a full
+    // buffer's worth otherwise
+    uint32_t size;
+    size_t needed = frame_header(dec, &size) ? frame_wanted(size) : FRAME_BUFFER_SIZE;
+    if (frame_reserve(dec, needed) == -1)
+    {
+        perror("buffer_alloc");
+        return -1;
+    }
+
+    size_t space = buffer_capacity(dec->buf) - dec->end;
+    if (space == 0)
+    {
+        return 0;
+    }
+
+    ssize_t bytes_read = frame_recv(sock, dec, dec->buf + dec->end, space);
+    if (bytes_read > 0)
+    {
+        dec->end += (size_t)bytes_read;
+    }
+    return bytes_read;
+}
+
+int frame_header(frame_decoder_t const* dec, uint32_t* size)
+{
+    if (dec->end - dec->start < FRAME_HEADER_SIZE)
+    {
+        return 0;
+    }
+    memcpy(size, dec->buf + dec->start, FRAME_HEADER_SIZE);
+    return 1;
+}
+
+size_t frame_body_buffered(frame_decoder_t const* dec)
+{
+    return dec->end - dec->start - FRAME_HEADER_SIZE;
+}
+
+char* frame_body(frame_decoder_t const* dec, uint32_t size)
+{
+    if (dec->end - dec->start < FRAME_HEADER_SIZE + (size_t)size)
+    {
+        return NULL;
+    }
+    return dec->buf + dec->start + FRAME_HEADER_SIZE;
+}
+
+void frame_consume(frame_decoder_t* dec, size_t len)
+{
+    atomic_fetch_add_explicit(&frame_stats.frames, 1, memory_order_relaxed);
+    dec->start += len;
+    if (dec->start == dec->end)
+    {
+        dec->start = dec->end = 0;
+    }
+}
+
+char* frame_detach(frame_decoder_t* dec, size_t len)
+{
+    size_t left = dec->end - dec->start - len;
+    char* replacement = buffer_alloc(left < FRAME_BUFFER_SIZE ? FRAME_BUFFER_SIZE : left);
+    if (!replacement)
+    {
+        return NULL;
+    }
+
+    memcpy(replacement, dec->buf + dec->start + len, left);
+    atomic_fetch_add_explicit(&frame_stats.frames, 1, memory_order_relaxed);
+
+    char* old = dec->buf;
+    dec->buf = replacement;
+    dec->start = 0;
+    dec->end = left;
+    return old;
+}
+
+size_t frame_consume_partial(frame_decoder_t* dec, uint32_t size, char const** body)
+{
+    size_t buffered = frame_body_buffered(dec);
+    size_t len = buffered < size ? buffered : size;
+    *body = dec->buf + dec->start + FRAME_HEADER_SIZE;
+    frame_consume(dec, FRAME_HEADER_SIZE + len);
+    return len;
+}
+
+void frame_decoder_trim(frame_decoder_t* dec)
+{
+    if (dec->buf && dec->start == dec->end)
+    {
+        buffer_free(dec->buf);
+        dec->buf = NULL;
+        dec->start = dec->end = 0;
+        atomic_fetch_add_explicit(&frame_stats.trimmed, 1, memory_order_relaxed);
+    }
+}
+
+void frame_decoder_release(frame_decoder_t* dec)
+{
+    buffer_free(dec->buf);
+    frame_decoder_init(dec);
+}
+
+int frame_stats_report(char* buf, size_t len)
+{
+    size_t recvs = atomic_load(&frame_stats.recvs);
+    size_t frames = atomic_load(&frame_stats.frames);
+    return snprintf(buf, len, "Frames: %zu decoded from %zu recv calls (%.2f recvs per frame); "
+                              "%zu idle input buffers returned\n",
+                    frames, recvs, frames ? (double)recvs / (double)frames : 0.0, atomic_load(&frame_stats.trimmed));
+}
@@ -23,7 +23,12 @@ Revisions:
 #include <sys/time.h>
 
 #include "log.h"
+#include "config.h"
+#include "accept_thread.h"
+#include "admission.h"
+#include "output_queue.h"
 #include "server.h"
+#include "socket_profile.h"
 
 #define DEFAULT_PORT 8005
 
@@ -52,13 +57,159 @@ Revisions:
 *********************************************************************************************/
 void print_usage(char const* name)
 {
-    printf("usage: %s [-h] [-p port]\n", name);
+    printf("usage: %s [-h] [-p port] [-s server] [-r reactors] [-m min] [-M max] [-i ms]\n", name);
+    printf("\t       [-k stack_kib] [-g guard_kib] [-w handlers] [-c cost]\n");
+    printf("\t       [-S splice_min] [-Z zerocopy_min] [-o out_kib] [-b budget_kib]\n");
+    printf("\t       [-B messages] [-a policy] [-P profile] [-R]\n");
+    printf("\t       [-I idle_ms] [-H header_ms] [-D send_ms] [-L limit] [-T target_us]\n");
     printf("\t-h, --help:          print this help message and exit.\n");
     printf("\t-p, --port [port]:   the port on which to listen for connections;\n");
     printf("\t                     default is %u.\n", DEFAULT_PORT);
     printf("\t-s, --server [name]: the server used to handle connections.\n");
-    printf("\t                     Valid values are thread, select, or epoll.");
-    printf("\t                     Default is epoll.");
+    printf("\t                     Valid values are thread, thread-lf, select, select-mt, poll,\n");
+    printf("\t                     epoll, epoll-mr, epoll-mt, epoll-pool, uring, or coro.\n");
+    printf("\t                     Default is epoll.\n");
+    printf("\t-r, --reactors [n]:  the number of event loop threads for epoll-mr,\n");
+    printf("\t                     epoll-mt and select-mt; default is one per online CPU.\n");
+    printf("\t                     epoll-pool defaults to one.\n");
+    printf("\t-w, --handlers [n]:  the number of epoll-pool handler threads;\n");
+    printf("\t                     default is one per online CPU.\n");
+    printf("\t-c, --handler-cost [n]:\n");
+    printf("\t                     checksum passes over each message to simulate\n");
+    printf("\t                     handler CPU work (epoll servers); default is 0.\n");
+    printf("\t-S, --splice-min [bytes]:\n");
+    printf("\t                     the epoll and select servers echo message bodies at\n");
+    printf("\t                     least this big with splice() instead of copying them;\n");
+    printf("\t                     default is to always copy.\n");
+    printf("\t-Z, --zerocopy-min [bytes]:\n");
+    printf("\t                     the epoll servers send echoes at least this big with\n");
+    printf("\t                     MSG_ZEROCOPY; default is to always copy.\n");
+    printf("\t-o, --out-high-water [KiB]:\n");
+    printf("\t                     the epoll and select servers stop reading from a client\n");
+    printf("\t                     with this much echo data waiting to be sent, until it\n");
+    printf("\t                     drains to half of that; default is %u.\n", DEFAULT_OUT_HIGH_WATER / 1024);
+    printf("\t-b, --read-budget [KiB]:\n");
+    printf("\t                     how much the epoll and select servers read from one\n");
+    printf("\t                     client before serving the others; default is %u.\n", DEFAULT_READ_BUDGET / 1024);
+    printf("\t-B, --message-budget [n]:\n");
+    printf("\t                     how many messages the epoll and select servers handle\n");
+    printf("\t                     for one client before serving the others; default is %u.\n", DEFAULT_MESSAGE_BUDGET);
+    printf("\t-a, --accept-policy [policy]:\n");
+    printf("\t                     accept on a dedicated thread and hand clients to the\n");
+    printf("\t                     epoll and select event loops round-robin (rr), by fewest\n");
+    printf("\t                     connections (least-conn) or by fewest bytes in flight\n");
+    printf("\t                     (least-bytes); default is for each loop to accept itself.\n");
+    printf("\t                     epoll-mt workers always accept for themselves, and\n");
+    printf("\t                     select-mt always has an accept thread (least-conn by default).\n");
+    printf("\t-P, --profile [name]:\n");
+    printf("\t                     socket options for the listening and accepted sockets:\n");
+    printf("\t                     latency, throughput or c10m. The settings in effect are\n");
+    printf("\t                     printed at startup. Default is a backlog of 256 and the\n");
+    printf("\t                     kernel's defaults for everything else.\n");
+    printf("\t-R, --release-idle:  the epoll and select servers give a connection's buffers\n");
+    printf("\t                     back to the pool whenever it has nothing buffered or\n");
+    printf("\t                     waiting to be sent, so that idle clients hold none.\n");
+    printf("\t-I, --client-idle [ms]:\n");
+    printf("\t                     the epoll servers close a client that has sent nothing\n");
+    printf("\t                     for this long between messages; default is never.\n");
+    printf("\t-H, --header-timeout [ms]:\n");
+    printf("\t                     the epoll servers close a client that stalls this long\n");
+    printf("\t                     partway through a message; default is never.\n");
+    printf("\t-D, --send-timeout [ms]:\n");
+    printf("\t                     the epoll servers close a client that has echoes waiting\n");
+    printf("\t                     and takes none of them for this long; default is never.\n");
+    printf("\t-L, --adaptive-limit [n]:\n");
+    printf("\t                     admit at most n clients at once to start with, then keep\n");
+    printf("\t                     moving the limit to where echo latency stays near its\n");
+    printf("\t                     baseline; clients past it are reset as they're accepted.\n");
+    printf("\t                     Default is to admit everyone.\n");
+    printf("\t-T, --latency-target [us]:\n");
+    printf("\t                     echo latency the adaptive limit never comes down for;\n");
+    printf("\t                     default is %u.\n", DEFAULT_ADMISSION_TARGET_US);
+    printf("\t-m, --pool-min [n]:  the number of worker threads the thread server\n");
+    printf("\t                     keeps even when idle; default is 200.\n");
+    printf("\t-M, --pool-max [n]:  the most worker threads the thread server will\n");
+    printf("\t                     start; clients queue once it is reached. Default is 4096.\n");
+    printf("\t-i, --idle-timeout [ms]:\n");
+    printf("\t                     how long a thread server worker above the minimum\n");
+    printf("\t                     waits for a client before exiting; default is 30000.\n");
+    printf("\t-k, --stack-size [KiB]:\n");
+    printf("\t                     the stack size of each thread server worker or coroutine;\n");
+    printf("\t                     default is the pthread default (usually 8 MiB) for\n");
+    printf("\t                     threads and 32 KiB for coroutines.\n");
+    printf("\t-g, --guard-size [KiB]:\n");
+    printf("\t                     the guard region below each worker's or coroutine's\n");
+    printf("\t                     stack; default is one page for threads and none for\n");
+    printf("\t                     coroutines.\n");
+}
+
+/**
+ * Parses a positive integer command line argument, exiting with a usage message if it isn't one.
+ *
+ * @param arg  The argument to parse.
+ * @param what A description of the argument for the error message.
+ * @param name The program name for the usage message.
+ * @return The parsed value.
+ */
+static unsigned int parse_uint_arg(char const* arg, char const* what, char const* name)
+{
+    unsigned int value;
+    int num_read = sscanf(arg, "%u", &value);
+    if (num_read != 1 || value == 0)
+    {
+        fprintf(stderr, "Invalid %s %s.\n", what, arg);
+        print_usage(name);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+/**
+ * Raises the open file limit as far as the kernel allows: to fs.nr_open if the process may raise its hard limit, or
+ * otherwise to the hard limit. Every connection needs an fd, so this is what caps the number of clients; the epoll
+ * servers size their connection tables from the result.
+ */
+static void raise_open_file_limit(void)
+{
+    struct rlimit open_file_limit;
+    if (getrlimit(RLIMIT_NOFILE, &open_file_limit) == -1)
+    {
+        perror("getrlimit");
+        return;
+    }
+
+    unsigned long nr_open = 0;
+    FILE* file = fopen("/proc/sys/fs/nr_open", "r");
+    if (file)
+    {
+        if (fscanf(file, "%lu", &nr_open) != 1)
+        {
+            nr_open = 0;
+        }
+        fclose(file);
+    }
+
+    struct rlimit wanted = open_file_limit;
+    if (nr_open > open_file_limit.rlim_max)
+    {
+        wanted.rlim_cur = wanted.rlim_max = (rlim_t)nr_open;
+    }
+    else
+    {
+        wanted.rlim_cur = open_file_limit.rlim_max;
+    }
+
+    // Raising the hard limit needs CAP_SYS_RESOURCE; without it, the soft limit can still go up to the hard one
+    if (setrlimit(RLIMIT_NOFILE, &wanted) == -1)
+    {
+        wanted.rlim_cur = wanted.rlim_max = open_file_limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &wanted) == -1)
+        {
+            perror("setrlimit");
+            wanted = open_file_limit;
+        }
+    }
+    printf("Open file limit: %lu\n", (unsigned long)wanted.rlim_cur);
 }
 
 /*********************************************************************************************
@@ -82,7 +233,8 @@ Description:
     Runs the different servers based off the users choice.
 
 Revisions:
-	(none)
+	2026-10-17 - Shane Spoor - Raise the open file limit as far as allowed instead of pinning it
+	                           at 131072, which failed wherever the hard limit was lower.
 
 *********************************************************************************************/
 int main(int argc, char** argv)
@@ -90,24 +242,37 @@ int main(int argc, char** argv)
     unsigned short port = DEFAULT_PORT;
     server_t* server = epoll_server;
 
-    char const* short_opts = "p:s:h";
+    char const* short_opts = "p:s:r:m:M:i:k:g:w:c:S:Z:o:b:B:a:P:RI:H:D:L:T:h";
     struct option long_opts[] =
     {
         {"port",   1, NULL, 'p'},
         {"server", 1, NULL, 's'},
+        {"reactors", 1, NULL, 'r'},
+        {"pool-min", 1, NULL, 'm'},
+        {"pool-max", 1, NULL, 'M'},
+        {"idle-timeout", 1, NULL, 'i'},
+        {"stack-size", 1, NULL, 'k'},
+        {"guard-size", 1, NULL, 'g'},
+        {"handlers", 1, NULL, 'w'},
+        {"handler-cost", 1, NULL, 'c'},
+        {"splice-min", 1, NULL, 'S'},
+        {"zerocopy-min", 1, NULL, 'Z'},
+        {"out-high-water", 1, NULL, 'o'},
+        {"read-budget", 1, NULL, 'b'},
+        {"message-budget", 1, NULL, 'B'},
+        {"accept-policy", 1, NULL, 'a'},
+        {"profile", 1, NULL, 'P'},
+        {"release-idle", 0, NULL, 'R'},
+        {"client-idle", 1, NULL, 'I'},
+        {"header-timeout", 1, NULL, 'H'},
+        {"send-timeout", 1, NULL, 'D'},
+        {"adaptive-limit", 1, NULL, 'L'},
+        {"latency-target", 1, NULL, 'T'},
         {"help",   0, NULL, 'h'},
         {0, 0, 0, 0},
     };
 
-    struct rlimit open_file_limit;
-    open_file_limit.rlim_cur = 131072;
-    open_file_limit.rlim_max = 131072;
-
-    if (setrlimit(RLIMIT_NOFILE, &open_file_limit) == -1)
-    {
-        perror("setrlimit");
-        exit(EXIT_FAILURE);
-    }
+    raise_open_file_limit();
 
     if (argc > 1)
     {
@@ -144,10 +309,42 @@ int main(int argc, char** argv)
                         server = select_server;
                         printf("select");
                     }
+                    else if (strcmp(optarg, "select-mt") == 0)
+                    {
+                        server = select_mt_server;
+                    }
+                    else if (strcmp(optarg, "poll") == 0)
+                    {
+                        server = poll_server;
+                    }
+                    else if (strcmp(optarg, "epoll-mr") == 0)
+                    {
+                        server = epoll_reuseport_server;
+                    }
+                    else if (strcmp(optarg, "epoll-mt") == 0)
+                    {
+                        server = epoll_mt_server;
+                    }
+                    else if (strcmp(optarg, "epoll-pool") == 0)
+                    {
+                        server = epoll_pool_server;
+                    }
+                    else if (strcmp(optarg, "uring") == 0)
+                    {
+                        server = uring_server;
+                    }
                     else if (strcmp(optarg, "thread") == 0)
                     {
                         server = thread_server;
                     }
+                    else if (strcmp(optarg, "thread-lf") == 0)
+                    {
+                        server = thread_lf_server;
+                    }
+                    else if (strcmp(optarg, "coro") == 0)
+                    {
+                        server = coro_server;
+                    }
                     else
                     {
                         fprintf(stderr, "Invalid server %s.\n", optarg);
@@ -156,6 +353,81 @@ int main(int argc, char** argv)
                     }
                 }
                 break;
+                case 'r':
+                    server_config.reactors = parse_uint_arg(optarg, "number of reactors", argv[0]);
+                break;
+                case 'm':
+                    server_config.pool_min = parse_uint_arg(optarg, "minimum pool size", argv[0]);
+                break;
+                case 'M':
+                    server_config.pool_max = parse_uint_arg(optarg, "maximum pool size", argv[0]);
+                break;
+                case 'i':
+                    server_config.idle_timeout_ms = parse_uint_arg(optarg, "idle timeout", argv[0]);
+                break;
+                case 'k':
+                    server_config.worker_stack_size = (size_t)parse_uint_arg(optarg, "stack size", argv[0]) * 1024;
+                break;
+                case 'g':
+                    server_config.worker_guard_size = (size_t)parse_uint_arg(optarg, "guard size", argv[0]) * 1024;
+                break;
+                case 'w':
+                    server_config.handler_threads = parse_uint_arg(optarg, "number of handlers", argv[0]);
+                break;
+                case 'c':
+                    server_config.handler_cost = parse_uint_arg(optarg, "handler cost", argv[0]);
+                break;
+                case 'S':
+                    server_config.splice_threshold = parse_uint_arg(optarg, "splice threshold", argv[0]);
+                break;
+                case 'Z':
+                    server_config.zerocopy_threshold = parse_uint_arg(optarg, "zero-copy threshold", argv[0]);
+                break;
+                case 'o':
+                    server_config.out_high_water = (size_t)parse_uint_arg(optarg, "output high-water mark", argv[0]) * 1024;
+                break;
+                case 'b':
+                    server_config.read_budget = (size_t)parse_uint_arg(optarg, "read budget", argv[0]) * 1024;
+                break;
+                case 'B':
+                    server_config.message_budget = parse_uint_arg(optarg, "message budget", argv[0]);
+                break;
+                case 'a':
+                    server_config.accept_policy = accept_policy_parse(optarg);
+                    if (server_config.accept_policy == ACCEPT_POLICY_NONE)
+                    {
+                        fprintf(stderr, "Invalid accept policy %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                break;
+                case 'P':
+                    if (socket_profile_find(optarg) == NULL)
+                    {
+                        fprintf(stderr, "Invalid socket profile %s.\n", optarg);
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    server_config.socket_profile = optarg;
+                break;
+                case 'R':
+                    server_config.release_idle = 1;
+                break;
+                case 'I':
+                    server_config.client_idle_ms = parse_uint_arg(optarg, "client idle timeout", argv[0]);
+                break;
+                case 'H':
+                    server_config.header_timeout_ms = parse_uint_arg(optarg, "header timeout", argv[0]);
+                break;
+                case 'D':
+                    server_config.send_timeout_ms = parse_uint_arg(optarg, "send timeout", argv[0]);
+                break;
+                case 'L':
+                    server_config.admission_limit = parse_uint_arg(optarg, "adaptive limit", argv[0]);
+                break;
+                case 'T':
+                    server_config.admission_target_us = parse_uint_arg(optarg, "latency target", argv[0]);
+                break;
                 case 'h':
                     print_usage(argv[0]);
                     exit(EXIT_SUCCESS);
@@ -190,7 +462,9 @@ int main(int argc, char** argv)
     {
         perror("close");
     }
-    fprintf(stderr, "Total served: %lu; Max concurrent connections: %lu\n", server->total_served, server->max_concurrent);
+    char summary[2048];
+    server_summary(server, summary, sizeof(summary));
+    fputs(summary, stderr);
     fflush(stderr);
 
     return ret;
@@ -0,0 +1,239 @@
+/*********************************************************************************************
+Name:			output_queue.c
+
+    Required:	output_queue.h
+                buffer_pool.h
+                config.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    Per-connection output queues for the epoll and select servers. Echoes are copied into
+    pooled chunks and sent with one vectored sendmsg for as many chunks as are queued;
+    whatever the socket won't take stays queued until it's writable again, and a connection
+    whose queue grows past the high-water mark stops being read until it drains.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "buffer_pool.h"
+#include "config.h"
+#include "output_queue.h"
+
+#define OUTPUT_CHUNK_SIZE 16384
+#define OUTPUT_IOV_MAX    64
+
+typedef struct
+{
+    char* buf;    // From the buffer pool
+    size_t start; // First byte not yet sent
+    size_t end;   // One past the last byte queued
+} output_chunk_t;
+
+// Kept for the whole process so that they can be reported after the servers have cleaned up
+static struct
+{
+    atomic_size_t sends;
+    atomic_size_t bytes;
+    atomic_size_t appends;
+    atomic_size_t peak;
+    atomic_size_t throttles;
+} output_stats;
+
+void output_queue_init(output_queue_t* queue)
+{
+    queue->chunks.items = NULL;
+    queue->chunks.size = 0;
+    queue->head = 0;
+    queue->pending = 0;
+    queue->throttled = 0;
+}
+
+int output_queue_append(output_queue_t* queue, void const* data, size_t len)
+{
+    if (queue->chunks.items == NULL && vector_init(&queue->chunks, sizeof(output_chunk_t), 4) == -1)
+    {
+        queue->chunks.items = NULL;
+        return -1;
+    }
+
+    char const* bytes = (char const*)data;
+    while (len > 0)
+    {
+        output_chunk_t* chunks = (output_chunk_t*)queue->chunks.items;
+        output_chunk_t* tail = queue->chunks.size > queue->head ? &chunks[queue->chunks.size - 1] : NULL;
+        size_t space = tail ? buffer_capacity(tail->buf) - tail->end : 0;
+        if (space == 0)
+        {
+            output_chunk_t chunk = {buffer_alloc(len > OUTPUT_CHUNK_SIZE ? len : OUTPUT_CHUNK_SIZE), 0, 0};
+            if (!chunk.buf)
+            {
+                return -1;
+            }
+            if (vector_push_back(&queue->chunks, &chunk) == -1)
+            {
+                buffer_free(chunk.buf);
+                return -1;
+            }
+            continue;
+        }
+
+        size_t copied = len < space ? len : space;
+        memcpy(tail->buf + tail->end, bytes, copied);
+        tail->end += copied;
+        queue->pending += copied;
+        bytes += copied;
+        len -= copied;
+    }
+
+    atomic_fetch_add_explicit(&output_stats.appends, 1, memory_order_relaxed);
+    size_t peak = atomic_load_explicit(&output_stats.peak, memory_order_relaxed);
+    while (queue->pending > peak &&
+           !atomic_compare_exchange_weak_explicit(&output_stats.peak, &peak, queue->pending, memory_order_relaxed,
+                                                  memory_order_relaxed));
+    return 0;
+}
+
+/**
+ * Frees the chunks that sendmsg has finished with and advances past the bytes it sent from a partly sent one.
+ */
+static void output_queue_advance(output_queue_t* queue, size_t sent)
+{
+    output_chunk_t* chunks = (output_chunk_t*)queue->chunks.items;
+    queue->pending -= sent;
+    while (sent > 0)
+    {
+        output_chunk_t* chunk = &chunks[queue->head];
+        size_t queued = chunk->end - chunk->start;
+        if (sent < queued)
+        {
+            chunk->start += sent;
+            break;
+        }
+        buffer_free(chunk->buf);
+        ++queue->head;
+        sent -= queued;
+    }
+
+    if (queue->head == queue->chunks.size)
+    {
+        queue->head = 0;
+        queue->chunks.size = 0;
+    }
+    else if (queue->head > queue->chunks.size / 2)
+    {
+        // Keep the sent chunks from piling up at the front of a queue that never quite empties
+        memmove(chunks, chunks + queue->head, (queue->chunks.size - queue->head) * sizeof(output_chunk_t));
+        queue->chunks.size -= queue->head;
+        queue->head = 0;
+    }
+}
+
+ssize_t output_queue_flush(int sock, output_queue_t* queue)
+{
+    size_t sent_total = 0;
+    while (queue->pending > 0)
+    {
+        output_chunk_t* chunks = (output_chunk_t*)queue->chunks.items;
+        struct iovec iov[OUTPUT_IOV_MAX];
+        size_t count = 0;
+        size_t batch = 0;
+        for (size_t i = queue->head; i < queue->chunks.size && count < OUTPUT_IOV_MAX; ++i, ++count)
+        {
+            iov[count].iov_base = chunks[i].buf + chunks[i].start;
+            iov[count].iov_len = chunks[i].end - chunks[i].start;
+            batch += iov[count].iov_len;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t bytes_sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        atomic_fetch_add_explicit(&output_stats.sends, 1, memory_order_relaxed);
+        if (bytes_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return -1;
+        }
+
+        output_queue_advance(queue, (size_t)bytes_sent);
+        sent_total += (size_t)bytes_sent;
+        if ((size_t)bytes_sent < batch)
+        {
+            // The socket buffer is full; the rest waits for the socket to become writable
+            break;
+        }
+    }
+
+    atomic_fetch_add_explicit(&output_stats.bytes, sent_total, memory_order_relaxed);
+    return (ssize_t)sent_total;
+}
+
+int output_queue_throttled(output_queue_t* queue, size_t held)
+{
+    size_t high_water = server_config.out_high_water ? server_config.out_high_water : DEFAULT_OUT_HIGH_WATER;
+    size_t pending = queue->pending + held;
+    if (!queue->throttled && pending >= high_water)
+    {
+        queue->throttled = 1;
+        atomic_fetch_add_explicit(&output_stats.throttles, 1, memory_order_relaxed);
+    }
+    else if (queue->throttled && pending <= high_water / 2)
+    {
+        queue->throttled = 0;
+    }
+    return queue->throttled;
+}
+
+void output_queue_trim(output_queue_t* queue)
+{
+    // Sent chunks are freed as they go, so an empty queue only holds the list itself
+    if (queue->chunks.items && queue->pending == 0)
+    {
+        vector_free(&queue->chunks);
+        output_queue_init(queue);
+    }
+}
+
+void output_queue_release(output_queue_t* queue)
+{
+    if (queue->chunks.items)
+    {
+        output_chunk_t* chunks = (output_chunk_t*)queue->chunks.items;
+        for (size_t i = queue->head; i < queue->chunks.size; ++i)
+        {
+            buffer_free(chunks[i].buf);
+        }
+        vector_free(&queue->chunks);
+    }
+    output_queue_init(queue);
+}
+
+int output_queue_report(char* buf, size_t len)
+{
+    size_t sends = atomic_load(&output_stats.sends);
+    size_t appends = atomic_load(&output_stats.appends);
+    return snprintf(buf, len, "Output: %zu echoes queued, %zu bytes sent in %zu sendmsg calls (%.2f echoes per call); "
+                              "peak queue %zu KiB; reading throttled %zu times\n",
+                    appends, atomic_load(&output_stats.bytes), sends, sends ? (double)appends / (double)sends : 0.0,
+                    atomic_load(&output_stats.peak) / 1024, atomic_load(&output_stats.throttles));
+}
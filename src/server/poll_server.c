@@ -0,0 +1,367 @@
+/*********************************************************************************************
+Name:			poll_server.c
+
+    Required:	acceptor.h
+                admission.h
+                config.h
+                done.h
+                server.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    This is the poll server. It serves clients with the same echo routine as the select
+    server (echo.c), but waits on them with poll over a dense pollfd array: the listener is
+    always the first entry and the clients are packed after it, and a client that disconnects
+    is removed by moving the last entry into its place. Each entry has a matching entry in a
+    parallel array of request state. The arrays grow as clients arrive, so there's no limit
+    on fds besides the process's own, and each poll call costs time in proportion to the
+    clients connected rather than to the highest fd.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "config.h"
+#include "done.h"
+#include "acceptor.h"
+#include "admission.h"
+#include "echo.h"
+#include "frame.h"
+#include "output_queue.h"
+#include "protocol.h"
+#include "server.h"
+#include "zero_copy.h"
+
+#define POLL_MIN_ENTRIES   1024 // Entries the arrays start with; they double as clients arrive
+#define POLL_ACCEPT_BATCH  64
+#define POLL_TIMEOUT_MS    1000
+
+static int poll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int poll_server_add_client(server_t* server, client_t client);
+static void poll_server_cleanup(server_t* server);
+static int poll_server_report(server_t* server, char* buf, size_t len);
+
+static server_t poll_server_impl =
+{
+    poll_server_start,
+    poll_server_add_client,
+    poll_server_cleanup,
+    0,
+    0,
+    NULL,
+    poll_server_report
+};
+
+server_t* poll_server = &poll_server_impl;
+
+typedef struct
+{
+    client_t client;
+    echo_conn_t conn;
+} poll_server_request;
+
+typedef struct
+{
+    struct pollfd* fds;             // fds[0] is the listener; the clients are packed after it
+    poll_server_request* requests;  // requests[i] is the state for fds[i]; requests[0] is unused
+    size_t count;                   // Entries in use, including the listener
+    size_t capacity;
+    int listen_sock;
+    accept_pause_t pause;           // Set while the listener isn't polled for want of fds
+} poll_server_private;
+
+/**
+ * Returns the events to poll a client for: input unless it's throttled for not keeping up with its echoes, and output
+ * only while it has echoes waiting.
+ */
+static short poll_client_events(echo_conn_t const* conn)
+{
+    return (short)((echo_conn_wants_read(conn) ? POLLIN : 0) | (echo_conn_wants_write(conn) ? POLLOUT : 0));
+}
+
+/**
+ * Handles a client request on the given entry with echo_conn_serve, and closes the client once it's finished or if it
+ * fails; either way only that client is affected.
+ *
+ * @param private The server's private data.
+ * @param index   The client's entry in the pollfd and request arrays.
+ * @return 0 if the client is still connected, or 1 if its socket has been closed (its entry still has to be removed).
+ */
+static int handle_request(poll_server_private* private, size_t index)
+{
+    poll_server_request* request = &private->requests[index];
+    int sock = private->fds[index].fd;
+
+    int result = echo_conn_serve(sock, &request->conn);
+    if (result == ECHO_OPEN)
+    {
+        private->fds[index].events = poll_client_events(&request->conn);
+        return 0;
+    }
+
+    echo_conn_close(sock, &request->conn, result, &request->client.peer);
+    return 1;
+}
+
+/**
+ * Removes a closed client's entry by moving the last entry into its place, so the array stays dense. The moved entry
+ * keeps its revents, so a caller walking the array should look at the same index again.
+ */
+static void poll_remove(poll_server_private* private, size_t index)
+{
+    size_t last = --private->count;
+    if (index != last)
+    {
+        private->fds[index] = private->fds[last];
+        private->requests[index] = private->requests[last];
+    }
+}
+
+/**
+ * Makes room for one more entry, doubling the arrays if they're full.
+ *
+ * @return 0 on success, or -1 if the arrays couldn't be grown.
+ */
+static int poll_reserve(poll_server_private* private)
+{
+    if (private->count < private->capacity)
+    {
+        return 0;
+    }
+
+    size_t capacity = private->capacity ? private->capacity * 2 : POLL_MIN_ENTRIES;
+    struct pollfd* fds = realloc(private->fds, capacity * sizeof(struct pollfd));
+    if (fds == NULL)
+    {
+        return -1;
+    }
+    private->fds = fds;
+    poll_server_request* requests = realloc(private->requests, capacity * sizeof(poll_server_request));
+    if (requests == NULL)
+    {
+        return -1;
+    }
+    private->requests = requests;
+    private->capacity = capacity;
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		poll_server_start
+
+    Prototype:	static int poll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since the event loop accepts for itself.
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Runs the poll event loop. Each pass serves the clients poll reported, removing the ones
+    that finished as it goes, and then accepts new clients onto the end of the array, so that
+    they're first polled on the next pass.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+static int poll_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    // Set accept socket to non-blocking mode
+    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    {
+        perror("fnctl");
+        return -1;
+    }
+
+    poll_server_private* private = calloc(1, sizeof(poll_server_private));
+    if (private == NULL)
+    {
+        perror("malloc priv");
+        return -1;
+    }
+    server->private = private;
+    atomic_store(&private->pause.paused, 0);
+    private->listen_sock = acceptor->sock;
+
+    if (poll_reserve(private) == -1)
+    {
+        perror("malloc pollfds");
+        return -1;
+    }
+    private->fds[0].fd = acceptor->sock;
+    private->fds[0].events = POLLIN;
+    private->fds[0].revents = 0;
+    private->count = 1;
+
+    while (!atomic_load(&done))
+    {
+        if (accept_pause_over(&private->pause, private->count - 1))
+        {
+            private->fds[0].events = POLLIN;
+        }
+
+        int pause_ms = accept_pause_wait_ms(&private->pause);
+        int num_ready = poll(private->fds, (nfds_t)private->count, pause_ms == -1 ? POLL_TIMEOUT_MS : pause_ms);
+        if (num_ready == -1)
+        {
+            if (errno != EINTR)
+            {
+                perror("poll");
+                return -1;
+            }
+            break;
+        }
+        else if (num_ready == 0)
+        {
+            continue;
+        }
+
+        struct timespec pass_start;
+        clock_gettime(CLOCK_MONOTONIC, &pass_start);
+
+        size_t i = 1;
+        while (i < private->count && !atomic_load(&done))
+        {
+            if (private->fds[i].revents == 0)
+            {
+                ++i;
+                continue;
+            }
+
+            if (handle_request(private, i) == 1)
+            {
+                // The last entry takes this one's place and still has to be looked at
+                poll_remove(private, i);
+                continue;
+            }
+            ++i;
+        }
+
+        if (private->fds[0].revents & POLLIN)
+        {
+            client_t clients[POLL_ACCEPT_BATCH];
+            int accepted;
+            do
+            {
+                accepted = accept_clients(private->listen_sock, clients, POLL_ACCEPT_BATCH);
+                for (int j = 0; j < accepted; ++j)
+                {
+                    if (server->add_client(server, clients[j]) == -1)
+                    {
+                        return -1;
+                    }
+                }
+            } while (accepted == POLL_ACCEPT_BATCH);
+
+            if (accepted == ACCEPT_EXHAUSTED && accept_pause_start(&private->pause, private->count - 1))
+            {
+                private->fds[0].events = 0;
+            }
+        }
+
+        // The last client served in a pass waited for all of it, so that's the latency queueing adds
+        struct timespec pass_end;
+        clock_gettime(CLOCK_MONOTONIC, &pass_end);
+        admission_sample((uint64_t)((pass_end.tv_sec - pass_start.tv_sec) * 1000000000L +
+                                    (pass_end.tv_nsec - pass_start.tv_nsec)), private->count - 1);
+    }
+
+    return 0;
+}
+
+static int poll_server_add_client(server_t* server, client_t client)
+{
+    poll_server_private* private = (poll_server_private*)server->private;
+
+    if (!admission_admit(client.sock, private->count - 1))
+    {
+        return 0;
+    }
+
+    if (poll_reserve(private) == -1)
+    {
+        fprintf(stderr, "No room to poll socket %d; closing it\n", client.sock);
+        close(client.sock);
+        return 0;
+    }
+
+    size_t index = private->count++;
+    server_client_added(server, private->count - 1);
+
+    private->fds[index].fd = client.sock;
+    private->fds[index].events = POLLIN;
+    private->fds[index].revents = 0;
+
+    poll_server_request* request = &private->requests[index];
+    request->client = client;
+    echo_conn_init(&request->conn);
+
+    return 0;
+}
+
+static void poll_server_cleanup(server_t* server)
+{
+    poll_server_private* private = (poll_server_private*)server->private;
+    if (private == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 1; i < private->count; ++i)
+    {
+        close(private->fds[i].fd);
+        echo_conn_release(&private->requests[i].conn);
+    }
+    free(private->fds);
+    free(private->requests);
+    free(private);
+    server->private = NULL;
+}
+
+static int poll_server_report(server_t* server, char* buf, size_t len)
+{
+    (void)server;
+
+    int written = echo_stats_report(buf, len);
+    if (written > 0 && (size_t)written < len)
+    {
+        written += frame_stats_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += output_queue_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += buffer_pool_report(buf + written, len - (size_t)written);
+    }
+    return written;
+}
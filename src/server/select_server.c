@@ -2,7 +2,10 @@
 // Created by shane on 2/13/17.
 //
 
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
@@ -14,353 +17,712 @@
 #include <sys/select.h>
 #include <unistd.h>
 #include <sys/time.h>
-#include <arpa/inet.h>
+#include <time.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <client.h>
 
-#include "log.h"
-#include "timing.h"
+#include "buffer_pool.h"
+#include "config.h"
 #include "done.h"
 #include "acceptor.h"
+#include "accept_thread.h"
+#include "admission.h"
+#include "echo.h"
+#include "frame.h"
+#include "output_queue.h"
 #include "protocol.h"
 #include "server.h"
+#include "zero_copy.h"
 
 #define EXT_FD_SETSIZE 65536
+#define EXT_FD_WORDS   (EXT_FD_SETSIZE / 64)
 typedef struct
 {
-    long __fds_bits[EXT_FD_SETSIZE / 8 / sizeof(long)];
+    uint64_t words[EXT_FD_WORDS]; // Same layout as an fd_set (on a little-endian machine), just bigger
 } ext_fd_set;
 
+// glibc's FD_ macros check against FD_SETSIZE when fortified, so the big sets get their own
+#define EXT_FD_SET(fd, set)   ((set)->words[(fd) / 64] |= (uint64_t)1 << ((fd) % 64))
+#define EXT_FD_CLR(fd, set)   ((set)->words[(fd) / 64] &= ~((uint64_t)1 << ((fd) % 64)))
+#define EXT_FD_ISSET(fd, set) (((set)->words[(fd) / 64] >> ((fd) % 64)) & 1)
+
+#define SELECT_MIN_CLIENTS 1024 // Slots the client arrays start with; they double as higher fds turn up
+
 #define ACCEPT_PER_ITER 50
-#define BYTES_PER_ITER  2048
 
 static int select_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int select_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
 static int select_server_add_client(server_t* server, client_t client);
 static void select_server_cleanup(server_t* server);
+static int select_server_report(server_t* server, char* buf, size_t len);
 
 typedef struct
 {
-    ssize_t transferred;
-    time_t transfer_time;
-    uint32_t partial_msg_size; // :(
-    uint32_t msg_size;
-    char* msg;
+    echo_conn_t conn;
+    size_t reported_bytes; // Input and output bytes last counted in the accept queue's load
 } select_server_request;
 
 typedef struct
 {
-    ext_fd_set set;
+    // Kept up to date as clients come and go and their state changes, and copied for each select call
+    ext_fd_set read_master;
+    ext_fd_set write_master; // Only clients with output waiting
+    ext_fd_set read_ready;
+    ext_fd_set write_ready;
     int max_fd;
-    client_t clients[FD_SETSIZE];
-    select_server_request requests[FD_SETSIZE];
+
+    // Indexed by socket, and grown as higher fds turn up
+    client_t* clients;
+    select_server_request* requests;
+    size_t capacity;
     size_t connected_count;
+    atomic_size_t* connected; // Clients across every set, for the summary and admission control
+
+    server_t* server;
+    pthread_t thread;
+    int listen_sock;         // Accepted on directly when there's no accept thread
+    int accept_fd;           // Watched for new clients: the listening socket, or the accept queue's eventfd
+    accept_queue_t* accepts; // This set's queue from the accept thread, or NULL without one
+    accept_pause_t pause;    // Set while the listener is left out of the read set for want of fds
 } select_server_client_set;
 
 /**
- * Handles a client request on the given socket.
+ * One client set per event loop thread. With several, each thread only ever selects on its own clients, and the
+ * accept thread decides which set each new client goes to.
+ */
+typedef struct
+{
+    select_server_client_set* sets;
+    size_t num_sets;
+    accept_thread_t acceptor;
+    accept_queue_t* accepts; // One per set while there's an accept thread
+    atomic_size_t connected;
+} select_server_private;
+
+/**
+ * Handles a client request on the given socket with echo_conn_serve, and closes the client once it's finished or if
+ * it fails; either way only that client is affected.
  *
  * @param set  The client set for this server, which contains the list of clients and requests.
  * @param sock The socket for the given client.
- * @return 0 on success, or -1 on failure.
  */
-static int handle_request(server_t* server, int sock)
+static void handle_request(select_server_client_set* set, int sock)
 {
-    // TODO: Try to remove some of the return paths
-    select_server_client_set* set = (select_server_client_set*)server->private;
-
-    int index = sock; // To make things a bit less confusing
-    select_server_request* request = set->requests + index;
-
-    struct timeval start;
-    gettimeofday(&start, NULL);
-
-    int result = 0;
-    int would_block = 0;
-    do
+    select_server_request* request = set->requests + sock;
+    int result = echo_conn_serve(sock, &request->conn);
+    if (result == ECHO_OPEN)
     {
-        int which_message = request->transferred / (request->msg_size + sizeof(request->msg_size));
-        size_t offset = request->transferred % (request->msg_size + sizeof(request->msg_size));
-
-        if (offset < sizeof(request->msg_size))
+        if (set->accepts)
         {
-            // We're reading a message size
-            unsigned char* raw = ((unsigned char*)&request->partial_msg_size) + offset;
-            size_t bytes_left = sizeof(request->partial_msg_size) - offset;
-            ssize_t bytes_read = read_data(sock, raw, bytes_left);
-            if (bytes_read == -1)
-            {
-                result = -1;
-                goto cleanup;
-            }
-
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
-            {
-                request->msg_size = request->partial_msg_size;
-                if (request->msg_size == 0)
-                {
-                    // Client is finished sending data
-                    goto cleanup;
-                }
-                if (request->msg == NULL)
-                {
-                    request->msg = malloc(request->msg_size);
-                    if (!request->msg)
-                    {
-                        perror("malloc");
-                        result = -1;
-                        goto cleanup;
-                    }
-                }
-            }
+            size_t in_flight = echo_conn_in_flight(&request->conn);
+            atomic_fetch_add_explicit(&set->accepts->bytes_in_flight, in_flight - request->reported_bytes,
+                                      memory_order_relaxed);
+            request->reported_bytes = in_flight;
         }
-        else
-        {
-            // We're reading message content
-            offset -= sizeof(request->msg_size);
-            size_t bytes_left = request->msg_size - offset;
-            ssize_t bytes_read = read_data(sock, request->msg, bytes_left);
+        return;
+    }
 
-            if (bytes_read == -1)
-            {
-                result = -1;
-                goto cleanup;
-            }
+    --set->connected_count;
+    atomic_fetch_sub(set->connected, 1);
+    if (set->accepts)
+    {
+        atomic_fetch_sub(&set->accepts->connections, 1);
+        atomic_fetch_sub(&set->accepts->bytes_in_flight, request->reported_bytes);
+        request->reported_bytes = 0;
+    }
 
-            request->transferred += bytes_read;
-            if (bytes_read < bytes_left)
-            {
-                would_block = 1;
-            }
-            else
-            {
-                // We've received a full message; echo back to the client
-                ssize_t bytes_sent;
-                size_t send_bytes_left = (ssize_t)request->msg_size;
-                do
-                {
-                    bytes_sent = send_data(sock, request->msg + (request->msg_size - send_bytes_left), send_bytes_left);
-                    send_bytes_left -= bytes_sent;
-                } while(bytes_sent != -1 && send_bytes_left > 0);
-                
-                if (bytes_sent == -1)
-                {
-                    result = -1;
-                    goto cleanup;
-                }
-            }
-        }
-    } while(!would_block && !atomic_load(&done));
+    echo_conn_close(sock, &request->conn, result, &set->clients[sock].peer);
+    set->clients[sock].sock = -1;
+}
 
+/**
+ * Brings a client's bits in the master sets up to date after it's been added or served. It's read unless it's
+ * throttled for not keeping up with its echoes, and only watched for writing while it has echoes waiting; once it's
+ * closed it's in neither, and max_fd comes down past any closed fds at the top.
+ */
+static void select_update_watch(select_server_client_set* set, int sock)
+{
+    if (set->clients[sock].sock == -1)
     {
-        struct timeval end;
-        gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        EXT_FD_CLR(sock, &set->read_master);
+        EXT_FD_CLR(sock, &set->write_master);
+        while (set->max_fd > set->accept_fd && set->clients[set->max_fd].sock == -1)
+        {
+            --set->max_fd;
+        }
+        return;
     }
 
-    return 0;
+    echo_conn_t const* conn = &set->requests[sock].conn;
+    if (echo_conn_wants_read(conn))
+    {
+        EXT_FD_SET(sock, &set->read_master);
+    }
+    else
+    {
+        EXT_FD_CLR(sock, &set->read_master);
+    }
+    if (echo_conn_wants_write(conn))
+    {
+        EXT_FD_SET(sock, &set->write_master);
+    }
+    else
+    {
+        EXT_FD_CLR(sock, &set->write_master);
+    }
+}
 
-cleanup:
-    --set->connected_count;
-    if (result == 0)
+/**
+ * Grows the client arrays, if need be, to take the given socket.
+ *
+ * @return 0 on success, or -1 if the socket is past EXT_FD_SETSIZE or the arrays couldn't be grown.
+ */
+static int select_reserve(select_server_client_set* set, int sock)
+{
+    if ((size_t)sock < set->capacity)
+    {
+        return 0;
+    }
+    if (sock >= EXT_FD_SETSIZE)
     {
-        // Success, so write results to file
-        struct timeval end;
-        gettimeofday(&end, NULL);
-        request->transfer_time += TIME_DIFF(start, end);
+        return -1;
+    }
 
-        unsigned short src_port = ntohs(set->clients[index].peer.sin_port);
-        char *addr = inet_ntoa(set->clients[index].peer.sin_addr);
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request->transfer_time, request->transferred, addr, src_port);
-        log_msg(csv);
+    size_t capacity = set->capacity ? set->capacity : SELECT_MIN_CLIENTS;
+    while (capacity <= (size_t)sock)
+    {
+        capacity *= 2;
+    }
+    capacity = capacity > EXT_FD_SETSIZE ? EXT_FD_SETSIZE : capacity;
 
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-                 request->transfer_time, request->transferred, addr, src_port);
-        printf("%s", pretty);
+    client_t* clients = realloc(set->clients, capacity * sizeof(client_t));
+    if (clients == NULL)
+    {
+        return -1;
     }
-    else
+    set->clients = clients;
+    select_server_request* requests = realloc(set->requests, capacity * sizeof(select_server_request));
+    if (requests == NULL)
     {
-        perror("oops!");
+        return -1;
     }
+    set->requests = requests;
 
-    close(sock);
-    free(request->msg);
-
-    // Reset everything for the next client
-    request->msg = NULL;
-    request->msg_size = 0;
-    request->partial_msg_size = 0;
-    request->transferred = 0;
-    request->transfer_time = 0;
-    set->clients[index].sock = -1;
-    return result;
+    for (size_t i = set->capacity; i < capacity; ++i)
+    {
+        set->clients[i].sock = -1;
+    }
+    memset(set->requests + set->capacity, 0, (capacity - set->capacity) * sizeof(select_server_request));
+    set->capacity = capacity;
+    return 0;
 }
 
-static void register_fds(fd_set* set, acceptor_t* acceptor, client_t* clients)
+/**
+ * Returns the first word at or after word in which either ready set has a bit set, or words if there isn't one. Runs
+ * of empty words are skipped several at a time with SIMD where it's available, since with thousands of mostly idle
+ * clients most of each set is empty.
+ */
+static size_t select_next_word(select_server_client_set const* set, size_t word, size_t words)
 {
-    memset(set, 0, sizeof(ext_fd_set));//FD_ZERO(set);
-    FD_SET(acceptor->sock, set);
-    for (int i = 0; i < FD_SETSIZE; ++i)
+    uint64_t const* read = set->read_ready.words;
+    uint64_t const* write = set->write_ready.words;
+#if defined(__AVX2__)
+    for (; word + 4 <= words; word += 4)
     {
-        if(clients[i].sock != -1)
+        __m256i any = _mm256_or_si256(_mm256_loadu_si256((__m256i const*)(read + word)),
+                                      _mm256_loadu_si256((__m256i const*)(write + word)));
+        if (!_mm256_testz_si256(any, any))
         {
-            FD_SET(clients[i].sock, set);
+            break;
         }
     }
+#elif defined(__SSE2__)
+    for (; word + 2 <= words; word += 2)
+    {
+        __m128i any = _mm_or_si128(_mm_loadu_si128((__m128i const*)(read + word)),
+                                   _mm_loadu_si128((__m128i const*)(write + word)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF)
+        {
+            break;
+        }
+    }
+#endif
+    while (word < words && !(read[word] | write[word]))
+    {
+        ++word;
+    }
+    return word;
 }
 
-static int select_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+/**
+ * Adds an accepted client to a set, unless admission control turns it away or its fd is too high for the set.
+ *
+ * @return 0 on success (including when the client was turned away), or -1 on failure.
+ */
+static int select_set_add_client(select_server_client_set* client_set, client_t client)
 {
-    *handles_accept = 1;
-
-    select_server_client_set* client_set = malloc(sizeof(select_server_client_set));
-    if (client_set == NULL)
+    if (!admission_admit(client.sock, atomic_load(client_set->connected)))
     {
-        perror("malloc");
-        return -1;
+        if (client_set->accepts)
+        {
+            atomic_fetch_sub(&client_set->accepts->connections, 1);
+        }
+        return 0;
     }
 
-    client_set->connected_count = 0;
-
-    // Set accept socket to non-blocking mode
-    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    if (select_reserve(client_set, client.sock) == -1)
     {
-        perror("fnctl");
-        free(client_set);
-        return -1;
+        // Past what an ext_fd_set can hold (or out of memory), so turn this one client away
+        fprintf(stderr, "No client slot for socket %d; closing it\n", client.sock);
+        close(client.sock);
+        if (client_set->accepts)
+        {
+            atomic_fetch_sub(&client_set->accepts->connections, 1);
+        }
+        return 0;
     }
 
-    server->private = client_set;
+    ++client_set->connected_count;
+    server_client_added(client_set->server, atomic_fetch_add(client_set->connected, 1) + 1);
 
-    for (int i = 0; i < FD_SETSIZE; ++i)
+    client_set->clients[client.sock] = client;
+    echo_conn_init(&client_set->requests[client.sock].conn);
+    if (client.sock > client_set->max_fd)
     {
-        client_set->clients[i].sock = -1;
+        client_set->max_fd = client.sock;
     }
+    select_update_watch(client_set, client.sock);
 
-    client_set->clients[acceptor->sock].sock = acceptor->sock;
-    client_set->max_fd = acceptor->sock;
-    memset(client_set->requests, 0, FD_SETSIZE * sizeof(select_server_request));
+    return 0;
+}
 
-    memset(&client_set->set, 0, sizeof(ext_fd_set));
-    FD_SET(acceptor->sock, &client_set->set);
+/**
+ * Runs one set's event loop until the server is done.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+static int select_set_run(select_server_client_set* client_set)
+{
+    EXT_FD_SET(client_set->accept_fd, &client_set->read_master);
 
     int num_selected;
     while(!atomic_load(&done))
     {
-        register_fds((fd_set*)&client_set->set, acceptor, client_set->clients);
-        //fd_set read_fds = client_set->set;
+        if (accept_pause_over(&client_set->pause, client_set->connected_count))
+        {
+            EXT_FD_SET(client_set->accept_fd, &client_set->read_master);
+        }
+
+        // Only the words up to max_fd mean anything to select, so that's all that's copied and scanned
+        size_t words = (size_t)client_set->max_fd / 64 + 1;
+        memcpy(client_set->read_ready.words, client_set->read_master.words, words * sizeof(uint64_t));
+        memcpy(client_set->write_ready.words, client_set->write_master.words, words * sizeof(uint64_t));
+
         struct timeval timeout;
-        timeout.tv_sec = 1;
-        num_selected = select(client_set->max_fd + 1, (fd_set*)&client_set->set, NULL, NULL, &timeout);
+        int pause_ms = accept_pause_wait_ms(&client_set->pause);
+        timeout.tv_sec = pause_ms == -1 ? 1 : 0;
+        timeout.tv_usec = pause_ms == -1 ? 0 : pause_ms * 1000;
+        num_selected = select(client_set->max_fd + 1, (fd_set*)&client_set->read_ready,
+                              (fd_set*)&client_set->write_ready, NULL, &timeout);
         
         if (num_selected == -1)
         {
             if (errno != EINTR)
             {
                 perror("select");
+                return -1;
             }
             break;
         }else if(num_selected == 0)
         {
-            printf("timed out\n");
+            if (pause_ms == -1)
+            {
+                printf("timed out\n");
+            }
             continue;
         }
 
+        struct timespec pass_start;
+        clock_gettime(CLOCK_MONOTONIC, &pass_start);
+
         // Check for new clients
-        if(FD_ISSET(acceptor->sock, &client_set->set))
+        if (EXT_FD_ISSET(client_set->accept_fd, &client_set->read_ready))
         {
-            // Continue accepting clients until we would block
+            EXT_FD_CLR(client_set->accept_fd, &client_set->read_ready);
+
+            // Continue accepting clients until we would block (or the accept thread's queue is empty)
+            client_t clients[ACCEPT_PER_ITER];
+            int accepted;
             int err = 0;
-            while(1)
+            do
             {
-                client_t client;
-                int result = accept_client(acceptor, &client);
-                if (result == -1)
+                accepted = client_set->accepts ?
+                           (int)accept_queue_take(client_set->accepts, clients, ACCEPT_PER_ITER) :
+                           accept_clients(client_set->listen_sock, clients, ACCEPT_PER_ITER);
+                for (int j = 0; j < accepted && !err; ++j)
                 {
-                    if (errno != EWOULDBLOCK && errno != EAGAIN)
+                    if (select_set_add_client(client_set, clients[j]) == -1)
                     {
                         err = 1;
-                    }
-                    break;
-                }
-                else
-                {
-                    if (server->add_client(server, client) == -1)
-                    {
-                        err = 1;
-                        break;
                     }else{
                         printf("addclient\n");
                     }
                 }
+            } while (accepted == ACCEPT_PER_ITER && !err);
+
+            if (accepted == ACCEPT_EXHAUSTED && accept_pause_start(&client_set->pause, client_set->connected_count))
+            {
+                EXT_FD_CLR(client_set->accept_fd, &client_set->read_master);
             }
         }
 
-        for (int i = acceptor->sock + 1; i < FD_SETSIZE; ++i)
+        // Clients accepted just now aren't in the ready sets, so only the ones select reported are served
+        for (size_t word = select_next_word(client_set, 0, words); word < words && !atomic_load(&done);
+             word = select_next_word(client_set, word + 1, words))
         {
-            if (atomic_load(&done))
+            uint64_t ready = client_set->read_ready.words[word] | client_set->write_ready.words[word];
+            while (ready && !atomic_load(&done))
             {
-                break;
-            }
+                int sock = (int)(word * 64 + (size_t)__builtin_ctzll(ready));
+                ready &= ready - 1;
 
-            if (client_set->clients[i].sock != -1 && FD_ISSET(client_set->clients[i].sock, &client_set->set))
-            {
-                if (handle_request(server, client_set->clients[i].sock) == -1)
+                if (client_set->clients[sock].sock != -1)
                 {
-                    return -1;
+                    handle_request(client_set, sock);
+                    select_update_watch(client_set, sock);
                 }
             }
         }
+
+        // The last client served in a pass waited for all of it, so that's the latency queueing adds
+        struct timespec pass_end;
+        clock_gettime(CLOCK_MONOTONIC, &pass_end);
+        admission_sample((uint64_t)((pass_end.tv_sec - pass_start.tv_sec) * 1000000000L +
+                                    (pass_end.tv_nsec - pass_start.tv_nsec)), atomic_load(client_set->connected));
     }
 
-    return (errno && errno != EINTR) * -1;
+    // errno may be left over from a client that failed, which only cost that client
+    return 0;
 }
 
-static int select_server_add_client(server_t* server, client_t client)
+/**
+ * Allocates the private data for a server with the given number of client sets, each of which starts out accepting
+ * on listen_sock itself.
+ */
+static select_server_private* select_server_private_create(server_t* server, size_t num_sets, int listen_sock)
 {
-    select_server_client_set* client_set = (select_server_client_set*)server->private;
-    
-    if (fcntl(client.sock, F_SETFL, O_NONBLOCK | fcntl(client.sock, F_GETFL, 0)) == -1)
+    select_server_private* priv = calloc(1, sizeof(select_server_private));
+    if (priv == NULL)
+    {
+        return NULL;
+    }
+    priv->sets = calloc(num_sets, sizeof(select_server_client_set));
+    if (priv->sets == NULL)
     {
-        perror("setsockopt");
+        free(priv);
+        return NULL;
+    }
+    priv->num_sets = num_sets;
+    atomic_store(&priv->connected, 0);
+
+    for (size_t i = 0; i < num_sets; ++i)
+    {
+        select_server_client_set* client_set = &priv->sets[i];
+        atomic_store(&client_set->pause.paused, 0);
+        client_set->connected = &priv->connected;
+        client_set->server = server;
+        client_set->listen_sock = listen_sock;
+        client_set->accept_fd = listen_sock;
+        if (select_reserve(client_set, listen_sock) == -1)
+        {
+            return priv;
+        }
+        client_set->max_fd = listen_sock;
+    }
+    return priv;
+}
+
+/**
+ * Starts the accept thread for server_config.accept_policy, giving each set a queue to take its clients from in place
+ * of the listening socket.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int select_start_acceptor(select_server_private* priv, int listen_sock)
+{
+    priv->accepts = calloc(priv->num_sets, sizeof(accept_queue_t));
+    if (priv->accepts == NULL)
+    {
+        perror("malloc accept queues");
         return -1;
     }
-    ++server->total_served;
-    ++client_set->connected_count;
-    if (client_set->connected_count > server->max_concurrent)
+    for (size_t i = 0; i < priv->num_sets; ++i)
     {
-        server->max_concurrent = client_set->connected_count;
+        priv->accepts[i].event_fd = -1;
     }
 
-    client_set->clients[client.sock] = client;
-    if (client.sock > client_set->max_fd)
+    for (size_t i = 0; i < priv->num_sets; ++i)
     {
-        client_set->max_fd = client.sock;
+        select_server_client_set* client_set = &priv->sets[i];
+        if (accept_queue_init(&priv->accepts[i]) == -1)
+        {
+            return -1;
+        }
+        client_set->accepts = &priv->accepts[i];
+        client_set->accept_fd = priv->accepts[i].event_fd;
+        client_set->max_fd = client_set->accept_fd;
+    }
+
+    return accept_thread_start(&priv->acceptor, listen_sock, priv->accepts, priv->num_sets,
+                               (accept_policy_t)server_config.accept_policy);
+}
+
+/**
+ * Sets up the server's private data with num_sets client sets, and the accept thread if there's an accept policy.
+ *
+ * @return 0 on success, or -1 on failure (an error message will have been printed already).
+ */
+static int select_server_init(server_t* server, acceptor_t* acceptor, size_t num_sets)
+{
+    // Set accept socket to non-blocking mode
+    if (fcntl(acceptor->sock, F_SETFL, O_NONBLOCK | fcntl(acceptor->sock, F_GETFL, 0)) == -1)
+    {
+        perror("fnctl");
+        return -1;
+    }
+
+    select_server_private* priv = select_server_private_create(server, num_sets, acceptor->sock);
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return -1;
     }
+    server->private = priv;
 
+    for (size_t i = 0; i < num_sets; ++i)
+    {
+        if (priv->sets[i].clients == NULL || priv->sets[i].requests == NULL)
+        {
+            perror("malloc clients");
+            return -1;
+        }
+    }
 
+    // Even with only one loop to hand clients to, accepting on its own thread keeps it out of the loop's way
+    if (server_config.accept_policy != ACCEPT_POLICY_NONE && select_start_acceptor(priv, acceptor->sock) == -1)
+    {
+        return -1;
+    }
     return 0;
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		select_server_start
+
+    Prototype:	static int select_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since the event loop accepts for itself (or takes clients from
+                     the accept thread).
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Runs a single select event loop on the calling thread.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+static int select_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    if (select_server_init(server, acceptor, 1) == -1)
+    {
+        return -1;
+    }
+
+    select_server_private* priv = (select_server_private*)server->private;
+    return select_set_run(&priv->sets[0]);
+}
+
+static void* select_set_thread(void* void_set)
+{
+    if (select_set_run((select_server_client_set*)void_set) == -1)
+    {
+        atomic_store(&done, 1);
+        return (void*)-1;
+    }
+    return NULL;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		select_mt_server_start
+
+    Prototype:	static int select_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since the accept thread hands clients to the event loops.
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Starts one select event loop per core (or server_config.reactors of them), each with its
+    own client set, and an accept thread that spreads new clients over them by the accept
+    policy (least-conn if none was given). Each loop only watches and serves its own clients,
+    and the loops never share any state apart from the summary counts. fd numbers are
+    process-wide, though, so a loop's select still spans up to its highest fd; the bits of
+    the other loops' clients are just left clear, and skipped a word or more at a time.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+static int select_mt_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    // Something has to decide which loop gets each client, since they can't all select on the listener
+    if (server_config.accept_policy == ACCEPT_POLICY_NONE)
+    {
+        server_config.accept_policy = ACCEPT_POLICY_LEAST_CONN;
+    }
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_sets = server_config.reactors ? server_config.reactors : (num_cpus > 0 ? (size_t)num_cpus : 1);
+    if (select_server_init(server, acceptor, num_sets) == -1)
+    {
+        return -1;
+    }
+    select_server_private* priv = (select_server_private*)server->private;
+    printf("Started %zu select loops\n", num_sets);
+
+    size_t started;
+    for (started = 1; started < num_sets; ++started)
+    {
+        if (pthread_create(&priv->sets[started].thread, NULL, select_set_thread, &priv->sets[started]) != 0)
+        {
+            perror("pthread_create");
+            atomic_store(&done, 1);
+            break;
+        }
+    }
+
+    int result = 0;
+    if (started == num_sets)
+    {
+        result = select_set_thread(&priv->sets[0]) == NULL ? 0 : -1;
+    }
+
+    // Whatever stopped this loop should stop the rest; the signal interrupts their select
+    atomic_store(&done, 1);
+    for (size_t i = 1; i < started; ++i)
+    {
+        pthread_kill(priv->sets[i].thread, SIGINT);
+    }
+    for (size_t i = 1; i < started; ++i)
+    {
+        void* thread_result;
+        pthread_join(priv->sets[i].thread, &thread_result);
+        if (thread_result != NULL)
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Only used if something other than the event loops accepts, which never happens since they report that they handle
+ * accepting; the client goes to the first set.
+ */
+static int select_server_add_client(server_t* server, client_t client)
+{
+    select_server_private* priv = (select_server_private*)server->private;
+    return select_set_add_client(&priv->sets[0], client);
+}
+
 static void select_server_cleanup(server_t* server)
 {
-    select_server_client_set* client_set = (select_server_client_set*)server->private;
+    select_server_private* priv = (select_server_private*)server->private;
+    if (priv == NULL)
+    {
+        return;
+    }
 
-    for (size_t i = 0; i < FD_SETSIZE; ++i)
+    accept_thread_stop(&priv->acceptor);
+    for (size_t i = 0; priv->accepts && i < priv->num_sets; ++i)
     {
-        if (client_set->clients[i].sock != -1)
+        accept_queue_release(&priv->accepts[i]);
+    }
+    free(priv->accepts);
+
+    for (size_t set = 0; set < priv->num_sets; ++set)
+    {
+        select_server_client_set* client_set = &priv->sets[set];
+        for (size_t i = 0; i < client_set->capacity; ++i)
         {
-            // Technically we could just use i here, but w/e
-            close(client_set->clients[i].sock);
-            free(client_set->requests[i].msg);
+            if (client_set->clients[i].sock != -1)
+            {
+                // Technically we could just use i here, but w/e
+                close(client_set->clients[i].sock);
+                echo_conn_release(&client_set->requests[i].conn);
+            }
         }
+        free(client_set->clients);
+        free(client_set->requests);
     }
+    free(priv->sets);
     free(server->private);
+    server->private = NULL;
+}
+
+static int select_server_report(server_t* server, char* buf, size_t len)
+{
+    int written = 0;
+    if (server_config.accept_policy != ACCEPT_POLICY_NONE)
+    {
+        written = accept_thread_report(buf, len);
+    }
+    if (written >= 0 && (size_t)written < len)
+    {
+        written += echo_stats_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += frame_stats_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += output_queue_report(buf + written, len - (size_t)written);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += buffer_pool_report(buf + written, len - (size_t)written);
+    }
+    return written;
 }
 
 static server_t select_server_impl =
@@ -370,7 +732,21 @@ static server_t select_server_impl =
     select_server_cleanup,
     0,
     0,
-    NULL
+    NULL,
+    select_server_report
+};
+
+server_t* select_server = &select_server_impl;
+
+static server_t select_mt_server_impl =
+{
+    select_mt_server_start,
+    select_server_add_client,
+    select_server_cleanup,
+    0,
+    0,
+    NULL,
+    select_server_report
 };
 
-server_t* select_server = &select_server_impl;
\ No newline at end of file
+server_t* select_mt_server = &select_mt_server_impl;
@@ -25,12 +25,17 @@ Name:			server.c
 #include <stdlib.h>
 
 #include "done.h"
+#include "config.h"
 #include "acceptor.h"
+#include "accept_thread.h"
+#include "admission.h"
 #include "server.h"
+#include "socket_profile.h"
 #include "log.h"
 
 static server_t* current_server; // The hacks just don't stop
 atomic_int done = 0;
+server_config_t server_config = {0};
 static __sig_atomic_t handled = 0;
 static void nonfatal_sighandler(int sig)
 {
@@ -40,9 +45,8 @@ static void nonfatal_sighandler(int sig)
 
 static void fatal_sighandler(int sig)
 {
-    static char final_message[256];
-    snprintf(final_message, 256, "Total served: %lu; Max concurrent connections: %lu\n",
-             current_server->total_served, current_server->max_concurrent);
+    static char final_message[2048];
+    server_summary(current_server, final_message, sizeof(final_message));
 
     fputs(final_message, stdout);
     fflush(stdout);
@@ -52,6 +56,86 @@ static void fatal_sighandler(int sig)
     exit(EXIT_FAILURE);
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		server_client_added
+
+    Prototype:	void server_client_added(server_t* server, size_t connected)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - Struct for the server data
+    connected - Number of clients connected, including the new one.
+
+    Return Values:
+
+    Description:
+    Counts a new client and raises max_concurrent if needed. Servers with several event loops
+    call this from each of them, so the update is done with atomics.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+void server_client_added(server_t* server, size_t connected)
+{
+    atomic_fetch_add(&server->total_served, 1);
+
+    size_t max = atomic_load(&server->max_concurrent);
+    while (connected > max && !atomic_compare_exchange_weak(&server->max_concurrent, &max, connected));
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		server_summary
+
+    Prototype:	void server_summary(server_t* server, char* buf, size_t len)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - Struct for the server data
+    buf - Buffer for the summary
+    len - Size of buf
+
+    Return Values:
+
+    Description:
+    Writes the "Total served" summary line followed by the server's own stats, if it has any,
+    and the clients shed for want of fds or turned away by admission control.
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Add the clients shed and listener pauses.
+	2026-10-17 - Shane Spoor - Add the admission control limit and rejections.
+
+*********************************************************************************************/
+void server_summary(server_t* server, char* buf, size_t len)
+{
+    int written = snprintf(buf, len, "Total served: %lu; Max concurrent connections: %lu\n",
+                           atomic_load(&server->total_served), atomic_load(&server->max_concurrent));
+    if (server->report && written > 0 && (size_t)written < len)
+    {
+        int report = server->report(server, buf + written, len - (size_t)written);
+        written += report > 0 ? report : 0;
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        int report = accept_overload_report(buf + written, len - (size_t)written);
+        written += report > 0 ? report : 0;
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        admission_report(buf + written, len - (size_t)written);
+    }
+}
+
 /*********************************************************************************************
 FUNCTION
 
@@ -73,7 +157,8 @@ FUNCTION
     Generic function used by the servers to connect to the client.
 
     Revisions:
-	(none)
+	2026-10-17 - Shane Spoor - Log the socket profile in effect.
+	2026-10-17 - Shane Spoor - Only use SO_REUSEPORT for servers that open a listener per loop.
 
 *********************************************************************************************/
 int serve(server_t *server, unsigned short port)
@@ -130,34 +215,18 @@ int serve(server_t *server, unsigned short port)
     }
 
     acceptor.port = port;
-    acceptor.sock = socket(acceptor.info->ai_family, acceptor.info->ai_socktype, acceptor.info->ai_protocol);
+
+    // Only the servers that open a listener per reactor share the port; for the rest, a second server on it should fail
+    // to bind rather than quietly take some of the clients
+    acceptor.reuseport = (server == epoll_reuseport_server || server == epoll_pool_server) &&
+                         server_config.accept_policy == ACCEPT_POLICY_NONE;
+    acceptor.sock = open_listen_socket(&acceptor);
     if (acceptor.sock < 0)
     {
-        perror("socket");
         freeaddrinfo(acceptor.info);
         return -1;
     }
-
-    int reuse = 1;
-    if (setsockopt(acceptor.sock, SOL_SOCKET, SO_REUSEADDR, &reuse, (socklen_t)sizeof(reuse)) < 0)
-    {
-        // This isn't a fatal error, so just print the error message and carry on
-        perror("setsockopt");
-    }
-
-    if (bind(acceptor.sock, acceptor.info->ai_addr, acceptor.info->ai_addrlen) < 0)
-    {
-        perror("bind");
-        cleanup_acceptor(&acceptor);
-        return -1;
-    }
-
-    if (listen(acceptor.sock, 256) == -1)
-    {
-        perror("listen");
-        cleanup_acceptor(&acceptor);
-        return -1;
-    }
+    socket_profile_log(acceptor.sock);
 
     int handles_accept;
     if (server->start(server, &acceptor, &handles_accept) == -1)
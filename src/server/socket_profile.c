@@ -0,0 +1,172 @@
+/*********************************************************************************************
+Name:			socket_profile.c
+
+    Required:	socket_profile.h
+                config.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    Named socket tuning profiles. Each one sets the listen backlog, Nagle, the buffer sizes,
+    deferred accept, TCP Fast Open, the unsent-data low-water mark and busy polling on every
+    listening socket; accepted sockets get the same per-connection options (from the listener
+    where the kernel copies them over). The settings the kernel actually applied are logged
+    at startup so that a benchmark run can be repeated with the same ones.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "socket_profile.h"
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+#define DEFAULT_BACKLOG 256
+
+static socket_profile_t const profiles[] =
+{
+    // name         backlog          nodelay  rcvbuf           sndbuf           defer  fastopen  notsent    busy_poll
+    {"default",     DEFAULT_BACKLOG, 0,       0,               0,               0,     0,        0,         0},
+    // Small echoes out immediately, a short unsent queue and spinning instead of sleeping for input
+    {"latency",     1024,            1,       0,               0,               0,     256,      16 * 1024, 50},
+    // Big fixed buffers (no waiting for autotuning to grow them) and Nagle left on to fill segments
+    {"throughput",  4096,            0,       4 * 1024 * 1024, 4 * 1024 * 1024, 0,     0,        0,         0},
+    // Lots of mostly idle connections: small buffers, and no wakeup until a connection has sent something
+    {"c10m",        65535,           1,       32 * 1024,       32 * 1024,       5,     4096,     16 * 1024, 0},
+};
+
+static atomic_int accepted_inherits = -1; // Whether accepted sockets get the listener's options; -1 until checked
+
+/**
+ * Returns the configured profile, or the default one if none was chosen.
+ */
+static socket_profile_t const* socket_profile_current(void)
+{
+    socket_profile_t const* profile = server_config.socket_profile ? socket_profile_find(server_config.socket_profile) :
+                                      NULL;
+    return profile ? profile : &profiles[0];
+}
+
+/**
+ * Sets an integer socket option if the profile gives it a value, printing (but otherwise ignoring) any failure.
+ */
+static void socket_profile_set(int sock, int level, int option, int value, char const* name)
+{
+    if (value != 0 && setsockopt(sock, level, option, &value, (socklen_t)sizeof(value)) == -1)
+    {
+        // None of these are needed to serve clients, so just say so and carry on
+        fprintf(stderr, "setsockopt %s: %s\n", name, strerror(errno));
+    }
+}
+
+/**
+ * Reads an integer socket option back, or returns -1 if the kernel won't say.
+ */
+static int socket_profile_get(int sock, int level, int option)
+{
+    int value;
+    socklen_t len = sizeof(value);
+    return getsockopt(sock, level, option, &value, &len) == -1 ? -1 : value;
+}
+
+/**
+ * Sets the options that apply to each connection rather than to accepting.
+ */
+static void socket_profile_connection(int sock, socket_profile_t const* profile)
+{
+    socket_profile_set(sock, IPPROTO_TCP, TCP_NODELAY, profile->nodelay, "TCP_NODELAY");
+    socket_profile_set(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, profile->notsent_lowat, "TCP_NOTSENT_LOWAT");
+    socket_profile_set(sock, SOL_SOCKET, SO_BUSY_POLL, profile->busy_poll, "SO_BUSY_POLL");
+}
+
+socket_profile_t const* socket_profile_find(char const* name)
+{
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); ++i)
+    {
+        if (strcmp(profiles[i].name, name) == 0)
+        {
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+int socket_profile_listener(int sock)
+{
+    socket_profile_t const* profile = socket_profile_current();
+    socket_profile_set(sock, SOL_SOCKET, SO_RCVBUF, profile->rcvbuf, "SO_RCVBUF");
+    socket_profile_set(sock, SOL_SOCKET, SO_SNDBUF, profile->sndbuf, "SO_SNDBUF");
+    socket_profile_set(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, profile->defer_accept, "TCP_DEFER_ACCEPT");
+    socket_profile_set(sock, IPPROTO_TCP, TCP_FASTOPEN, profile->fastopen, "TCP_FASTOPEN");
+    socket_profile_connection(sock, profile);
+    return profile->backlog;
+}
+
+void socket_profile_accepted(int sock)
+{
+    socket_profile_t const* profile = socket_profile_current();
+    if (!profile->nodelay && !profile->notsent_lowat && !profile->busy_poll)
+    {
+        return;
+    }
+
+    int inherits = atomic_load_explicit(&accepted_inherits, memory_order_relaxed);
+    if (inherits == -1)
+    {
+        inherits = (!profile->nodelay || socket_profile_get(sock, IPPROTO_TCP, TCP_NODELAY) > 0) &&
+                   (!profile->notsent_lowat ||
+                    socket_profile_get(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT) == profile->notsent_lowat) &&
+                   (!profile->busy_poll || socket_profile_get(sock, SOL_SOCKET, SO_BUSY_POLL) == profile->busy_poll);
+        atomic_store_explicit(&accepted_inherits, inherits, memory_order_relaxed);
+    }
+
+    if (!inherits)
+    {
+        socket_profile_connection(sock, profile);
+    }
+}
+
+void socket_profile_log(int listen_sock)
+{
+    socket_profile_t const* profile = socket_profile_current();
+
+    int somaxconn = -1;
+    FILE* file = fopen("/proc/sys/net/core/somaxconn", "r");
+    if (file)
+    {
+        if (fscanf(file, "%d", &somaxconn) != 1)
+        {
+            somaxconn = -1;
+        }
+        fclose(file);
+    }
+    int backlog = somaxconn > 0 && somaxconn < profile->backlog ? somaxconn : profile->backlog;
+
+    // Buffer sizes come back doubled for the kernel's bookkeeping, which is what the socket really gets
+    printf("Socket profile %s: backlog %d; TCP_NODELAY %d; SO_RCVBUF %d; SO_SNDBUF %d; TCP_DEFER_ACCEPT %ds; "
+           "TCP_FASTOPEN %d; TCP_NOTSENT_LOWAT %d; SO_BUSY_POLL %dus\n",
+           profile->name, backlog,
+           socket_profile_get(listen_sock, IPPROTO_TCP, TCP_NODELAY),
+           socket_profile_get(listen_sock, SOL_SOCKET, SO_RCVBUF),
+           socket_profile_get(listen_sock, SOL_SOCKET, SO_SNDBUF),
+           socket_profile_get(listen_sock, IPPROTO_TCP, TCP_DEFER_ACCEPT),
+           socket_profile_get(listen_sock, IPPROTO_TCP, TCP_FASTOPEN),
+           socket_profile_get(listen_sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT),
+           socket_profile_get(listen_sock, SOL_SOCKET, SO_BUSY_POLL));
+    fflush(stdout);
+}
@@ -14,34 +14,54 @@ Name:			thread_server.c
     Description:
     This is the threaded server application. This will create threads based off the number of 
     sockets it receives and receives the data from the client and then echos it back to the 
-    client. This is a threaded echo server.
+    client. This is a threaded echo server. The accept loop hands clients to the workers
+    through a bounded blocking queue; idle workers sleep on it instead of spinning. The pool
+    grows while every worker is busy, up to a hard cap, after which clients wait in the queue
+    (and then in the listen backlog once the queue is full). Workers that stay idle for too
+    long exit until the pool is back down to its minimum size. Worker stacks can be shrunk
+    from the pthread default, and the stack and heap each worker actually commits are
+    tracked so that the memory cost of a connection can be quoted.
+
+    The leader/follower variant (thread_lf_server) has no accept thread or queue at all: idle
+    workers take turns holding the leader lock and blocking in accept, and the leader hands
+    the lock to the next follower as soon as it has a client, then serves that client itself.
 
     Revisions:
-    (none)
+    2026-10-17 - Shane Spoor - Feed message latencies to admission control.
 
 *********************************************************************************************/
 
+#define _GNU_SOURCE
+#include <errno.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <client.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <vector.h>
 #include <arpa/inet.h>
 
+#include "admission.h"
+#include "buffer_pool.h"
 #include "log.h"
 #include "timing.h"
 #include "vector.h"
 #include "ring_buffer.h"
+#include "config.h"
 #include "done.h"
 #include "server.h"
 #include "protocol.h"
 
-static const unsigned int WORKER_POOL_SIZE = 200;
+static const unsigned int WORKER_POOL_SIZE = 200;       // Default minimum pool size
+static const unsigned int WORKER_POOL_MAX = 4096;       // Default hard cap on the pool size
+static const unsigned long WORKER_IDLE_TIMEOUT = 30000; // Default ms before an idle worker above the minimum exits
 
-#define CLIENT_BACKLOG_SIZE 100
+#define CLIENT_BACKLOG_SIZE 1024
 static client_t client_backlog_buf[CLIENT_BACKLOG_SIZE];
 
 typedef struct
@@ -53,132 +73,278 @@ typedef struct
 
 typedef struct
 {
-    atomic_int busy;
-    client_t client;
-} worker_params;
-
-typedef struct
-{
-    vector_t worker_params_list;
     ring_buffer_t client_backlog;
     pthread_mutex_t stdout_guard;
+
+    // Workers waiting on the backlog, minus clients queued that haven't been picked up yet
+    atomic_long idle_workers;
+    atomic_size_t connected_count;
+
+    size_t pool_min;
+    size_t pool_max;
+    unsigned long idle_timeout_ms;
+    pthread_attr_t worker_attr;
+
+    // Leader/follower mode only; whoever holds the lock is the one accepting
+    pthread_mutex_t leader_lock;
+    acceptor_t* acceptor;
 } thread_server_private;
 
+// The part of a worker's stack that's been touched, for the memory accounting
+typedef struct
+{
+    void* addr;
+    size_t size;
+    size_t committed;
+} worker_stack;
+
+// Kept outside the private data so that they can still be reported after cleanup
+static struct
+{
+    atomic_size_t pool_size;
+    atomic_size_t pool_peak;
+    atomic_size_t reaped;
+    atomic_size_t queued;
+    atomic_size_t queue_peak;
+
+    // Memory accounting
+    size_t stack_reserved;            // Usable stack per worker
+    size_t guard_size;                // Guard region below each worker's stack
+    atomic_size_t stack_committed;    // Resident stack summed over live workers
+    atomic_size_t stack_peak;         // Most stack any one worker has committed
+    atomic_size_t heap_in_use;        // Message buffers currently allocated by workers
+    atomic_size_t heap_peak;
+    size_t rss_baseline;              // Process RSS once the initial pool is running
+    atomic_size_t rss_at_peak;        // Process RSS when max_concurrent was last raised
+    atomic_size_t connections_at_peak;
+} pool_stats;
+
 static int thread_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
 static int thread_server_add_client(server_t* server, client_t client);
 static void thread_server_cleanup(server_t* server);
+static int thread_server_report(server_t* server, char* buf, size_t len);
+static int thread_lf_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int thread_lf_server_add_client(server_t* server, client_t client);
+static int start_worker(server_t* server, void* (*worker_main)(void*));
+
+/**
+ * Raises *max to value if value is larger.
+ */
+static void update_max(atomic_size_t* max, size_t value)
+{
+    size_t current = atomic_load(max);
+    while (value > current && !atomic_compare_exchange_weak(max, &current, value));
+}
 
-/*********************************************************************************************
-FUNCTION
+/**
+ * Returns the resident set size of the process in bytes, or 0 if it can't be read.
+ */
+static size_t read_rss(void)
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+    {
+        return 0;
+    }
 
-    Name:		worker_func
+    unsigned long size, resident;
+    int num_read = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+    return num_read == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
 
-    Prototype:	static void* worker_func(void* void_params)
+/**
+ * Returns the number of bytes of the given stack that are backed by physical pages.
+ *
+ * @param stack_addr The lowest address of the stack.
+ * @param stack_size The size of the stack.
+ */
+static size_t committed_stack(void* stack_addr, size_t stack_size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    unsigned char resident[4096];
+    size_t committed = 0;
 
-    Developer:	Shane Spoor/Mat Siwoski
+    uintptr_t start = (uintptr_t)stack_addr & ~(page_size - 1);
+    uintptr_t end = (uintptr_t)stack_addr + stack_size;
+    while (start < end)
+    {
+        size_t pages = (end - start + page_size - 1) / page_size;
+        pages = pages > sizeof(resident) ? sizeof(resident) : pages;
+        if (mincore((void*)start, pages * page_size, resident) == -1)
+        {
+            break;
+        }
 
-    Created On: 2017-02-17
+        for (size_t i = 0; i < pages; ++i)
+        {
+            committed += (resident[i] & 1) * page_size;
+        }
+        start += pages * page_size;
+    }
 
-    Parameters:
-    void_params - Params from the threaded server
+    return committed;
+}
 
-    Return Values:
-	
-    Description:
-    Serves a single client request at a time, indicating to the main thread when it is no longer
-    busy.
+/**
+ * Looks up the calling thread's stack so that worker_stack_update can measure it.
+ */
+static void worker_stack_init(worker_stack* stack)
+{
+    stack->addr = NULL;
+    stack->size = 0;
+    stack->committed = 0;
 
-    Revisions:
-	(none)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0)
+    {
+        pthread_attr_getstack(&attr, &stack->addr, &stack->size);
+        pthread_attr_destroy(&attr);
+    }
+}
 
-*********************************************************************************************/
-static void* worker_func(void* void_params)
+/**
+ * Re-measures the calling thread's committed stack and folds the change into the pool stats.
+ */
+static void worker_stack_update(worker_stack* stack)
 {
-    worker_params* params = (worker_params*)void_params;
-
-    // Busy wait for a socket or done ;)
-    // If we cared about the threaded implementation, use of a conditional variable/eventfd would probably be a good
-    // way to make it better
-    while (1)
+    // Stack pages stay resident once touched, so this only ever grows
+    if (stack->addr)
     {
-        int done_local;
-        while(!atomic_load(&params->busy) && !(done_local = atomic_load(&done)));
-        if (done_local)
-        {
-            break;
-        }
+        size_t now_committed = committed_stack(stack->addr, stack->size);
+        atomic_fetch_add(&pool_stats.stack_committed, now_committed - stack->committed);
+        update_max(&pool_stats.stack_peak, now_committed);
+        stack->committed = now_committed;
+    }
+}
 
-        // Handle the new client
-        thread_server_request request;
-        request.stats.transferred = 0;
-        request.stats.transfer_time = 0;
+/**
+ * Removes an exiting thread's stack from the pool stats.
+ */
+static void worker_stack_release(worker_stack* stack)
+{
+    atomic_fetch_sub(&pool_stats.stack_committed, stack->committed);
+    stack->committed = 0;
+}
 
-        struct timeval start, end;
-        gettimeofday(&start, NULL);
+/**
+ * Counts a newly connected client, snapshotting the RSS if it's a new peak.
+ */
+static void count_client(server_t* server, thread_server_private* private)
+{
+    size_t connected = atomic_fetch_add(&private->connected_count, 1) + 1;
+    if (connected > atomic_load(&server->max_concurrent))
+    {
+        // Snapshot memory use at each new peak so that the cost of a connection can be worked out afterwards
+        atomic_store(&pool_stats.rss_at_peak, read_rss());
+        atomic_store(&pool_stats.connections_at_peak, connected);
+    }
+    server_client_added(server, connected);
+}
 
-        ssize_t read_result = read_data(params->client.sock, &request.msg_size, sizeof(request.msg_size));
-        if (read_result == -1)
+/**
+ * Echoes messages back to the client until it sends a message size of 0, then closes its socket and logs its stats.
+ *
+ * @param private The private data of the server that owns the client.
+ * @param client  The client to serve.
+ * @return 0 on success, or -1 on failure (the done flag will have been set in this case).
+ */
+static int serve_client(thread_server_private* private, client_t* client)
+{
+    // Handle the new client
+    thread_server_request request;
+    request.stats.transferred = 0;
+    request.stats.transfer_time = 0;
+    request.msg = NULL;
+    size_t msg_alloc = 0;
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    ssize_t read_result = read_data(client->sock, &request.msg_size, sizeof(request.msg_size));
+    if (read_result == -1)
+    {
+        atomic_store(&done, 1);
+        return -1;
+    }
+    else if (read_result != 0) // We should actually always receive > 0 the first time, but who knows
+    {
+        request.msg = buffer_alloc(request.msg_size);
+        if (request.msg == NULL)
         {
             atomic_store(&done, 1);
-            break;
+            close(client->sock);
+            return -1;
         }
-        else if (read_result != 0) // We should actually always receive > 0 the first time, but who knows
+        msg_alloc = buffer_capacity(request.msg);
+        update_max(&pool_stats.heap_peak, atomic_fetch_add(&pool_stats.heap_in_use, msg_alloc) + msg_alloc);
+    }
+    request.stats.transferred += sizeof(request.msg_size);
+
+    // Continue reading from the client until we get size == 0
+    while(1)
+    {
+        if (request.msg_size > msg_alloc)
         {
-            request.msg = malloc(request.msg_size);
+            // A bigger message than any before it; swap for a buffer from a larger size class
+            buffer_free(request.msg);
+            atomic_fetch_sub(&pool_stats.heap_in_use, msg_alloc);
+            msg_alloc = 0;
+            request.msg = buffer_alloc(request.msg_size);
             if (request.msg == NULL)
             {
                 atomic_store(&done, 1);
-                close(params->client.sock);
-                break;
+                close(client->sock);
+                return -1;
             }
+            msg_alloc = buffer_capacity(request.msg);
+            update_max(&pool_stats.heap_peak, atomic_fetch_add(&pool_stats.heap_in_use, msg_alloc) + msg_alloc);
         }
-        request.stats.transferred += sizeof(request.msg_size);
 
-        // Continue reading from the client until we get size == 0
-        while(1)
-        {
-            // Read all data, send it, then read the next message size
-            read_data(params->client.sock, request.msg, request.msg_size);
-            send_data(params->client.sock, request.msg, request.msg_size);
-            read_data(params->client.sock, &request.msg_size, sizeof(request.msg_size));
+        // Read all data, send it, then read the next message size
+        struct timespec msg_start, msg_end;
+        clock_gettime(CLOCK_MONOTONIC, &msg_start);
+        read_data(client->sock, request.msg, request.msg_size);
+        send_data(client->sock, request.msg, request.msg_size);
+        clock_gettime(CLOCK_MONOTONIC, &msg_end);
+        admission_sample((uint64_t)((msg_end.tv_sec - msg_start.tv_sec) * 1000000000L +
+                                    (msg_end.tv_nsec - msg_start.tv_nsec)),
+                         atomic_load(&private->connected_count));
+        read_data(client->sock, &request.msg_size, sizeof(request.msg_size));
 
-            request.stats.transferred += sizeof(request.msg_size);
-            request.stats.transferred += request.msg_size;
+        request.stats.transferred += sizeof(request.msg_size);
+        request.stats.transferred += request.msg_size;
 
-            if (request.msg_size == 0)
-            {
-                break;
-            }
+        if (request.msg_size == 0)
+        {
+            break;
         }
+    }
 
-        free(request.msg);
-        close(params->client.sock);
-
-        gettimeofday(&end, NULL);
-        request.stats.transfer_time = TIME_DIFF(start, end);
+    buffer_free(request.msg);
+    atomic_fetch_sub(&pool_stats.heap_in_use, msg_alloc);
+    close(client->sock);
 
-        unsigned short src_port = ntohs(params->client.peer.sin_port);
-        char addr_buf[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &params->client.peer.sin_addr, addr_buf, INET_ADDRSTRLEN);
+    gettimeofday(&end, NULL);
+    request.stats.transfer_time = TIME_DIFF(start, end);
 
-        char csv[256];
-        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
-        log_msg(csv);
+    unsigned short src_port = ntohs(client->peer.sin_port);
+    char addr_buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client->peer.sin_addr, addr_buf, INET_ADDRSTRLEN);
 
-        char pretty[256];
-        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
-                 request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
+    char csv[256];
+    snprintf(csv, 256, "%ld,%ld,%s:%hu\n", request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
+    log_msg(csv);
 
-        pthread_mutex_t* stdout_guard = &((thread_server_private*)thread_server->private)->stdout_guard;
-        pthread_mutex_lock(stdout_guard);
-        printf("%s", pretty);
-        pthread_mutex_unlock(stdout_guard);
+    char pretty[256];
+    snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+             request.stats.transfer_time, request.stats.transferred, addr_buf, src_port);
 
-        atomic_store(&params->busy, 0);
-    }
+    pthread_mutex_lock(&private->stdout_guard);
+    printf("%s", pretty);
+    pthread_mutex_unlock(&private->stdout_guard);
 
-    free(params);
-    return NULL;
+    return 0;
 }
 
 /*********************************************************************************************
@@ -198,68 +364,261 @@ FUNCTION
     Return Values:
 	
     Description:
-    Create the serrver sockets that the will connect to the client and send/receive data.
+    Serves a single client request at a time, sleeping on the client backlog between clients.
+    Exits after sitting idle for the idle timeout if the pool is above its minimum size.
 
     Revisions:
-	(none)
+	2026-10-17 - Shane Spoor - Block on the client backlog instead of busy waiting.
+	2026-10-17 - Shane Spoor - Reap idle workers.
 
 *********************************************************************************************/
-static void accept_loop(server_t* server, acceptor_t* acceptor)
+static void* worker_func(void* void_server)
 {
+    server_t* server = (server_t*)void_server;
     thread_server_private* private = (thread_server_private*)server->private;
 
-    // Get clients from the acceptor and send them to an available thread
-    while (1)
+    worker_stack stack;
+    worker_stack_init(&stack);
+
+    while (!atomic_load(&done))
     {
-        client_t next_client;
-        int result = accept_client(acceptor, &next_client);
-        if (result == -1 || atomic_load(&done))
-        {
-            break;
-        }
+        atomic_fetch_add(&private->idle_workers, 1);
 
-        if (server->add_client(server, next_client) == -1)
+        client_t client;
+        if (ring_buffer_timed_get(&private->client_backlog, &client, private->idle_timeout_ms) == -1)
         {
-            break;
+            if (errno != ETIMEDOUT)
+            {
+                break;
+            }
+
+            // Only leave if another worker is waiting to take our place for any client that's on its way
+            size_t size = atomic_load(&pool_stats.pool_size);
+            if (size <= private->pool_min ||
+                !atomic_compare_exchange_strong(&pool_stats.pool_size, &size, size - 1))
+            {
+                atomic_fetch_sub(&private->idle_workers, 1);
+                continue;
+            }
+
+            long idle = atomic_load(&private->idle_workers);
+            while (idle > 0 && !atomic_compare_exchange_weak(&private->idle_workers, &idle, idle - 1));
+            if (idle > 0)
+            {
+                atomic_fetch_add(&pool_stats.reaped, 1);
+                worker_stack_release(&stack);
+                return NULL;
+            }
+
+            atomic_fetch_add(&pool_stats.pool_size, 1);
+            atomic_fetch_sub(&private->idle_workers, 1);
+            continue;
         }
+        atomic_fetch_sub(&pool_stats.queued, 1);
+
+        int result = serve_client(private, &client);
+        atomic_fetch_sub(&private->connected_count, 1);
+        worker_stack_update(&stack);
 
-        ++server->total_served;
-        if (private->worker_params_list.size > server->max_concurrent)
+        if (result == -1)
         {
-            server->max_concurrent = private->worker_params_list.size;
+            break;
         }
     }
+
+    worker_stack_release(&stack);
+    atomic_fetch_sub(&pool_stats.pool_size, 1);
+    return NULL;
 }
 
 /*********************************************************************************************
 FUNCTION
 
-    Name:		thread_server_start
+    Name:		lf_worker_func
 
-    Prototype:	int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *handles_accept)
+    Prototype:	static void* lf_worker_func(void* void_server)
 
-    Developer:	Shane Spoor/Mat Siwoski
+    Developer:	Shane Spoor
 
-    Created On: 2017-02-17
+    Created On: 2026-10-17
 
     Parameters:
-    thread_server - pointer to the struct with server read_data
-    acceptor - Struct with acceptor information
-    handles_accept - handles the accept
+    void_server - The leader/follower server to which the worker belongs
 
     Return Values:
 	
     Description:
-    Starts the threaded server. 
+    Leader/follower worker. Followers queue on the leader lock; the leader blocks in accept,
+    promotes the next follower by releasing the lock as soon as it has a client, and then
+    serves that client itself before rejoining the followers. A new worker is started if the
+    leader was the last idle one, so there is always someone accepting unless the pool is at
+    its cap. Followers that wait longer than the idle timeout exit while the pool is above its
+    minimum size.
 
     Revisions:
 	(none)
 
 *********************************************************************************************/
-int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *handles_accept)
+static void* lf_worker_func(void* void_server)
 {
-    *handles_accept = 1;
+    server_t* server = (server_t*)void_server;
+    thread_server_private* private = (thread_server_private*)server->private;
+
+    worker_stack stack;
+    worker_stack_init(&stack);
+
+    while (!atomic_load(&done))
+    {
+        atomic_fetch_add(&private->idle_workers, 1);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(private->idle_timeout_ms / 1000);
+        deadline.tv_nsec += (long)(private->idle_timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        int lock_result = pthread_mutex_timedlock(&private->leader_lock, &deadline);
+        if (lock_result == ETIMEDOUT)
+        {
+            // The leader is still waiting in accept, so there's always another idle worker here
+            size_t size = atomic_load(&pool_stats.pool_size);
+            if (size > private->pool_min &&
+                atomic_compare_exchange_strong(&pool_stats.pool_size, &size, size - 1))
+            {
+                atomic_fetch_sub(&private->idle_workers, 1);
+                atomic_fetch_add(&pool_stats.reaped, 1);
+                worker_stack_release(&stack);
+                return NULL;
+            }
+
+            atomic_fetch_sub(&private->idle_workers, 1);
+            continue;
+        }
+        else if (lock_result != 0)
+        {
+            errno = lock_result;
+            perror("pthread_mutex_timedlock");
+            atomic_store(&done, 1);
+            atomic_fetch_sub(&private->idle_workers, 1);
+            break;
+        }
+
+        // Once we're shutting down, each leader just passes the lock on so that every follower sees the flag
+        client_t client;
+        int accept_result = atomic_load(&done) ? -1 : accept_client(private->acceptor, &client);
+        long idle = atomic_fetch_sub(&private->idle_workers, 1);
+        if (accept_result == 0 && idle == 1 && start_worker(server, lf_worker_func) == -1 && errno != EAGAIN)
+        {
+            atomic_store(&done, 1);
+        }
+        pthread_mutex_unlock(&private->leader_lock);
+
+        if (accept_result == -1 || server->add_client(server, client) == -1)
+        {
+            break;
+        }
+        worker_stack_update(&stack);
+    }
+
+    worker_stack_release(&stack);
+    atomic_fetch_sub(&pool_stats.pool_size, 1);
+    return NULL;
+}
+
+/**
+ * Sets up the attributes for worker threads, applying the configured stack and guard sizes.
+ *
+ * @param attr The attributes to initialise.
+ * @return 0 on success, -1 on failure (an error message will have been printed already).
+ */
+static int init_worker_attr(pthread_attr_t* attr)
+{
+    if (pthread_attr_init(attr) != 0)
+    {
+        perror("pthread_attr_init");
+        return -1;
+    }
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    if (server_config.worker_stack_size)
+    {
+        // Round up to whole pages, and to at least what glibc needs for its own thread bookkeeping
+        size_t stack_size = (server_config.worker_stack_size + page_size - 1) & ~(page_size - 1);
+        if (stack_size < PTHREAD_STACK_MIN)
+        {
+            stack_size = PTHREAD_STACK_MIN;
+        }
+        if ((errno = pthread_attr_setstacksize(attr, stack_size)) != 0)
+        {
+            perror("pthread_attr_setstacksize");
+            return -1;
+        }
+    }
+    if (server_config.worker_guard_size)
+    {
+        size_t guard_size = (server_config.worker_guard_size + page_size - 1) & ~(page_size - 1);
+        if ((errno = pthread_attr_setguardsize(attr, guard_size)) != 0)
+        {
+            perror("pthread_attr_setguardsize");
+            return -1;
+        }
+    }
+
+    pthread_attr_getstacksize(attr, &pool_stats.stack_reserved);
+    pthread_attr_getguardsize(attr, &pool_stats.guard_size);
+    return 0;
+}
+
+/**
+ * Starts a new detached worker thread, unless the pool is already at its cap.
+ *
+ * @param server      The server to which the worker belongs.
+ * @param worker_main The worker's thread function.
+ * @return 0 on success, or -1 on failure with errno set (EAGAIN if the pool is at its cap).
+ */
+static int start_worker(server_t* server, void* (*worker_main)(void*))
+{
+    thread_server_private* private = (thread_server_private*)server->private;
 
+    size_t size = atomic_load(&pool_stats.pool_size);
+    do
+    {
+        if (size >= private->pool_max)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&pool_stats.pool_size, &size, size + 1));
+
+    size_t peak = atomic_load(&pool_stats.pool_peak);
+    while (size + 1 > peak && !atomic_compare_exchange_weak(&pool_stats.pool_peak, &peak, size + 1));
+
+    pthread_t thread;
+    int result = pthread_create(&thread, &private->worker_attr, worker_main, server);
+    if (result != 0)
+    {
+        atomic_fetch_sub(&pool_stats.pool_size, 1);
+        errno = result == EAGAIN ? ENOMEM : result; // EAGAIN is reserved for hitting the cap
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/**
+ * Allocates the server's private data and starts the minimum number of workers.
+ *
+ * @param server      The server to initialise.
+ * @param acceptor    The acceptor from which clients arrive.
+ * @param worker_main The thread function for the workers.
+ * @return 0 on success, -1 on failure (an error message will have been printed already).
+ */
+static int thread_server_init(server_t* server, acceptor_t* acceptor, void* (*worker_main)(void*))
+{
     thread_server_private* priv = malloc(sizeof(thread_server_private));
     if (!priv)
     {
@@ -267,67 +626,131 @@ int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *hand
         return -1;
     }
 
-    if (pthread_mutex_init(&priv->stdout_guard, NULL) == -1)
+    if (pthread_mutex_init(&priv->stdout_guard, NULL) != 0 || pthread_mutex_init(&priv->leader_lock, NULL) != 0)
     {
         perror("pthread_mutex_init");
         return -1;
     }
 
-    //ring_buffer_init(&priv->client_backlog, &client_backlog_buf[0], CLIENT_BACKLOG_SIZE, sizeof(client_t));
+    if (ring_buffer_init(&priv->client_backlog, &client_backlog_buf[0], CLIENT_BACKLOG_SIZE, sizeof(client_t)) == -1)
+    {
+        perror("ring_buffer_init");
+        return -1;
+    }
 
-    if (vector_init(&priv->worker_params_list, sizeof(worker_params*), WORKER_POOL_SIZE) == -1)
+    atomic_store(&priv->idle_workers, 0);
+    atomic_store(&priv->connected_count, 0);
+    priv->acceptor = acceptor;
+    priv->pool_max = server_config.pool_max ? server_config.pool_max : WORKER_POOL_MAX;
+    priv->pool_min = server_config.pool_min ? server_config.pool_min : WORKER_POOL_SIZE;
+    if (priv->pool_min > priv->pool_max)
+    {
+        priv->pool_min = priv->pool_max;
+    }
+    priv->idle_timeout_ms = server_config.idle_timeout_ms ? server_config.idle_timeout_ms : WORKER_IDLE_TIMEOUT;
+    if (init_worker_attr(&priv->worker_attr) == -1)
     {
-        fprintf(stderr, "vector_init failed");
         return -1;
     }
+    server->private = priv;
 
     size_t i;
-    for(i = 0; i < WORKER_POOL_SIZE; ++i)
+    for (i = 0; i < priv->pool_min; ++i)
     {
-        worker_params* params = malloc(sizeof(worker_params));
-        if (!params)
+        if (start_worker(server, worker_main) == -1)
         {
             break;
         }
-        params->busy = 0;
-        vector_push_back(&priv->worker_params_list, &params);
     }
-    if (i != WORKER_POOL_SIZE)
+
+    if (i != priv->pool_min)
     {
-        size_t const allocd = i;
-        worker_params** worker_param_list = (worker_params**)priv->worker_params_list.items;
-        perror("malloc");
+        perror("pthread_create");
+        atomic_store(&done, 1);
 
-        for (i = 0; i < allocd; ++i)
-        {
-            free(worker_param_list[i]);
-        } 
-        vector_free(&priv->worker_params_list);
         return -1;
     }
 
-    for (i = 0; i < WORKER_POOL_SIZE; ++i)
+    pool_stats.rss_baseline = read_rss();
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		worker_func
+
+    Prototype:	static void* worker_func(void* void_params)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2017-02-17
+
+    Parameters:
+    void_params - Params from the threaded server
+
+    Return Values:
+	
+    Description:
+    Create the serrver sockets that the will connect to the client and send/receive data.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+static void accept_loop(server_t* server, acceptor_t* acceptor)
+{
+    // Get clients from the acceptor and send them to an available thread
+    while (1)
     {
-        worker_params** worker_param_list = (worker_params**)priv->worker_params_list.items;
-        pthread_t thread;
-        int result = pthread_create(&thread, NULL, worker_func, worker_param_list[i]);
-        if (result == -1)
+        client_t next_client;
+        int result = accept_client(acceptor, &next_client);
+        if (result == -1 || atomic_load(&done))
+        {
+            break;
+        }
+
+        if (server->add_client(server, next_client) == -1)
         {
             break;
         }
-        pthread_detach(thread);
-        
     }
+}
 
-    if (i != WORKER_POOL_SIZE)
-    {
-        perror("pthread_create");
-        atomic_store(&done, 1);
+/*********************************************************************************************
+FUNCTION
+
+    Name:		thread_server_start
+
+    Prototype:	int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *handles_accept)
+
+    Developer:	Shane Spoor/Mat Siwoski
+
+    Created On: 2017-02-17
+
+    Parameters:
+    thread_server - pointer to the struct with server read_data
+    acceptor - Struct with acceptor information
+    handles_accept - handles the accept
+
+    Return Values:
+	
+    Description:
+    Starts the threaded server. 
+
+    Revisions:
+	2026-10-17 - Shane Spoor - Moved the setup into thread_server_init.
+
+*********************************************************************************************/
+int thread_server_start(server_t *thread_server, acceptor_t *acceptor, int *handles_accept)
+{
+    *handles_accept = 1;
 
+    if (thread_server_init(thread_server, acceptor, worker_func) == -1)
+    {
         return -1;
     }
 
-    thread_server->private = priv;
     accept_loop(thread_server, acceptor);
     return 0;
 }
@@ -353,51 +776,38 @@ FUNCTION
     Creates and adds the clients.
 
     Revisions:
-	(none)
+	2026-10-17 - Shane Spoor - Reset clients past the admission limit.
 
 *********************************************************************************************/
 static int thread_server_add_client(server_t* server, client_t client)
 {
     thread_server_private* private = (thread_server_private*)server->private;
-    worker_params** list = (worker_params**)private->worker_params_list.items;
 
-    // Find the next non-busy thread, if any
-    unsigned i;
-    for(i = 0; i < private->worker_params_list.size; ++i)
+    if (!admission_admit(client.sock, atomic_load(&private->connected_count)))
     {
-        worker_params* params = list[i];
-        int busy = atomic_load(&params->busy);
-        if (!busy)
-        {
-            list[i]->client = client;
-            atomic_store(&params->busy, 1);
-            break;
-        }
+        return 0;
     }
 
-    if (i == private->worker_params_list.size)
-    {
-        // All threads are busy; add a new one to the list and give it the new connection
-        worker_params* new_params = NULL;
-        new_params = malloc(sizeof(worker_params));
-        if (!new_params || (vector_push_back(&private->worker_params_list, &new_params) == -1))
-        {
-            atomic_store(&done, 1);
-            free(new_params);
-            return -1;
-        }
+    // Claim an idle worker; the queue hands the client to whichever one wakes first
+    long idle = atomic_fetch_sub(&private->idle_workers, 1);
+    count_client(server, private);
 
-        new_params->busy = 1;
-        new_params->client = client;
+    size_t queued = atomic_fetch_add(&pool_stats.queued, 1) + 1;
+    size_t peak = atomic_load(&pool_stats.queue_peak);
+    while (queued > peak && !atomic_compare_exchange_weak(&pool_stats.queue_peak, &peak, queued));
 
-        pthread_t new_thread;
-        if(pthread_create(&new_thread, NULL, worker_func, new_params) == -1 ||
-           pthread_detach(new_thread) == -1)
-        {
-            atomic_store(&done, 1);
-            free(new_params);
-            return -1;
-        }
+    if (ring_buffer_put(&private->client_backlog, &client) == -1)
+    {
+        atomic_fetch_sub(&pool_stats.queued, 1);
+        close(client.sock);
+        return -1;
+    }
+
+    // All threads are busy; add another unless we're at the cap, in which case the client waits for the next free one
+    if (idle <= 0 && start_worker(server, worker_func) == -1 && errno != EAGAIN)
+    {
+        atomic_store(&done, 1);
+        return -1;
     }
 
     return 0;
@@ -429,12 +839,119 @@ FUNCTION
 static void thread_server_cleanup(server_t* thread_server)
 {
     thread_server_private* private = (thread_server_private*)thread_server->private;
-    pthread_mutex_destroy(&private->stdout_guard);
-    vector_free(&private->worker_params_list); // The threads will free the individual elements... I hope
     atomic_store(&done, 1);
+    ring_buffer_close(&private->client_backlog);
+
+    // Idle workers leave as soon as the backlog is closed, but busy ones might be stuck in a blocking read. Give them
+    // a moment, and leak the private data rather than free it out from under them if they don't finish.
+    for (int i = 0; i < 100 && atomic_load(&pool_stats.pool_size) != 0; ++i)
+    {
+        usleep(10000);
+    }
+    if (atomic_load(&pool_stats.pool_size) != 0)
+    {
+        return;
+    }
+
+    ring_buffer_destroy(&private->client_backlog);
+    pthread_attr_destroy(&private->worker_attr);
+    pthread_mutex_destroy(&private->leader_lock);
+    pthread_mutex_destroy(&private->stdout_guard);
     free(private);
 }
 
+/*********************************************************************************************
+FUNCTION
+
+    Name:		thread_lf_server_start
+
+    Prototype:	static int thread_lf_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - struct with server data
+    acceptor - the acceptor whose socket the workers accept on
+    handles_accept - Set to 1, since the workers accept for themselves.
+
+    Return Values:
+    0 on success, -1 on failure.
+
+    Description:
+    Starts the leader/follower pool and waits for the done flag. The leader is then blocked
+    in accept, so the listening socket is shut down to wake it.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+static int thread_lf_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    if (thread_server_init(server, acceptor, lf_worker_func) == -1)
+    {
+        return -1;
+    }
+
+    while (!atomic_load(&done))
+    {
+        usleep(100000);
+    }
+    shutdown(acceptor->sock, SHUT_RD);
+    return 0;
+}
+
+/**
+ * Serves a client on the calling thread; the leader/follower workers call this once they have accepted it.
+ */
+static int thread_lf_server_add_client(server_t* server, client_t client)
+{
+    thread_server_private* private = (thread_server_private*)server->private;
+
+    if (!admission_admit(client.sock, atomic_load(&private->connected_count)))
+    {
+        return 0;
+    }
+
+    count_client(server, private);
+    int result = serve_client(private, &client);
+    atomic_fetch_sub(&private->connected_count, 1);
+    return result;
+}
+
+static int thread_server_report(server_t* server, char* buf, size_t len)
+{
+    size_t peak_connections = atomic_load(&pool_stats.connections_at_peak);
+    size_t rss_at_peak = atomic_load(&pool_stats.rss_at_peak);
+    size_t per_connection = 0;
+    if (peak_connections && rss_at_peak > pool_stats.rss_baseline)
+    {
+        per_connection = (rss_at_peak - pool_stats.rss_baseline) / peak_connections;
+    }
+
+    int written = snprintf(buf, len, "Pool size: %zu; Peak pool size: %zu; Idle workers reaped: %zu\n"
+                              "Queue depth: %zu; Peak queue depth: %zu\n"
+                              "Worker stack: %zu KiB reserved + %zu KiB guard; committed %zu KiB over live workers, "
+                              "%zu KiB peak per worker\n"
+                              "Worker heap: %zu KiB in use, %zu KiB peak\n"
+                              "RSS: %zu KiB baseline, %zu KiB at %zu connections (%zu bytes per connection)\n",
+                    atomic_load(&pool_stats.pool_size), atomic_load(&pool_stats.pool_peak),
+                    atomic_load(&pool_stats.reaped), atomic_load(&pool_stats.queued),
+                    atomic_load(&pool_stats.queue_peak),
+                    pool_stats.stack_reserved / 1024, pool_stats.guard_size / 1024,
+                    atomic_load(&pool_stats.stack_committed) / 1024, atomic_load(&pool_stats.stack_peak) / 1024,
+                    atomic_load(&pool_stats.heap_in_use) / 1024, atomic_load(&pool_stats.heap_peak) / 1024,
+                    pool_stats.rss_baseline / 1024, rss_at_peak / 1024, peak_connections, per_connection);
+    if (written > 0 && (size_t)written < len)
+    {
+        written += buffer_pool_report(buf + written, len - (size_t)written);
+    }
+    return written;
+}
+
 static server_t thread_server_impl =
 {
     thread_server_start,
@@ -442,7 +959,21 @@ static server_t thread_server_impl =
     thread_server_cleanup,
     0,
     0,
-    NULL
+    NULL,
+    thread_server_report
 };
 
 server_t* thread_server = &thread_server_impl;
+
+static server_t thread_lf_server_impl =
+{
+    thread_lf_server_start,
+    thread_lf_server_add_client,
+    thread_server_cleanup,
+    0,
+    0,
+    NULL,
+    thread_server_report
+};
+
+server_t* thread_lf_server = &thread_lf_server_impl;
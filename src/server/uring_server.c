@@ -0,0 +1,944 @@
+/*********************************************************************************************
+Name:			uring_server.c
+
+    Required:	acceptor.h
+                done.h
+                server.h
+                vector.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    This is the io_uring server. A single multishot accept delivers new connections, every
+    connection has a single multishot recv that reads into buffers taken from a provided buffer
+    ring, and the echoed bytes are sent straight out of those buffers with linked send SQEs.
+    Once the rings are set up, a whole batch of accepts, reads and echoes costs one
+    io_uring_enter call instead of the three or more syscalls per message that the epoll server
+    makes.
+
+    Revisions:
+    2026-10-17 - Shane Spoor - Leave the accept unarmed while out of fds instead of exiting.
+    2026-10-17 - Shane Spoor - Admit clients under the adaptive limit, fed with batch latencies.
+    2026-10-17 - Shane Spoor - Count clients with server_client_added like the other servers.
+
+*********************************************************************************************/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+#include "log.h"
+#include "timing.h"
+#include "done.h"
+#include "acceptor.h"
+#include "admission.h"
+#include "server.h"
+#include "socket_profile.h"
+#include "vector.h"
+
+#define URING_ENTRIES     4096
+#define URING_BUF_COUNT   4096 // Must be a power of two; buffer IDs are 16 bits
+#define URING_BUF_SIZE    8192
+#define URING_BUF_GROUP   0
+#define URING_MAX_LINKED  16
+#define URING_INITIAL_FDS 98304
+#define URING_NO_BUF      UINT32_MAX
+
+enum
+{
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,
+    URING_OP_SEND
+};
+
+// The fd lives in the upper bits of user_data, the operation in the lowest byte
+#define URING_USER_DATA(fd, op) (((uint64_t)(uint32_t)(fd) << 8) | (op))
+#define URING_USER_FD(data)     ((int)((data) >> 8))
+#define URING_USER_OP(data)     ((int)((data) & 0xff))
+
+static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept);
+static int uring_server_add_client(server_t* server, client_t client);
+static void uring_server_cleanup(server_t* server);
+
+static server_t uring_server_impl =
+{
+    uring_server_start,
+    uring_server_add_client,
+    uring_server_cleanup,
+    0,
+    0,
+    NULL,
+    NULL // No stats beyond the summary's
+};
+
+server_t* uring_server = &uring_server_impl;
+
+typedef struct
+{
+    uint32_t next;   // Next buffer in the owning connection's send queue
+    uint32_t offset; // Offset of the unsent echo data within the buffer
+    uint32_t len;    // Number of unsent echo bytes in the buffer
+    uint32_t sent;   // Set once a send CQE reports the whole segment as sent
+} uring_buf_meta;
+
+typedef struct
+{
+    client_t client;
+    struct timeval start;
+    size_t transferred;
+
+    // Framing state; the header can be split across any number of recv buffers
+    uint32_t partial_msg_size;
+    uint32_t header_read;
+    uint32_t body_left;
+
+    // Buffers holding echo data, oldest first. The first in_flight of them have sends queued.
+    uint32_t send_head;
+    uint32_t send_tail;
+    uint32_t in_flight;
+
+    int next_starved;
+    uint8_t recv_armed;
+    uint8_t starved;
+    uint8_t finished;
+    uint8_t failed;
+} uring_conn;
+
+typedef struct
+{
+    unsigned* head;
+    unsigned* tail;
+    unsigned* array;
+    unsigned mask;
+    unsigned entries;
+    unsigned local_tail;
+    unsigned submitted_tail;
+    struct io_uring_sqe* sqes;
+} uring_sq;
+
+typedef struct
+{
+    unsigned* head;
+    unsigned* tail;
+    unsigned mask;
+    struct io_uring_cqe* cqes;
+} uring_cq;
+
+typedef struct
+{
+    int ring_fd;
+    uring_sq sq;
+    uring_cq cq;
+
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;
+    size_t cq_map_len;
+    size_t sqes_map_len;
+
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_len;
+    uint16_t buf_tail;
+    char* bufs;
+    uring_buf_meta* meta;
+
+    vector_t conns;
+    int starved_head;
+    int listen_sock;
+    size_t connected_count;
+    accept_pause_t pause; // Set while the accept is left unarmed for want of fds
+} uring_server_private;
+
+static int uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Publishes every SQE prepared since the last call to the kernel and optionally waits for a
+ * completion.
+ *
+ * @param priv     The server's private data.
+ * @param wait_for The minimum number of completions to wait for.
+ * @return 0 on success, -1 on failure with errno set appropriately.
+ */
+static int uring_submit(uring_server_private* priv, unsigned wait_for)
+{
+    uring_sq* sq = &priv->sq;
+    unsigned to_submit = sq->local_tail - sq->submitted_tail;
+
+    atomic_store_explicit((_Atomic unsigned*)sq->tail, sq->local_tail, memory_order_release);
+    if (to_submit == 0 && wait_for == 0)
+    {
+        return 0;
+    }
+
+    int result = uring_enter(priv->ring_fd, to_submit, wait_for, wait_for ? IORING_ENTER_GETEVENTS : 0);
+    if (result >= 0)
+    {
+        sq->submitted_tail += (unsigned)result;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Returns the number of SQEs that can be prepared before the submission queue is full.
+ */
+static unsigned uring_sq_space(uring_server_private* priv)
+{
+    uring_sq* sq = &priv->sq;
+    unsigned head = atomic_load_explicit((_Atomic unsigned*)sq->head, memory_order_acquire);
+    return sq->entries - (sq->local_tail - head);
+}
+
+/**
+ * Makes sure that at least count SQEs can be prepared without a submission in between, so
+ * that linked chains are never split across two io_uring_enter calls.
+ */
+static int uring_reserve(uring_server_private* priv, unsigned count)
+{
+    while (uring_sq_space(priv) < count)
+    {
+        if (uring_submit(priv, 0) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static struct io_uring_sqe* uring_get_sqe(uring_server_private* priv)
+{
+    if (uring_reserve(priv, 1) == -1)
+    {
+        return NULL;
+    }
+
+    uring_sq* sq = &priv->sq;
+    unsigned index = sq->local_tail & sq->mask;
+    struct io_uring_sqe* sqe = &sq->sqes[index];
+    sq->array[index] = index;
+    ++sq->local_tail;
+
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static int uring_arm_accept(uring_server_private* priv)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(priv);
+    if (!sqe)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = priv->listen_sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_USER_DATA(priv->listen_sock, URING_OP_ACCEPT);
+    return 0;
+}
+
+static int uring_arm_recv(uring_server_private* priv, uring_conn* conn)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(priv);
+    if (!sqe)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->client.sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = URING_USER_DATA(conn->client.sock, URING_OP_RECV);
+    conn->recv_armed = 1;
+    return 0;
+}
+
+/**
+ * Hands a buffer back to the provided buffer ring. The new tail is only made visible to the
+ * kernel by uring_publish_bufs.
+ */
+static void uring_recycle_buf(uring_server_private* priv, uint32_t bid)
+{
+    struct io_uring_buf* buf = &priv->buf_ring->bufs[priv->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(priv->bufs + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = (uint16_t)bid;
+    ++priv->buf_tail;
+}
+
+static void uring_publish_bufs(uring_server_private* priv)
+{
+    atomic_store_explicit((_Atomic uint16_t*)&priv->buf_ring->tail, priv->buf_tail, memory_order_release);
+}
+
+static uring_conn* uring_get_conn(uring_server_private* priv, int fd)
+{
+    return (uring_conn*)priv->conns.items + fd;
+}
+
+/**
+ * Queues linked sends for every buffer in the connection's send queue that isn't already in
+ * flight. Only one chain is in flight per connection at a time, which keeps the echoed bytes in
+ * order even when a send is cut short.
+ */
+static int uring_flush_sends(uring_server_private* priv, uring_conn* conn)
+{
+    if (conn->in_flight != 0 || conn->send_head == URING_NO_BUF || conn->failed)
+    {
+        return 0;
+    }
+
+    unsigned count = 0;
+    for (uint32_t bid = conn->send_head; bid != URING_NO_BUF && count < URING_MAX_LINKED; bid = priv->meta[bid].next)
+    {
+        ++count;
+    }
+
+    if (uring_reserve(priv, count) == -1)
+    {
+        return -1;
+    }
+
+    uint32_t bid = conn->send_head;
+    for (unsigned i = 0; i < count; ++i, bid = priv->meta[bid].next)
+    {
+        uring_buf_meta* meta = &priv->meta[bid];
+        struct io_uring_sqe* sqe = uring_get_sqe(priv);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn->client.sock;
+        sqe->addr = (uint64_t)(uintptr_t)(priv->bufs + (size_t)bid * URING_BUF_SIZE + meta->offset);
+        sqe->len = meta->len;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->flags = (i + 1 < count) ? IOSQE_IO_LINK : 0;
+        sqe->user_data = URING_USER_DATA(conn->client.sock, URING_OP_SEND) | ((uint64_t)bid << 40);
+    }
+    conn->in_flight = count;
+    return 0;
+}
+
+/**
+ * Closes the connection once it has nothing outstanding in the kernel, logging its stats.
+ */
+static void uring_maybe_close(uring_server_private* priv, uring_conn* conn)
+{
+    if (conn->recv_armed || conn->starved || conn->in_flight)
+    {
+        return;
+    }
+    if (!conn->finished && !conn->failed)
+    {
+        return;
+    }
+    if (!conn->failed && conn->send_head != URING_NO_BUF)
+    {
+        // Still echoing data that arrived before the client finished
+        return;
+    }
+
+    while (conn->send_head != URING_NO_BUF)
+    {
+        uint32_t bid = conn->send_head;
+        conn->send_head = priv->meta[bid].next;
+        uring_recycle_buf(priv, bid);
+    }
+
+    --priv->connected_count;
+    if (!conn->failed)
+    {
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        time_t transfer_time = TIME_DIFF(conn->start, end);
+
+        unsigned short src_port = ntohs(conn->client.peer.sin_port);
+        char* addr = inet_ntoa(conn->client.peer.sin_addr);
+        char csv[256];
+        snprintf(csv, 256, "%ld,%ld,%s:%hu\n", transfer_time, conn->transferred, addr, src_port);
+        log_msg(csv);
+
+        char pretty[256];
+        snprintf(pretty, 256, "Transfer time; %ldus; total bytes transferred: %ld; peer: %s:%hu\n",
+                 transfer_time, conn->transferred, addr, src_port);
+        printf("%s", pretty);
+    }
+    else
+    {
+        fprintf(stderr, "uring: dropped client on fd %d\n", conn->client.sock);
+    }
+
+    int sock = conn->client.sock;
+    conn->client.sock = -1;
+    close(sock);
+}
+
+/**
+ * Strips the framing out of a freshly received buffer, leaving only the bytes to echo at the
+ * front of it, and queues it for sending (or recycles it if there's nothing to echo).
+ */
+static void uring_handle_data(uring_server_private* priv, uring_conn* conn, uint32_t bid, uint32_t len)
+{
+    unsigned char* buf = (unsigned char*)priv->bufs + (size_t)bid * URING_BUF_SIZE;
+    uint32_t in = 0;
+    uint32_t out = 0;
+
+    conn->transferred += len;
+    while (in < len && !conn->finished)
+    {
+        if (conn->header_read < sizeof(conn->partial_msg_size))
+        {
+            unsigned char* raw = (unsigned char*)&conn->partial_msg_size;
+            while (in < len && conn->header_read < sizeof(conn->partial_msg_size))
+            {
+                raw[conn->header_read++] = buf[in++];
+            }
+
+            if (conn->header_read == sizeof(conn->partial_msg_size))
+            {
+                conn->body_left = conn->partial_msg_size;
+                if (conn->body_left == 0)
+                {
+                    // Client is finished sending data; the recv finishes once the read side is shut down
+                    conn->finished = 1;
+                    shutdown(conn->client.sock, SHUT_RD);
+                }
+            }
+        }
+        else
+        {
+            uint32_t chunk = len - in < conn->body_left ? len - in : conn->body_left;
+            if (out != in)
+            {
+                memmove(buf + out, buf + in, chunk);
+            }
+            in += chunk;
+            out += chunk;
+            conn->body_left -= chunk;
+            if (conn->body_left == 0)
+            {
+                conn->header_read = 0;
+            }
+        }
+    }
+
+    if (out == 0 || conn->failed)
+    {
+        uring_recycle_buf(priv, bid);
+        return;
+    }
+
+    uring_buf_meta* meta = &priv->meta[bid];
+    meta->next = URING_NO_BUF;
+    meta->offset = 0;
+    meta->len = out;
+    meta->sent = 0;
+    if (conn->send_head == URING_NO_BUF)
+    {
+        conn->send_head = bid;
+    }
+    else
+    {
+        priv->meta[conn->send_tail].next = bid;
+    }
+    conn->send_tail = bid;
+}
+
+static void uring_handle_recv(uring_server_private* priv, struct io_uring_cqe* cqe)
+{
+    uring_conn* conn = uring_get_conn(priv, URING_USER_FD(cqe->user_data));
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        conn->recv_armed = 0;
+    }
+
+    if (cqe->res > 0)
+    {
+        uring_handle_data(priv, conn, cqe->flags >> IORING_CQE_BUFFER_SHIFT, (uint32_t)cqe->res);
+    }
+    else if (cqe->res == 0)
+    {
+        conn->finished = 1;
+    }
+    else if (cqe->res == -ENOBUFS)
+    {
+        // Out of buffers; re-armed once some have been recycled
+        if (!conn->finished && !conn->failed && !conn->starved)
+        {
+            conn->starved = 1;
+            conn->next_starved = priv->starved_head;
+            priv->starved_head = conn->client.sock;
+        }
+    }
+    else if (cqe->res != -ECANCELED)
+    {
+        conn->failed = 1;
+    }
+
+    if (!conn->recv_armed && !conn->starved && !conn->finished && !conn->failed)
+    {
+        // The multishot recv ended on its own (e.g. the kernel ran out of CQ space); start another
+        if (uring_arm_recv(priv, conn) == -1)
+        {
+            conn->failed = 1;
+        }
+    }
+
+    uring_flush_sends(priv, conn);
+    uring_maybe_close(priv, conn);
+}
+
+static void uring_handle_send(uring_server_private* priv, struct io_uring_cqe* cqe)
+{
+    uring_conn* conn = uring_get_conn(priv, URING_USER_FD(cqe->user_data & 0xffffffffffULL));
+    uring_buf_meta* meta = &priv->meta[(uint32_t)(cqe->user_data >> 40)];
+
+    if (cqe->res > 0)
+    {
+        meta->offset += (uint32_t)cqe->res;
+        meta->len -= (uint32_t)cqe->res;
+        meta->sent = meta->len == 0;
+    }
+    else if (cqe->res < 0 && cqe->res != -ECANCELED && !conn->failed)
+    {
+        conn->failed = 1;
+        shutdown(conn->client.sock, SHUT_RDWR);
+    }
+
+    if (--conn->in_flight != 0)
+    {
+        return;
+    }
+
+    // The whole chain has completed; release everything that went out and resend the rest
+    while (conn->send_head != URING_NO_BUF && priv->meta[conn->send_head].sent)
+    {
+        uint32_t bid = conn->send_head;
+        conn->send_head = priv->meta[bid].next;
+        uring_recycle_buf(priv, bid);
+    }
+
+    if (uring_flush_sends(priv, conn) == -1)
+    {
+        conn->failed = 1;
+    }
+    uring_maybe_close(priv, conn);
+}
+
+static void uring_handle_accept(server_t* server, uring_server_private* priv, struct io_uring_cqe* cqe)
+{
+    // Out of fds, so shed a client to say so and leave the accept unarmed until some have closed
+    int out_of_fds = cqe->res == -EMFILE || cqe->res == -ENFILE;
+    if (out_of_fds)
+    {
+        accept_shed(priv->listen_sock);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !atomic_load(&done) &&
+        !(out_of_fds && accept_pause_start(&priv->pause, priv->connected_count)))
+    {
+        uring_arm_accept(priv);
+    }
+
+    if (cqe->res < 0)
+    {
+        if (out_of_fds)
+        {
+            return;
+        }
+        if (cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ECANCELED)
+        {
+            errno = -cqe->res;
+            perror("accept");
+            atomic_store(&done, 1);
+        }
+        return;
+    }
+
+    client_t client;
+    socklen_t peer_len = sizeof(client.peer);
+    client.sock = cqe->res;
+    socket_profile_accepted(client.sock);
+    if (getpeername(client.sock, (struct sockaddr*)&client.peer, &peer_len) == -1)
+    {
+        memset(&client.peer, 0, sizeof(client.peer));
+    }
+
+    if (server->add_client(server, client) == -1)
+    {
+        close(client.sock);
+    }
+}
+
+/**
+ * Re-arms the recvs of connections that ran out of buffers now that some have been returned.
+ */
+static void uring_rearm_starved(uring_server_private* priv)
+{
+    while (priv->starved_head != -1)
+    {
+        uring_conn* conn = uring_get_conn(priv, priv->starved_head);
+        priv->starved_head = conn->next_starved;
+        conn->starved = 0;
+
+        if (conn->finished || conn->failed || uring_arm_recv(priv, conn) == -1)
+        {
+            conn->failed |= !conn->finished;
+            uring_maybe_close(priv, conn);
+        }
+    }
+}
+
+static int uring_map_rings(uring_server_private* priv, struct io_uring_params* params)
+{
+    priv->sq_map_len = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    priv->cq_map_len = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (priv->cq_map_len > priv->sq_map_len)
+        {
+            priv->sq_map_len = priv->cq_map_len;
+        }
+        priv->cq_map_len = priv->sq_map_len;
+    }
+
+    priv->sq_map = mmap(NULL, priv->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        priv->ring_fd, IORING_OFF_SQ_RING);
+    if (priv->sq_map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        priv->cq_map = priv->sq_map;
+    }
+    else
+    {
+        priv->cq_map = mmap(NULL, priv->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            priv->ring_fd, IORING_OFF_CQ_RING);
+        if (priv->cq_map == MAP_FAILED)
+        {
+            return -1;
+        }
+    }
+
+    priv->sqes_map_len = params->sq_entries * sizeof(struct io_uring_sqe);
+    priv->sq.sqes = mmap(NULL, priv->sqes_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         priv->ring_fd, IORING_OFF_SQES);
+    if (priv->sq.sqes == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    char* sq_base = (char*)priv->sq_map;
+    priv->sq.head = (unsigned*)(sq_base + params->sq_off.head);
+    priv->sq.tail = (unsigned*)(sq_base + params->sq_off.tail);
+    priv->sq.array = (unsigned*)(sq_base + params->sq_off.array);
+    priv->sq.mask = *(unsigned*)(sq_base + params->sq_off.ring_mask);
+    priv->sq.entries = *(unsigned*)(sq_base + params->sq_off.ring_entries);
+    priv->sq.local_tail = *priv->sq.tail;
+    priv->sq.submitted_tail = priv->sq.local_tail;
+
+    char* cq_base = (char*)priv->cq_map;
+    priv->cq.head = (unsigned*)(cq_base + params->cq_off.head);
+    priv->cq.tail = (unsigned*)(cq_base + params->cq_off.tail);
+    priv->cq.mask = *(unsigned*)(cq_base + params->cq_off.ring_mask);
+    priv->cq.cqes = (struct io_uring_cqe*)(cq_base + params->cq_off.cqes);
+    return 0;
+}
+
+static int uring_setup_bufs(uring_server_private* priv)
+{
+    priv->buf_ring_len = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    priv->buf_ring = mmap(NULL, priv->buf_ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (priv->buf_ring == MAP_FAILED)
+    {
+        priv->buf_ring = NULL;
+        return -1;
+    }
+
+    priv->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    priv->meta = calloc(URING_BUF_COUNT, sizeof(uring_buf_meta));
+    if (!priv->bufs || !priv->meta)
+    {
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)priv->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (uring_register(priv->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        return -1;
+    }
+
+    priv->buf_tail = 0;
+    for (uint32_t bid = 0; bid < URING_BUF_COUNT; ++bid)
+    {
+        uring_recycle_buf(priv, bid);
+    }
+    uring_publish_bufs(priv);
+    return 0;
+}
+
+/*********************************************************************************************
+FUNCTION
+
+    Name:		uring_server_start
+
+    Prototype:	static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Parameters:
+    server - server struct with server data
+    acceptor - acceptor struct with acceptor data
+    handles_accept - Set to 1, since the multishot accept runs on the server's own ring.
+
+    Return Values:
+    0 when the server stops because of a signal, -1 on failure.
+
+    Description:
+    Sets up the ring and the provided buffers, arms the multishot accept and then reaps
+    completions until the done flag is set.
+
+    Revisions:
+	(none)
+
+*********************************************************************************************/
+static int uring_server_start(server_t* server, acceptor_t* acceptor, int* handles_accept)
+{
+    *handles_accept = 1;
+
+    uring_server_private* priv = calloc(1, sizeof(uring_server_private));
+    if (priv == NULL)
+    {
+        perror("malloc priv");
+        return -1;
+    }
+    priv->ring_fd = -1;
+    priv->starved_head = -1;
+    priv->listen_sock = acceptor->sock;
+    server->private = priv;
+
+    if (vector_init(&priv->conns, sizeof(uring_conn), URING_INITIAL_FDS) == -1)
+    {
+        perror("malloc clients");
+        return -1;
+    }
+    priv->conns.size = priv->conns.cap;
+    for (size_t i = 0; i < priv->conns.cap; ++i)
+    {
+        uring_get_conn(priv, (int)i)->client.sock = -1;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    priv->ring_fd = uring_setup(URING_ENTRIES, &params);
+    if (priv->ring_fd == -1 && errno == EINVAL)
+    {
+        // Older kernel; these flags are only optimisations
+        memset(&params, 0, sizeof(params));
+        priv->ring_fd = uring_setup(URING_ENTRIES, &params);
+    }
+    if (priv->ring_fd == -1)
+    {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    if (uring_map_rings(priv, &params) == -1)
+    {
+        perror("mmap ring");
+        return -1;
+    }
+
+    if (uring_setup_bufs(priv) == -1)
+    {
+        perror("io_uring provided buffers");
+        return -1;
+    }
+
+    if (uring_arm_accept(priv) == -1)
+    {
+        perror("io_uring accept");
+        return -1;
+    }
+
+    int err = 0;
+    while (!atomic_load(&done))
+    {
+        if (uring_submit(priv, 1) == -1)
+        {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                perror("io_uring_enter");
+                err = 1;
+                break;
+            }
+        }
+
+        struct timespec batch_start;
+        clock_gettime(CLOCK_MONOTONIC, &batch_start);
+        unsigned head = *priv->cq.head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned*)priv->cq.tail, memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            struct io_uring_cqe cqe = priv->cq.cqes[head & priv->cq.mask];
+            switch (URING_USER_OP(cqe.user_data))
+            {
+                case URING_OP_ACCEPT:
+                    uring_handle_accept(server, priv, &cqe);
+                break;
+                case URING_OP_RECV:
+                    uring_handle_recv(priv, &cqe);
+                break;
+                case URING_OP_SEND:
+                    uring_handle_send(priv, &cqe);
+                break;
+                default:
+                break;
+            }
+        }
+        atomic_store_explicit((_Atomic unsigned*)priv->cq.head, head, memory_order_release);
+
+        uring_publish_bufs(priv);
+        uring_rearm_starved(priv);
+
+        // The last completion handled waited for every one before it, so that's the latency queueing adds
+        struct timespec batch_end;
+        clock_gettime(CLOCK_MONOTONIC, &batch_end);
+        admission_sample((uint64_t)((batch_end.tv_sec - batch_start.tv_sec) * 1000000000L +
+                                    (batch_end.tv_nsec - batch_start.tv_nsec)), priv->connected_count);
+
+        // Only checked as completions come in, but it's closes (which complete something) that end a pause anyway
+        if (accept_pause_over(&priv->pause, priv->connected_count) && uring_arm_accept(priv) == -1)
+        {
+            perror("io_uring accept");
+            err = 1;
+            break;
+        }
+    }
+
+    return err ? -1 : 0;
+}
+
+static int uring_server_add_client(server_t* server, client_t client)
+{
+    uring_server_private* priv = (uring_server_private*)server->private;
+
+    if (!admission_admit(client.sock, priv->connected_count))
+    {
+        return 0;
+    }
+
+    if ((size_t)client.sock >= priv->conns.cap)
+    {
+        size_t old_cap = priv->conns.cap;
+        size_t new_cap = old_cap * 2 > (size_t)client.sock ? old_cap * 2 : (size_t)client.sock + 1;
+        if (vector_resize(&priv->conns, new_cap) == -1)
+        {
+            perror("vector_resize");
+            return -1;
+        }
+        priv->conns.size = priv->conns.cap;
+        for (size_t i = old_cap; i < priv->conns.cap; ++i)
+        {
+            uring_get_conn(priv, (int)i)->client.sock = -1;
+        }
+    }
+
+    uring_conn* conn = uring_get_conn(priv, client.sock);
+    memset(conn, 0, sizeof(*conn));
+    conn->client = client;
+    conn->send_head = URING_NO_BUF;
+    conn->send_tail = URING_NO_BUF;
+    conn->next_starved = -1;
+    gettimeofday(&conn->start, NULL);
+
+    if (uring_arm_recv(priv, conn) == -1)
+    {
+        perror("io_uring recv");
+        conn->client.sock = -1;
+        return -1;
+    }
+
+    ++priv->connected_count;
+    server_client_added(server, priv->connected_count);
+    return 0;
+}
+
+static void uring_server_cleanup(server_t* server)
+{
+    uring_server_private* priv = (uring_server_private*)server->private;
+    if (!priv)
+    {
+        return;
+    }
+
+    if (priv->conns.items)
+    {
+        for (size_t i = 0; i < priv->conns.cap; ++i)
+        {
+            uring_conn* conn = uring_get_conn(priv, (int)i);
+            if (conn->client.sock != -1)
+            {
+                close(conn->client.sock);
+            }
+        }
+        vector_free(&priv->conns);
+    }
+
+    if (priv->ring_fd != -1)
+    {
+        close(priv->ring_fd);
+    }
+    if (priv->sq.sqes && priv->sq.sqes != MAP_FAILED)
+    {
+        munmap(priv->sq.sqes, priv->sqes_map_len);
+    }
+    if (priv->cq_map && priv->cq_map != MAP_FAILED && priv->cq_map != priv->sq_map)
+    {
+        munmap(priv->cq_map, priv->cq_map_len);
+    }
+    if (priv->sq_map && priv->sq_map != MAP_FAILED)
+    {
+        munmap(priv->sq_map, priv->sq_map_len);
+    }
+    if (priv->buf_ring)
+    {
+        munmap(priv->buf_ring, priv->buf_ring_len);
+    }
+    free(priv->bufs);
+    free(priv->meta);
+    free(priv);
+    server->private = NULL;
+}
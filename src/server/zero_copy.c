@@ -0,0 +1,587 @@
+/*********************************************************************************************
+Name:			zero_copy.c
+
+    Required:	zero_copy.h
+                config.h
+
+    Developer:	Shane Spoor
+
+    Created On: 2026-10-17
+
+    Description:
+    Echo paths that keep message bodies out of user space. Large bodies can be spliced from
+    the client's socket into a pipe and from the pipe straight back to the socket; pipes are
+    pooled so that connections don't pay for pipe2/close each time. Large echoes can also be
+    sent with MSG_ZEROCOPY, in which case the connection holds on to each buffer until the
+    kernel's completion for it arrives on the socket's error queue. Also keeps the echo
+    byte counts per path so that the servers can report throughput and CPU cost per GB.
+
+    Revisions:
+    (none)
+
+*********************************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#include "buffer_pool.h"
+#include "config.h"
+#include "zero_copy.h"
+
+#define SPLICE_POOL_SIZE 1024
+#define SPLICE_PIPE_SIZE (1024 * 1024) // Falls back to the default if above /proc/sys/fs/pipe-max-size
+#define ZEROCOPY_PARK_SECONDS 60       // Longest a closed connection waits for its completions before it's reset
+
+static struct
+{
+    pthread_mutex_t lock;
+    int fds[SPLICE_POOL_SIZE][2];
+    size_t count;
+} pipe_pool = {PTHREAD_MUTEX_INITIALIZER};
+
+static struct
+{
+    atomic_size_t copied;
+    atomic_size_t spliced;
+    atomic_long start_ns; // When the first byte was echoed
+
+    atomic_size_t zc_bytes;
+    atomic_size_t zc_sends;       // send calls made with MSG_ZEROCOPY
+    atomic_size_t zc_completions; // Send calls the kernel has reported done
+    atomic_size_t zc_copied;      // ...of which the kernel had to copy anyway (e.g. over loopback)
+    atomic_size_t zc_fallbacks;   // Sends that fell back to copying because zero-copy was unavailable
+    atomic_size_t zc_parked;      // Connections closed while the kernel still held some of their buffers
+    atomic_size_t zc_reset;       // ...of which had to be reset before their buffers could be released
+} echo_stats;
+
+void splice_pipe_init(splice_pipe_t* pipe)
+{
+    pipe->fds[0] = -1;
+    pipe->fds[1] = -1;
+    pipe->queued = 0;
+}
+
+int splice_wanted(size_t msg_size)
+{
+    return server_config.splice_threshold && msg_size >= server_config.splice_threshold;
+}
+
+/**
+ * Takes a pipe from the pool, or creates one if the pool is empty.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int splice_pipe_acquire(splice_pipe_t* pipe)
+{
+    pthread_mutex_lock(&pipe_pool.lock);
+    if (pipe_pool.count > 0)
+    {
+        --pipe_pool.count;
+        pipe->fds[0] = pipe_pool.fds[pipe_pool.count][0];
+        pipe->fds[1] = pipe_pool.fds[pipe_pool.count][1];
+        pthread_mutex_unlock(&pipe_pool.lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&pipe_pool.lock);
+
+    if (pipe2(pipe->fds, O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        pipe->fds[0] = -1;
+        pipe->fds[1] = -1;
+        return -1;
+    }
+
+    // A bigger pipe moves a large body in fewer splices; failing just leaves the default size
+    fcntl(pipe->fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    return 0;
+}
+
+void splice_pipe_release(splice_pipe_t* pipe)
+{
+    if (pipe->fds[0] == -1)
+    {
+        return;
+    }
+
+    // A pipe with data left in it would leak that data into the next connection's echo
+    if (pipe->queued == 0)
+    {
+        pthread_mutex_lock(&pipe_pool.lock);
+        if (pipe_pool.count < SPLICE_POOL_SIZE)
+        {
+            pipe_pool.fds[pipe_pool.count][0] = pipe->fds[0];
+            pipe_pool.fds[pipe_pool.count][1] = pipe->fds[1];
+            ++pipe_pool.count;
+            pthread_mutex_unlock(&pipe_pool.lock);
+            splice_pipe_init(pipe);
+            return;
+        }
+        pthread_mutex_unlock(&pipe_pool.lock);
+    }
+
+    close(pipe->fds[0]);
+    close(pipe->fds[1]);
+    splice_pipe_init(pipe);
+}
+
+ssize_t splice_drain(int sock, splice_pipe_t* pipe)
+{
+    if (pipe->queued == 0)
+    {
+        return 0;
+    }
+
+    // splice has no MSG_NOSIGNAL, and SIGPIPE is fatal to the server, so it's held off while writing to the socket
+    sigset_t pipe_set;
+    sigset_t old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    size_t sent_total = 0;
+    ssize_t result = 0;
+    while (pipe->queued > 0)
+    {
+        ssize_t bytes_out = splice(pipe->fds[0], NULL, sock, NULL, pipe->queued, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes_out == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break; // The rest waits in the pipe until the socket is writable
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        pipe->queued -= (size_t)bytes_out;
+        sent_total += (size_t)bytes_out;
+    }
+
+    int saved_errno = errno;
+    if (result == -1 && errno == EPIPE && !sigismember(&old_set, SIGPIPE))
+    {
+        // The failed splice raised SIGPIPE for this thread; take it before unblocking
+        struct timespec none = {0, 0};
+        sigtimedwait(&pipe_set, NULL, &none);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    errno = saved_errno;
+
+    return result == -1 ? -1 : (ssize_t)sent_total;
+}
+
+ssize_t splice_echo(int sock, splice_pipe_t* pipe, size_t bytes_to_echo, int* eof)
+{
+    if (pipe->fds[0] == -1 && splice_pipe_acquire(pipe) == -1)
+    {
+        return -1;
+    }
+
+    *eof = 0;
+    if (splice_drain(sock, pipe) == -1)
+    {
+        return -1;
+    }
+
+    // Nothing more is read while the pipe still holds data the socket wouldn't take
+    size_t read_total = 0;
+    while (pipe->queued == 0 && read_total < bytes_to_echo)
+    {
+        ssize_t bytes_in = splice(sock, NULL, pipe->fds[1], NULL, bytes_to_echo - read_total,
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes_in == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break; // The socket ran dry (or the pipe is full, but it was just drained)
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        else if (bytes_in == 0)
+        {
+            *eof = 1;
+            break;
+        }
+        read_total += (size_t)bytes_in;
+        pipe->queued += (size_t)bytes_in;
+
+        // Empty the pipe back into the socket before reading more
+        if (splice_drain(sock, pipe) == -1)
+        {
+            return -1;
+        }
+    }
+
+    echo_stats_add(0, read_total);
+    return (ssize_t)read_total;
+}
+
+/**
+ * Starts the throughput clock if this is the first echo.
+ */
+static void echo_stats_start(void)
+{
+    if (atomic_load_explicit(&echo_stats.start_ns, memory_order_relaxed) == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long expected = 0;
+        atomic_compare_exchange_strong(&echo_stats.start_ns, &expected, now.tv_sec * 1000000000L + now.tv_nsec);
+    }
+}
+
+void zerocopy_init(zerocopy_state_t* state)
+{
+    state->enabled = 0;
+    state->next_seq = 0;
+    state->pending.items = NULL;
+    state->pending.size = 0;
+}
+
+int zerocopy_wanted(size_t msg_size)
+{
+    return server_config.zerocopy_threshold && msg_size >= server_config.zerocopy_threshold;
+}
+
+int zerocopy_send(int sock, zerocopy_state_t* state, output_queue_t* output, char* buf, char const* data, size_t len)
+{
+    if (state->enabled == 0)
+    {
+        int one = 1;
+        state->enabled = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 ? 1 : -1;
+    }
+    if (state->enabled == 1 && state->pending.items == NULL &&
+        vector_init(&state->pending, sizeof(zerocopy_buf_t), 0) == -1)
+    {
+        state->pending.items = NULL;
+        return -1;
+    }
+
+    int flags = state->enabled == 1 ? MSG_ZEROCOPY : 0;
+    uint32_t sends = 0;
+    size_t sent_total = 0;
+    int failed = 0;
+    while (sent_total < len)
+    {
+        ssize_t bytes_sent = send(sock, data + sent_total, len - sent_total, flags | MSG_NOSIGNAL);
+        if (bytes_sent == -1)
+        {
+            if (errno == ENOBUFS && flags)
+            {
+                // Out of optmem for pinning pages; copy the rest instead
+                flags = 0;
+                atomic_fetch_add(&echo_stats.zc_fallbacks, 1);
+                continue;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            failed = errno != EWOULDBLOCK && errno != EAGAIN;
+            break;
+        }
+        sent_total += (size_t)bytes_sent;
+        sends += flags ? 1 : 0;
+    }
+
+    // Whatever the socket won't take yet is copied out of buf, to go with the rest of the connection's output
+    size_t unsent = len - sent_total;
+    if (!failed && unsent > 0)
+    {
+        if (output_queue_append(output, data + sent_total, unsent) == -1)
+        {
+            perror("output_queue_append");
+            failed = 1;
+        }
+        else
+        {
+            echo_stats_add(unsent, 0);
+        }
+    }
+
+    if (sends == 0)
+    {
+        // The kernel never saw the buffer zero-copy, so it can go straight away
+        if (state->enabled != 1)
+        {
+            atomic_fetch_add(&echo_stats.zc_fallbacks, 1);
+        }
+        buffer_free(buf);
+        if (failed)
+        {
+            return -1;
+        }
+        echo_stats_add(sent_total, 0);
+        return 0;
+    }
+
+    // The kernel may still read from data even if the send failed part way, so it's held either way
+    state->next_seq += sends;
+    zerocopy_buf_t held = {buf, state->next_seq - 1};
+    if (vector_push_back(&state->pending, &held) == -1)
+    {
+        perror("zerocopy pending");
+        return -1; // Leaks buf rather than free memory the kernel might be reading
+    }
+    atomic_fetch_add(&echo_stats.zc_sends, sends);
+    echo_stats_start();
+    atomic_fetch_add(&echo_stats.zc_bytes, sent_total);
+    return failed ? -1 : 0;
+}
+
+int zerocopy_reap(int sock, zerocopy_state_t* state)
+{
+    while (state->pending.size > 0)
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE) == -1)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+
+            struct sock_extended_err* err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0)
+            {
+                continue;
+            }
+
+            // The notification covers sends ee_info through ee_data
+            uint32_t count = err->ee_data - err->ee_info + 1;
+            atomic_fetch_add(&echo_stats.zc_completions, count);
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                atomic_fetch_add(&echo_stats.zc_copied, count);
+            }
+
+            zerocopy_buf_t* held = (zerocopy_buf_t*)state->pending.items;
+            size_t released = 0;
+            while (released < state->pending.size && (int32_t)(held[released].last_seq - err->ee_data) <= 0)
+            {
+                buffer_free(held[released].buf);
+                ++released;
+            }
+            memmove(held, held + released, (state->pending.size - released) * sizeof(zerocopy_buf_t));
+            state->pending.size -= released;
+        }
+    }
+    return 0;
+}
+
+void zerocopy_release(zerocopy_state_t* state)
+{
+    if (state->pending.items == NULL)
+    {
+        return;
+    }
+
+    zerocopy_buf_t* held = (zerocopy_buf_t*)state->pending.items;
+    for (size_t i = 0; i < state->pending.size; ++i)
+    {
+        buffer_free(held[i].buf);
+    }
+    vector_free(&state->pending);
+    zerocopy_init(state);
+}
+
+/**
+ * A closed connection's socket and the zero-copy buffers it may still be sending from.
+ */
+typedef struct
+{
+    int sock;
+    time_t parked_at; // CLOCK_MONOTONIC_COARSE seconds
+    zerocopy_state_t state;
+} zerocopy_parked_t;
+
+int zerocopy_parking_init(zerocopy_parking_t* parking)
+{
+    if (vector_init(&parking->parked, sizeof(zerocopy_parked_t), 0) == -1)
+    {
+        return -1;
+    }
+    pthread_mutex_init(&parking->lock, NULL);
+    return 0;
+}
+
+/**
+ * Resets the socket so that the kernel drops everything it still had queued to send from the connection's buffers,
+ * then releases them.
+ */
+static void zerocopy_reset(int sock, zerocopy_state_t* state)
+{
+    struct linger linger = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, (socklen_t)sizeof(linger));
+    close(sock);
+    zerocopy_release(state);
+    atomic_fetch_add(&echo_stats.zc_reset, 1);
+}
+
+void zerocopy_park(zerocopy_parking_t* parking, int sock, zerocopy_state_t* state)
+{
+    if (state->pending.size > 0)
+    {
+        // The completions may be in already
+        zerocopy_reap(sock, state);
+    }
+    if (state->pending.size == 0)
+    {
+        close(sock);
+        zerocopy_release(state);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    zerocopy_parked_t parked = {sock, now.tv_sec, *state};
+    shutdown(sock, SHUT_RDWR);
+
+    pthread_mutex_lock(&parking->lock);
+    int pushed = vector_push_back(&parking->parked, &parked);
+    pthread_mutex_unlock(&parking->lock);
+    if (pushed == -1)
+    {
+        perror("zerocopy park");
+        zerocopy_reset(sock, state);
+    }
+    else
+    {
+        atomic_fetch_add(&echo_stats.zc_parked, 1);
+    }
+    zerocopy_init(state);
+}
+
+void zerocopy_parking_reap(zerocopy_parking_t* parking, int force)
+{
+    pthread_mutex_lock(&parking->lock);
+    if (parking->parked.size == 0)
+    {
+        pthread_mutex_unlock(&parking->lock);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    zerocopy_parked_t* parked = (zerocopy_parked_t*)parking->parked.items;
+    size_t kept = 0;
+    for (size_t i = 0; i < parking->parked.size; ++i)
+    {
+        if (zerocopy_reap(parked[i].sock, &parked[i].state) == -1 || force ||
+            now.tv_sec - parked[i].parked_at >= ZEROCOPY_PARK_SECONDS)
+        {
+            if (parked[i].state.pending.size > 0)
+            {
+                zerocopy_reset(parked[i].sock, &parked[i].state);
+                continue;
+            }
+        }
+        if (parked[i].state.pending.size == 0)
+        {
+            close(parked[i].sock);
+            zerocopy_release(&parked[i].state);
+            continue;
+        }
+        parked[kept++] = parked[i];
+    }
+    parking->parked.size = kept;
+    pthread_mutex_unlock(&parking->lock);
+}
+
+void zerocopy_parking_release(zerocopy_parking_t* parking)
+{
+    if (parking->parked.items == NULL)
+    {
+        return;
+    }
+    zerocopy_parking_reap(parking, 1);
+    vector_free(&parking->parked);
+    parking->parked.items = NULL;
+    pthread_mutex_destroy(&parking->lock);
+}
+
+void echo_stats_add(size_t copied, size_t spliced)
+{
+    echo_stats_start();
+
+    if (copied)
+    {
+        atomic_fetch_add_explicit(&echo_stats.copied, copied, memory_order_relaxed);
+    }
+    if (spliced)
+    {
+        atomic_fetch_add_explicit(&echo_stats.spliced, spliced, memory_order_relaxed);
+    }
+}
+
+int echo_stats_report(char* buf, size_t len)
+{
+    size_t copied = atomic_load(&echo_stats.copied);
+    size_t spliced = atomic_load(&echo_stats.spliced);
+    size_t zc_bytes = atomic_load(&echo_stats.zc_bytes);
+    long start_ns = atomic_load(&echo_stats.start_ns);
+    if (start_ns == 0)
+    {
+        return snprintf(buf, len, "Echoed: nothing\n");
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (double)(now.tv_sec * 1000000000L + now.tv_nsec - start_ns) / 1e9;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu = (double)usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                 (double)usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    size_t total = copied + spliced + zc_bytes;
+    double gb = (double)total / 1e9;
+    int written = snprintf(buf, len, "Echoed: %zu bytes copied, %zu bytes spliced, %zu bytes zero-copy; %.1f MB/s; "
+                                     "%.2f CPU s/GB (%.2fs CPU)\n",
+                           copied, spliced, zc_bytes, seconds > 0 ? (double)total / 1e6 / seconds : 0.0,
+                           gb > 0 ? cpu / gb : 0.0, cpu);
+
+    size_t zc_sends = atomic_load(&echo_stats.zc_sends);
+    size_t zc_fallbacks = atomic_load(&echo_stats.zc_fallbacks);
+    if ((zc_sends || zc_fallbacks) && written > 0 && (size_t)written < len)
+    {
+        written += snprintf(buf + written, len - (size_t)written,
+                            "Zero-copy: %zu sends, %zu completed (%zu copied by the kernel), %zu fallbacks to copying; "
+                            "%zu closed connections parked for completions, %zu reset\n",
+                            zc_sends, atomic_load(&echo_stats.zc_completions), atomic_load(&echo_stats.zc_copied),
+                            zc_fallbacks, atomic_load(&echo_stats.zc_parked), atomic_load(&echo_stats.zc_reset));
+    }
+    return written;
+}
@@ -0,0 +1,340 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+
+#define MIN_CLASS_SHIFT 6                                  // 64 B
+#define MAX_CLASS_SHIFT 20                                 // 1 MiB
+#define NUM_CLASSES     (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1)
+#define OVERSIZE_CLASS  UINT32_MAX
+#define MAGAZINE_SIZE   32
+#define DEPOT_BYTES_MAX (32 * 1024 * 1024)                 // Per class; anything beyond goes back to malloc
+
+typedef struct
+{
+    size_t capacity;
+    uint32_t size_class;
+    uint32_t pad;
+} buffer_header; // Keeps the buffer itself 16-byte aligned
+
+typedef struct magazine
+{
+    size_t rounds;
+    void* items[MAGAZINE_SIZE];
+    struct magazine* next;
+} magazine;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    magazine* full;  // Magazines with at least one buffer in them
+    magazine* empty;
+    size_t full_count;
+    size_t max_full;
+} depot;
+
+typedef struct
+{
+    // Two magazines per class so that alternating alloc/free at a magazine boundary doesn't thrash the depot
+    magazine* loaded[NUM_CLASSES];
+    magazine* previous[NUM_CLASSES];
+} thread_cache;
+
+static depot depots[NUM_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static _Thread_local thread_cache* local_cache;
+
+static struct
+{
+    atomic_size_t allocs;
+    atomic_size_t frees;
+    atomic_size_t depot_hits;
+    atomic_size_t misses;
+    atomic_size_t oversize;
+    atomic_size_t cached_bytes;
+} stats;
+
+/**
+ * Hands a magazine to the depot, releasing its buffers to malloc instead if the depot already holds enough.
+ */
+static void depot_put(size_t size_class, magazine* mag)
+{
+    depot* d = &depots[size_class];
+    size_t class_bytes = (size_t)1 << (size_class + MIN_CLASS_SHIFT);
+
+    pthread_mutex_lock(&d->lock);
+    if (mag->rounds == 0)
+    {
+        mag->next = d->empty;
+        d->empty = mag;
+        pthread_mutex_unlock(&d->lock);
+        return;
+    }
+    if (d->full_count < d->max_full)
+    {
+        mag->next = d->full;
+        d->full = mag;
+        ++d->full_count;
+        pthread_mutex_unlock(&d->lock);
+        atomic_fetch_add_explicit(&stats.cached_bytes, mag->rounds * class_bytes, memory_order_relaxed);
+        return;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    for (size_t i = 0; i < mag->rounds; ++i)
+    {
+        free((buffer_header*)mag->items[i] - 1);
+    }
+    free(mag);
+}
+
+/**
+ * Takes a non-empty magazine from the depot, or NULL if there isn't one.
+ */
+static magazine* depot_get_full(size_t size_class)
+{
+    depot* d = &depots[size_class];
+    pthread_mutex_lock(&d->lock);
+    magazine* mag = d->full;
+    if (mag)
+    {
+        d->full = mag->next;
+        --d->full_count;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    if (mag)
+    {
+        size_t class_bytes = (size_t)1 << (size_class + MIN_CLASS_SHIFT);
+        atomic_fetch_sub_explicit(&stats.cached_bytes, mag->rounds * class_bytes, memory_order_relaxed);
+    }
+    return mag;
+}
+
+/**
+ * Takes an empty magazine from the depot, allocating one if it has none.
+ */
+static magazine* depot_get_empty(size_t size_class)
+{
+    depot* d = &depots[size_class];
+    pthread_mutex_lock(&d->lock);
+    magazine* mag = d->empty;
+    if (mag)
+    {
+        d->empty = mag->next;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    if (!mag && (mag = malloc(sizeof(magazine))))
+    {
+        mag->rounds = 0;
+    }
+    return mag;
+}
+
+/**
+ * Returns an exiting thread's magazines to the depot.
+ */
+static void cache_destroy(void* void_cache)
+{
+    thread_cache* cache = (thread_cache*)void_cache;
+    for (size_t i = 0; i < NUM_CLASSES; ++i)
+    {
+        if (cache->loaded[i])
+        {
+            depot_put(i, cache->loaded[i]);
+        }
+        if (cache->previous[i])
+        {
+            depot_put(i, cache->previous[i]);
+        }
+    }
+    free(cache);
+}
+
+static void pool_init(void)
+{
+    pthread_key_create(&cache_key, cache_destroy);
+    for (size_t i = 0; i < NUM_CLASSES; ++i)
+    {
+        pthread_mutex_init(&depots[i].lock, NULL);
+        size_t magazine_bytes = MAGAZINE_SIZE * ((size_t)1 << (i + MIN_CLASS_SHIFT));
+        depots[i].max_full = DEPOT_BYTES_MAX / magazine_bytes;
+        depots[i].max_full = depots[i].max_full < 2 ? 2 : depots[i].max_full;
+    }
+}
+
+/**
+ * Returns the calling thread's cache, creating it the first time. NULL if out of memory.
+ */
+static thread_cache* get_cache(void)
+{
+    if (local_cache)
+    {
+        return local_cache;
+    }
+
+    pthread_once(&pool_once, pool_init);
+    thread_cache* cache = calloc(1, sizeof(thread_cache));
+    if (cache && pthread_setspecific(cache_key, cache) != 0)
+    {
+        free(cache);
+        cache = NULL;
+    }
+    local_cache = cache;
+    return cache;
+}
+
+/**
+ * Returns the smallest size class that holds size bytes, or OVERSIZE_CLASS.
+ */
+static uint32_t size_class_of(size_t size)
+{
+    if (size > ((size_t)1 << MAX_CLASS_SHIFT))
+    {
+        return OVERSIZE_CLASS;
+    }
+
+    uint32_t shift = MIN_CLASS_SHIFT;
+    while (((size_t)1 << shift) < size)
+    {
+        ++shift;
+    }
+    return shift - MIN_CLASS_SHIFT;
+}
+
+/**
+ * Gets a fresh buffer from malloc.
+ */
+static void* buffer_create(size_t capacity, uint32_t size_class)
+{
+    buffer_header* header = malloc(sizeof(buffer_header) + capacity);
+    if (!header)
+    {
+        return NULL;
+    }
+    header->capacity = capacity;
+    header->size_class = size_class;
+    return header + 1;
+}
+
+void* buffer_alloc(size_t size)
+{
+    uint32_t size_class = size_class_of(size);
+    atomic_fetch_add_explicit(&stats.allocs, 1, memory_order_relaxed);
+    thread_cache* cache = size_class == OVERSIZE_CLASS ? NULL : get_cache();
+    if (!cache)
+    {
+        atomic_fetch_add_explicit(&stats.oversize, size_class == OVERSIZE_CLASS, memory_order_relaxed);
+        return buffer_create(size, OVERSIZE_CLASS);
+    }
+
+    magazine* loaded = cache->loaded[size_class];
+    if (!loaded || loaded->rounds == 0)
+    {
+        magazine* previous = cache->previous[size_class];
+        if (previous && previous->rounds > 0)
+        {
+            cache->previous[size_class] = loaded;
+            cache->loaded[size_class] = loaded = previous;
+        }
+        else
+        {
+            magazine* full = depot_get_full(size_class);
+            if (!full)
+            {
+                atomic_fetch_add_explicit(&stats.misses, 1, memory_order_relaxed);
+                return buffer_create((size_t)1 << (size_class + MIN_CLASS_SHIFT), size_class);
+            }
+
+            atomic_fetch_add_explicit(&stats.depot_hits, 1, memory_order_relaxed);
+            if (previous)
+            {
+                depot_put(size_class, previous);
+            }
+            cache->previous[size_class] = loaded;
+            cache->loaded[size_class] = loaded = full;
+        }
+    }
+
+    return loaded->items[--loaded->rounds];
+}
+
+void buffer_free(void* buf)
+{
+    if (!buf)
+    {
+        return;
+    }
+
+    buffer_header* header = (buffer_header*)buf - 1;
+    uint32_t size_class = header->size_class;
+    atomic_fetch_add_explicit(&stats.frees, 1, memory_order_relaxed);
+    thread_cache* cache = size_class == OVERSIZE_CLASS ? NULL : get_cache();
+    if (!cache)
+    {
+        free(header);
+        return;
+    }
+
+    magazine* loaded = cache->loaded[size_class];
+    if (!loaded || loaded->rounds == MAGAZINE_SIZE)
+    {
+        magazine* previous = cache->previous[size_class];
+        if (loaded && previous && previous->rounds < MAGAZINE_SIZE)
+        {
+            cache->previous[size_class] = loaded;
+            cache->loaded[size_class] = loaded = previous;
+        }
+        else
+        {
+            magazine* empty = depot_get_empty(size_class);
+            if (!empty)
+            {
+                free(header);
+                return;
+            }
+
+            if (previous)
+            {
+                depot_put(size_class, previous);
+            }
+            cache->previous[size_class] = loaded;
+            cache->loaded[size_class] = loaded = empty;
+        }
+    }
+
+    loaded->items[loaded->rounds++] = buf;
+}
+
+size_t buffer_capacity(void const* buf)
+{
+    return ((buffer_header const*)buf - 1)->capacity;
+}
+
+void buffer_pool_stats(buffer_pool_stats_t* out)
+{
+    out->allocs = atomic_load(&stats.allocs);
+    out->frees = atomic_load(&stats.frees);
+    out->depot_hits = atomic_load(&stats.depot_hits);
+    out->misses = atomic_load(&stats.misses);
+    out->oversize = atomic_load(&stats.oversize);
+    out->cached_bytes = atomic_load(&stats.cached_bytes);
+}
+
+int buffer_pool_report(char* buf, size_t len)
+{
+    buffer_pool_stats_t s;
+    buffer_pool_stats(&s);
+
+    size_t hits = s.allocs > s.misses + s.oversize ? s.allocs - s.misses - s.oversize : 0;
+    return snprintf(buf, len, "Buffer pool: %zu allocs, %zu frees; %zu from the depot, %zu from malloc, %zu oversize; "
+                              "%.1f%% hit rate; %zu KiB in the depot\n",
+                    s.allocs, s.frees, s.depot_hits, s.misses, s.oversize,
+                    s.allocs ? 100.0 * (double)hits / (double)s.allocs : 0.0, s.cached_bytes / 1024);
+}
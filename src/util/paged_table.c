@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+
+#include "paged_table.h"
+
+int paged_table_init(paged_table_t* table, size_t item_size, size_t capacity)
+{
+    table->num_pages = (capacity + PAGED_TABLE_PAGE_SIZE - 1) >> PAGED_TABLE_PAGE_SHIFT;
+    table->item_size = item_size;
+    atomic_store(&table->pages_allocated, 0);
+    table->pages = calloc(table->num_pages ? table->num_pages : 1, sizeof(*table->pages));
+    if (table->pages == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_init(&table->lock, NULL);
+    return 0;
+}
+
+void* paged_table_slot(paged_table_t* table, size_t index)
+{
+    size_t page_index = index >> PAGED_TABLE_PAGE_SHIFT;
+    if (page_index >= table->num_pages)
+    {
+        return NULL;
+    }
+
+    char* page = atomic_load_explicit(&table->pages[page_index], memory_order_acquire);
+    if (page == NULL)
+    {
+        // Another thread may have got here first, so check again under the lock
+        pthread_mutex_lock(&table->lock);
+        page = atomic_load_explicit(&table->pages[page_index], memory_order_relaxed);
+        if (page == NULL)
+        {
+            page = calloc(PAGED_TABLE_PAGE_SIZE, table->item_size);
+            if (page)
+            {
+                atomic_store_explicit(&table->pages[page_index], page, memory_order_release);
+                atomic_fetch_add(&table->pages_allocated, 1);
+            }
+        }
+        pthread_mutex_unlock(&table->lock);
+        if (page == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    return page + (index & (PAGED_TABLE_PAGE_SIZE - 1)) * table->item_size;
+}
+
+void* paged_table_find(paged_table_t* table, size_t index)
+{
+    size_t page_index = index >> PAGED_TABLE_PAGE_SHIFT;
+    if (page_index >= table->num_pages)
+    {
+        return NULL;
+    }
+
+    char* page = atomic_load_explicit(&table->pages[page_index], memory_order_acquire);
+    return page ? page + (index & (PAGED_TABLE_PAGE_SIZE - 1)) * table->item_size : NULL;
+}
+
+size_t paged_table_bytes(paged_table_t* table)
+{
+    return atomic_load(&table->pages_allocated) * PAGED_TABLE_PAGE_SIZE * table->item_size;
+}
+
+void paged_table_free(paged_table_t* table)
+{
+    if (table->pages == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < table->num_pages; ++i)
+    {
+        free(atomic_load(&table->pages[i]));
+    }
+    free(table->pages);
+    table->pages = NULL;
+    pthread_mutex_destroy(&table->lock);
+}
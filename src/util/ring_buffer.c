@@ -1,70 +1,136 @@
-#include <stdatomic.h>
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include "ring_buffer.h"
 
-void ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size)
+int ring_buffer_init(ring_buffer_t* buf, void* mem, size_t size, size_t elem_size)
 {
     buf->mem = mem;
     buf->size = size;
     buf->elem_size = elem_size;
     buf->head = 0;
     buf->tail = 0;
-    buf->reader_guard = 0;
+    buf->closed = 0;
+
+    if (pthread_mutex_init(&buf->lock, NULL) != 0)
+    {
+        return -1;
+    }
+    if (pthread_cond_init(&buf->not_empty, NULL) != 0)
+    {
+        pthread_mutex_destroy(&buf->lock);
+        return -1;
+    }
+    if (pthread_cond_init(&buf->not_full, NULL) != 0)
+    {
+        pthread_cond_destroy(&buf->not_empty);
+        pthread_mutex_destroy(&buf->lock);
+        return -1;
+    }
+    return 0;
+}
+
+int ring_buffer_put(ring_buffer_t* buf, void* item)
+{
+    pthread_mutex_lock(&buf->lock);
+    while (buf->tail - buf->head == buf->size && !buf->closed)
+    {
+        pthread_cond_wait(&buf->not_full, &buf->lock);
+    }
+
+    if (buf->closed)
+    {
+        pthread_mutex_unlock(&buf->lock);
+        return -1;
+    }
+
+    size_t pos = (buf->tail % buf->size) * buf->elem_size;
+    memcpy((unsigned char*)buf->mem + pos, item, buf->elem_size);
+    ++buf->tail;
+
+    pthread_mutex_unlock(&buf->lock);
+    pthread_cond_signal(&buf->not_empty);
+    return 0;
+}
+
+/**
+ * Takes the item at the head of the buffer. The buffer must be locked and non-empty; it is unlocked on return.
+ */
+static void ring_buffer_take(ring_buffer_t* buf, void* out)
+{
+    size_t pos = (buf->head % buf->size) * buf->elem_size;
+    memcpy(out, (unsigned char*)buf->mem + pos, buf->elem_size);
+    ++buf->head;
+
+    pthread_mutex_unlock(&buf->lock);
+    pthread_cond_signal(&buf->not_full);
 }
 
-void ring_buffer_put(ring_buffer_t* buf, void* item)
+int ring_buffer_get(ring_buffer_t* buf, void* out)
 {
-    int wrote = 0;
-    do
+    pthread_mutex_lock(&buf->lock);
+    while (buf->head == buf->tail && !buf->closed)
     {
-        size_t head = atomic_load(&buf->head);
-        size_t tail = atomic_load(&buf->tail);
-        size_t diff = tail - head; // This will eventually wrap around, but we're unlikely to hit that case ¯\_(ツ)_/¯
-
-        if (diff < buf->size &&
-            atomic_compare_exchange_strong(&buf->tail, &tail, tail + 1))
-        {
-            // There was space for another element in the buffer and we successfully added to tail,
-            // so we can safely write to the buffer... probably
-            size_t pos = (tail % buf->size) * buf->elem_size;
-            unsigned char* dest = (unsigned char*)buf->mem + pos;
-            memcpy(dest, item, buf->elem_size);
-
-            wrote = 1;
-            atomic_store_explicit(&buf->reader_guard, 1, memory_order_release);
-        }
-    } while (!wrote);
+        pthread_cond_wait(&buf->not_empty, &buf->lock);
+    }
+
+    if (buf->head == buf->tail)
+    {
+        // Closed and drained
+        pthread_mutex_unlock(&buf->lock);
+        return -1;
+    }
+
+    ring_buffer_take(buf, out);
+    return 0;
 }
 
-void ring_buffer_get(ring_buffer_t* buf, void* out)
+int ring_buffer_timed_get(ring_buffer_t* buf, void* out, unsigned long timeout_ms)
 {
-    int read = 0;
-    do
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int result = 0;
+    pthread_mutex_lock(&buf->lock);
+    while (buf->head == buf->tail && !buf->closed && result != ETIMEDOUT)
+    {
+        result = pthread_cond_timedwait(&buf->not_empty, &buf->lock, &deadline);
+    }
+
+    if (buf->head == buf->tail)
     {
-        // TODO: Do we actually need memory_order_acquire for head? Only one thread ever modifies it (or should, at least)
-        size_t head = atomic_load(&buf->head);
-        size_t tail = atomic_load(&buf->tail);
-
-        // There's no data to read - set the reader guard to 0 so that we'll block until some other thread writes
-        if (head == tail)
-        {
-            atomic_store(&buf->reader_guard, 0); // Not sure if this needs to be sequentially consistent
-            break;
-        }
-        else
-        {
-            // Also not sure if this needs to be sequentially consistent (provided that the store to reader_guard is
-            int reader_guard = atomic_load_explicit(&buf->reader_guard, memory_order_acquire);
-            if (reader_guard)
-            {
-                unsigned char* mem = (unsigned char*)buf->mem;
-                size_t pos = (head % buf->size) * buf->elem_size;
-                memcpy(out, mem + pos, buf->elem_size);
-
-                atomic_store_explicit(&buf->head, head + 1, memory_order_release);
-                read = 1;
-            }
-        }
-    } while(!read);
-}
\ No newline at end of file
+        pthread_mutex_unlock(&buf->lock);
+        errno = buf->closed ? EPIPE : ETIMEDOUT;
+        return -1;
+    }
+
+    ring_buffer_take(buf, out);
+    return 0;
+}
+
+void ring_buffer_close(ring_buffer_t* buf)
+{
+    pthread_mutex_lock(&buf->lock);
+    buf->closed = 1;
+    pthread_mutex_unlock(&buf->lock);
+
+    pthread_cond_broadcast(&buf->not_empty);
+    pthread_cond_broadcast(&buf->not_full);
+}
+
+void ring_buffer_destroy(ring_buffer_t* buf)
+{
+    pthread_cond_destroy(&buf->not_full);
+    pthread_cond_destroy(&buf->not_empty);
+    pthread_mutex_destroy(&buf->lock);
+}
@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+void timer_wheel_init(timer_wheel_t* wheel, uint32_t now)
+{
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->now = now;
+    wheel->count = 0;
+}
+
+/**
+ * Links a node into the slot for its expiry. The expiry has to be no earlier than the wheel's current tick; one equal
+ * to it only happens while moving timers down, just before the current level 0 slot is fired.
+ */
+static void timer_wheel_link(timer_wheel_t* wheel, timer_node_t* node)
+{
+    uint32_t delta = node->expires - wheel->now;
+    unsigned int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1)))
+    {
+        ++level;
+    }
+
+    timer_node_t** slot = &wheel->slots[level][(node->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK];
+    node->next = *slot;
+    if (node->next)
+    {
+        node->next->pprev = &node->next;
+    }
+    node->pprev = slot;
+    *slot = node;
+}
+
+/**
+ * Unlinks a scheduled node from its slot.
+ */
+static void timer_wheel_unlink(timer_node_t* node)
+{
+    *node->pprev = node->next;
+    if (node->next)
+    {
+        node->next->pprev = node->pprev;
+    }
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_node_t* node, uint32_t delay)
+{
+    if (node->pprev)
+    {
+        timer_wheel_unlink(node);
+    }
+    else
+    {
+        ++wheel->count;
+    }
+
+    delay = delay == 0 ? 1 : delay > TIMER_WHEEL_MAX ? TIMER_WHEEL_MAX : delay;
+    node->expires = wheel->now + delay;
+    timer_wheel_link(wheel, node);
+}
+
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_node_t* node)
+{
+    if (node->pprev)
+    {
+        timer_wheel_unlink(node);
+        --wheel->count;
+    }
+}
+
+int timer_node_pending(timer_node_t const* node)
+{
+    return node->pprev != NULL;
+}
+
+/**
+ * Moves every timer in one slot of a higher level down to the levels below, now that the wheel has reached the span
+ * that slot covers.
+ */
+static void timer_wheel_cascade(timer_wheel_t* wheel, unsigned int level, unsigned int index)
+{
+    timer_node_t* node = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while (node)
+    {
+        timer_node_t* next = node->next;
+        timer_wheel_link(wheel, node);
+        node = next;
+    }
+}
+
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint32_t now, timer_fn fn, void* arg)
+{
+    size_t fired = 0;
+    while (wheel->now != now)
+    {
+        if (wheel->count == 0)
+        {
+            // Nothing to fire or move down on the way, so skip straight there
+            wheel->now = now;
+            break;
+        }
+
+        uint32_t tick = ++wheel->now;
+        for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+        {
+            // Each level comes round once the ones below have all wrapped
+            if ((tick >> (TIMER_WHEEL_BITS * (level - 1))) & TIMER_SLOT_MASK)
+            {
+                break;
+            }
+            timer_wheel_cascade(wheel, level, (tick >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK);
+        }
+
+        timer_node_t** slot = &wheel->slots[0][tick & TIMER_SLOT_MASK];
+        while (*slot)
+        {
+            timer_node_t* node = *slot;
+            timer_wheel_unlink(node);
+            --wheel->count;
+            ++fired;
+            fn(node, arg);
+        }
+    }
+    return fired;
+}
+
+uint32_t timer_wheel_next(timer_wheel_t const* wheel)
+{
+    if (wheel->count == 0)
+    {
+        return UINT32_MAX;
+    }
+
+    uint32_t to_cascade = TIMER_WHEEL_SLOTS - (wheel->now & TIMER_SLOT_MASK);
+    for (uint32_t ticks = 1; ticks < to_cascade; ++ticks)
+    {
+        if (wheel->slots[0][(wheel->now + ticks) & TIMER_SLOT_MASK])
+        {
+            return ticks;
+        }
+    }
+    return to_cascade;
+}
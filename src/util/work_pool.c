@@ -0,0 +1,243 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "work_pool.h"
+
+typedef struct
+{
+    work_pool_t* pool;
+    size_t index;
+} work_worker_arg;
+
+/**
+ * Appends an item to the back of a deque, growing it if it's full.
+ */
+static int deque_push(work_deque_t* deque, work_item_t item)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->cap)
+    {
+        size_t new_cap = deque->cap * 2;
+        work_item_t* items = malloc(new_cap * sizeof(work_item_t));
+        if (!items)
+        {
+            pthread_mutex_unlock(&deque->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < deque->count; ++i)
+        {
+            items[i] = deque->items[(deque->head + i) % deque->cap];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->cap = new_cap;
+    }
+
+    deque->items[(deque->head + deque->count) % deque->cap] = item;
+    ++deque->count;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+/**
+ * Takes an item from the back (owner) or front (thief) of a deque.
+ *
+ * @return 1 if an item was taken, 0 if the deque was empty.
+ */
+static int deque_take(work_deque_t* deque, int steal, work_item_t* out)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == 0)
+    {
+        pthread_mutex_unlock(&deque->lock);
+        return 0;
+    }
+
+    if (steal)
+    {
+        *out = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->cap;
+    }
+    else
+    {
+        *out = deque->items[(deque->head + deque->count - 1) % deque->cap];
+    }
+    --deque->count;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+/**
+ * Takes the next item for the given worker, stealing if its own deque is empty.
+ *
+ * @return 1 if an item was taken, 0 if every deque was empty.
+ */
+static int pool_take(work_pool_t* pool, size_t index, work_item_t* out)
+{
+    // The owner works newest-first, since that item's data is most likely still in cache
+    if (deque_take(&pool->deques[index], 0, out))
+    {
+        return 1;
+    }
+
+    for (size_t i = 1; i < pool->num_workers; ++i)
+    {
+        if (deque_take(&pool->deques[(index + i) % pool->num_workers], 1, out))
+        {
+            atomic_fetch_add(&pool->stolen, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* work_worker(void* void_arg)
+{
+    work_worker_arg arg = *(work_worker_arg*)void_arg;
+    free(void_arg);
+    work_pool_t* pool = arg.pool;
+
+    while (1)
+    {
+        work_item_t item;
+        if (pool_take(pool, arg.index, &item))
+        {
+            atomic_fetch_sub(&pool->pending, 1);
+            item.fn(item.arg);
+            atomic_fetch_add(&pool->executed, 1);
+            continue;
+        }
+
+        // Announce that we're going to sleep before the last check, so that a submitter either sees us or we see
+        // its item
+        pthread_mutex_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->pending) == 0 && !pool->closed)
+        {
+            pthread_cond_wait(&pool->idle, &pool->idle_lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        int closed = pool->closed && atomic_load(&pool->pending) == 0;
+        pthread_mutex_unlock(&pool->idle_lock);
+
+        if (closed)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int work_pool_init(work_pool_t* pool, size_t num_workers, size_t deque_cap)
+{
+    pool->num_workers = num_workers;
+    pool->num_started = 0;
+    pool->closed = 0;
+    atomic_store(&pool->pending, 0);
+    atomic_store(&pool->sleepers, 0);
+    atomic_store(&pool->next_deque, 0);
+    atomic_store(&pool->executed, 0);
+    atomic_store(&pool->stolen, 0);
+
+    pool->deques = calloc(num_workers, sizeof(work_deque_t));
+    pool->threads = calloc(num_workers, sizeof(pthread_t));
+    if (!pool->deques || !pool->threads)
+    {
+        free(pool->deques);
+        free(pool->threads);
+        return -1;
+    }
+
+    if (pthread_mutex_init(&pool->idle_lock, NULL) != 0 || pthread_cond_init(&pool->idle, NULL) != 0)
+    {
+        free(pool->deques);
+        free(pool->threads);
+        return -1;
+    }
+
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        work_deque_t* deque = &pool->deques[i];
+        deque->cap = deque_cap ? deque_cap : 1;
+        deque->items = malloc(deque->cap * sizeof(work_item_t));
+        if (!deque->items || pthread_mutex_init(&deque->lock, NULL) != 0)
+        {
+            work_pool_destroy(pool);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        work_worker_arg* arg = malloc(sizeof(work_worker_arg));
+        if (!arg)
+        {
+            work_pool_destroy(pool);
+            return -1;
+        }
+        arg->pool = pool;
+        arg->index = i;
+        if (pthread_create(&pool->threads[i], NULL, work_worker, arg) != 0)
+        {
+            free(arg);
+            work_pool_destroy(pool);
+            return -1;
+        }
+        ++pool->num_started;
+    }
+
+    return 0;
+}
+
+int work_pool_submit(work_pool_t* pool, work_fn fn, void* arg)
+{
+    if (pool->closed)
+    {
+        return -1;
+    }
+
+    work_item_t item = {fn, arg};
+    size_t index = atomic_fetch_add(&pool->next_deque, 1) % pool->num_workers;
+    if (deque_push(&pool->deques[index], item) == -1)
+    {
+        return -1;
+    }
+
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->sleepers) > 0)
+    {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+    return 0;
+}
+
+void work_pool_destroy(work_pool_t* pool)
+{
+    pthread_mutex_lock(&pool->idle_lock);
+    pool->closed = 1;
+    pthread_cond_broadcast(&pool->idle);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (size_t i = 0; i < pool->num_started; ++i)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < pool->num_workers; ++i)
+    {
+        if (pool->deques[i].items)
+        {
+            free(pool->deques[i].items);
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+    }
+    free(pool->deques);
+    free(pool->threads);
+    pthread_cond_destroy(&pool->idle);
+    pthread_mutex_destroy(&pool->idle_lock);
+}